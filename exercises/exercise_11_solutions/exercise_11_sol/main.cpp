@@ -7,6 +7,7 @@
 #include <string>
 #include <glm/gtx/transform.hpp>
 #include "rt_renderer.h"
+#include "rasterizer.h"
 #include "primitives.h"
 
 #include "camera.h"
@@ -26,6 +27,11 @@ const unsigned int SCR_HEIGHT = 800;
 
 Camera camera(glm::vec3(0.9f, 0.0f, 1.5f));
 rt::Renderer renderer;
+raster::Rasterizer rasterizer;
+
+// which of the CPU renderers draws the frame
+enum RenderMode { RAY_TRACER, RASTERIZER, HYBRID };
+RenderMode renderMode = RAY_TRACER;
 
 float deltaTime = 0;
 unsigned int rtDepth = 2;
@@ -106,6 +112,8 @@ int main()
     // ----------------------------------
     // every frame we will: draw to it, upload it to a texture, and copy the texture to the window frame buffer.
     FrameBuffer<uint32_t> customBuffer(max_W, max_H);
+    // depth buffer, only used by the software rasterizer
+    FrameBuffer<float> depthBuffer(max_W, max_H);
 
 
     // initialize texture we will use to upload our buffer to GPU
@@ -139,6 +147,13 @@ int main()
     std::cout << "3 - two reflections" << std::endl;
     std::cout << "4 - three reflections" << std::endl;
     std::cout << "5 - four reflections" << std::endl;
+    std::cout << "L - grid of 100 coloured lights" << std::endl;
+    std::cout << "K - single white light" << std::endl;
+    std::cout << "P - add analytic spheres, boxes and a plane" << std::endl;
+    std::cout << "O - remove the analytic primitives" << std::endl;
+    std::cout << "R - software rasterizer (no lighting, triangles only)" << std::endl;
+    std::cout << "T - ray tracer" << std::endl;
+    std::cout << "H - hybrid, rasterized primary visibility and traced shadows/reflections" << std::endl;
 
     while (!glfwWindowShouldClose(window))
     {
@@ -154,7 +169,15 @@ int main()
 
         glm::mat4 scale = glm::scale(glm::vec3(.5f,.5f,.5f));
 
-        renderer.render(vts, glm::mat4(1), camera.GetViewMatrix(), 70.0f, rtDepth, customBuffer);
+        if (renderMode == RASTERIZER) {
+            depthBuffer.clearBuffer(1.0f);
+            glm::mat4 projection = glm::perspective(glm::radians(70.0f), (float) max_W / (float) max_H, .01f, 100.0f);
+            rasterizer.render(vts, projection * camera.GetViewMatrix(), customBuffer, depthBuffer);
+        }
+        else if (renderMode == HYBRID)
+            renderer.renderHybrid(vts, glm::mat4(1), camera.GetViewMatrix(), 70.0f, rtDepth, customBuffer);
+        else
+            renderer.render(vts, glm::mat4(1), camera.GetViewMatrix(), 70.0f, rtDepth, customBuffer);
 
         // show our rendered image
         // -----------------------
@@ -236,6 +259,33 @@ void processInput(GLFWwindow *window) {
     if (glfwGetKey(window, GLFW_KEY_4) == GLFW_PRESS) rtDepth = 4;
     if (glfwGetKey(window, GLFW_KEY_5) == GLFW_PRESS) rtDepth = 5;
 
+    if (glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS) {
+        // many dim lights close to the ceiling, each shading point still traces a single shadow ray
+        std::vector<rt::PointLight> lights;
+        for (int i = 0; i < 10; i++)
+            for (int j = 0; j < 10; j++)
+                lights.push_back(rt::PointLight{glm::vec3(-1.8f + i * .4f, 1.9f, -1.8f + j * .4f),
+                                                glm::vec4(.5f + .5f * (i % 2), .5f + .05f * j, .5f + .05f * i, 1),
+                                                .05f, 1.0f});
+        renderer.setLights(lights);
+    }
+    if (glfwGetKey(window, GLFW_KEY_K) == GLFW_PRESS)
+        renderer.setLights({rt::PointLight{glm::vec3(0, 1.9f, 0)}});
+
+    if (glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS && renderer.primitives.empty()) {
+        // smooth shapes that would need thousands of triangles each
+        renderer.primitives.spheres.add(glm::vec3(-.9f, -.3f, .5f), .4f, rt::red);
+        renderer.primitives.spheres.add(glm::vec3(.8f, .4f, -.6f), .3f, rt::blue);
+        renderer.primitives.boxes.add(glm::vec3(-1.2f, -1.2f, -1.2f), glm::vec3(-.6f, -.6f, -.6f), rt::green);
+        renderer.primitives.planes.add(glm::vec3(0, -1.f, 0), glm::vec3(0, 1, 0), rt::dark);
+    }
+    if (glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS)
+        renderer.primitives.clear();
+
+    if (glfwGetKey(window, GLFW_KEY_R) == GLFW_PRESS) renderMode = RASTERIZER;
+    if (glfwGetKey(window, GLFW_KEY_T) == GLFW_PRESS) renderMode = RAY_TRACER;
+    if (glfwGetKey(window, GLFW_KEY_H) == GLFW_PRESS) renderMode = HYBRID;
+
     // movement commands
     if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
         camera.ProcessKeyboard(FORWARD, deltaTime);
@@ -0,0 +1,296 @@
+#ifndef ITU_GRAPHICS_PROGRAMMING_RASTERIZER_H
+#define ITU_GRAPHICS_PROGRAMMING_RASTERIZER_H
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <glm/glm.hpp>
+#include "rt_types.h"
+#include "frame_buffer.h"
+
+namespace raster{
+    using namespace glm;
+
+    // Software rasterizer for the same rt::vertex triangle lists the ray tracer uses.
+    // The frame is split in square tiles. Triangles are clipped and set up in parallel, each thread bins its share of
+    // triangles into the tiles they overlap, then every tile is rasterized by a single thread, so tiles can be
+    // processed in parallel without synchronizing the color and depth writes. Pixels are tested with half-space edge
+    // functions, one row of a tile at a time, and all per pixel values are computed in plain arrays so the compiler
+    // can vectorize those loops.
+    class Rasterizer{
+
+        // a vertex of a clipped polygon, with its barycentric coordinates relative to the source triangle
+        struct ClipVertex{
+            vec4 pos;
+            vec3 bary;
+        };
+
+        // a triangle ready to be rasterized
+        struct SetupTriangle{
+            // edge functions e_i(x, y) = a_i * x + b_i * y + c_i, positive inside of the triangle
+            float a[3], b[3], c[3];
+            bool top_left[3];   // fill convention, pixels exactly on an edge belong to top and left edges only
+            float inv_area;     // 1 / (2 * area), normalizes the edge functions into barycentric coordinates
+            float z[3];         // depth of each vertex in [0, 1], linear in screen space
+            float inv_w[3];     // 1 / w of each vertex, for perspective correct interpolation
+            vec3 bary[3];       // barycentric coordinates of each vertex relative to the source triangle
+            int min_x, min_y, max_x, max_y; // pixel bounds, inclusive
+            unsigned int source; // index of the source triangle (first vertex index / 3)
+        };
+
+        // triangles set up by one thread, and the tiles each of them overlaps
+        struct ThreadBins{
+            std::vector<SetupTriangle> triangles;
+            std::vector<std::vector<unsigned int> > tiles;
+        };
+
+        std::vector<ThreadBins> thread_bins;
+
+    public:
+        // tile width and height in pixels
+        static const unsigned int tile_size = 32;
+        // number of threads used by the rasterizer, 0 uses all hardware threads
+        unsigned int thread_count = 0;
+        // triangles are only clipped against the sides of the frustum if they leave this enlarged viewport,
+        // the edge functions handle the parts that are outside of the screen but inside of the guard band
+        float guard_band = 4.0f;
+        bool cull_back_faces = false;
+
+        // rasterizes a triangle list with the given model-view-projection matrix, writing the interpolated vertex color
+        void render(const std::vector<rt::vertex> &vts,
+                    const mat4 &mvp,
+                    FrameBuffer<uint32_t> &fb,
+                    FrameBuffer<float> &depth){
+            uint32_t *colors = fb.buffer;
+            unsigned int width = fb.W;
+            rasterize(vts, mvp, depth, [&vts, colors, width](unsigned int x, unsigned int y, unsigned int tri, const vec3 &bary){
+                rt::vertex v = interpolate(vts[tri * 3], vts[tri * 3 + 1], vts[tri * 3 + 2], bary);
+                colors[x + y * width] = rt::Colors::toRGBA32(v.col);
+            });
+        }
+
+        // rasterizes a triangle list into the depth buffer, calling
+        //   fragment(x, y, triangle index, barycentric coordinates of the source triangle)
+        // for every pixel that passes the depth test. Fragments of one pixel are always produced by the same thread,
+        // in the order the triangles appear in the list.
+        template<class Fragment>
+        void rasterize(const std::vector<rt::vertex> &vts,
+                       const mat4 &mvp,
+                       FrameBuffer<float> &depth,
+                       Fragment fragment){
+            unsigned int threads = thread_count > 0 ? thread_count : std::max(1u, std::thread::hardware_concurrency());
+            unsigned int tiles_x = (depth.W + tile_size - 1) / tile_size;
+            unsigned int tiles_y = (depth.H + tile_size - 1) / tile_size;
+            unsigned int tile_count = tiles_x * tiles_y;
+            unsigned int triangle_count = (unsigned int) vts.size() / 3;
+
+            thread_bins.resize(threads);
+            for (ThreadBins &bins : thread_bins){
+                bins.triangles.clear();
+                bins.tiles.resize(tile_count);
+                for (std::vector<unsigned int> &tile : bins.tiles)
+                    tile.clear();
+            }
+
+            // 1. clip, set up and bin contiguous ranges of triangles, one range per thread
+            runParallel(threads, [&](unsigned int t){
+                ThreadBins &bins = thread_bins[t];
+                unsigned int begin = triangle_count * t / threads, end = triangle_count * (t + 1) / threads;
+                for (unsigned int tri = begin; tri < end; tri++) {
+                    unsigned int first = (unsigned int) bins.triangles.size();
+                    setupTriangle(vts, tri, mvp, depth.W, depth.H, bins.triangles);
+                    for (unsigned int i = first; i < bins.triangles.size(); i++) {
+                        const SetupTriangle &st = bins.triangles[i];
+                        for (int ty = st.min_y / (int) tile_size; ty <= st.max_y / (int) tile_size; ty++)
+                            for (int tx = st.min_x / (int) tile_size; tx <= st.max_x / (int) tile_size; tx++)
+                                bins.tiles[tx + ty * tiles_x].push_back(i);
+                    }
+                }
+            });
+
+            // 2. rasterize the tiles, threads take the next free tile until all are done
+            std::atomic<unsigned int> next_tile(0);
+            runParallel(threads, [&](unsigned int){
+                for (unsigned int tile = next_tile++; tile < tile_count; tile = next_tile++) {
+                    int x0 = (int) ((tile % tiles_x) * tile_size), y0 = (int) ((tile / tiles_x) * tile_size);
+                    int x1 = std::min(x0 + (int) tile_size, (int) depth.W) - 1;
+                    int y1 = std::min(y0 + (int) tile_size, (int) depth.H) - 1;
+                    // bins are visited in thread order, which is also the order of the triangles in the list
+                    for (const ThreadBins &bins : thread_bins)
+                        for (unsigned int i : bins.tiles[tile])
+                            rasterizeInTile(bins.triangles[i], x0, y0, x1, y1, depth, fragment);
+                }
+            });
+        }
+
+        // perspective correct attribute interpolation, done on the vertex as a flat array of floats
+        static rt::vertex interpolate(const rt::vertex &v0, const rt::vertex &v1, const rt::vertex &v2, const vec3 &bary){
+            static_assert(sizeof(rt::vertex) % sizeof(float) == 0, "rt::vertex must only contain floats");
+            const unsigned int n = sizeof(rt::vertex) / sizeof(float);
+            const float *f0 = reinterpret_cast<const float*>(&v0);
+            const float *f1 = reinterpret_cast<const float*>(&v1);
+            const float *f2 = reinterpret_cast<const float*>(&v2);
+            rt::vertex result;
+            float *out = reinterpret_cast<float*>(&result);
+            for (unsigned int i = 0; i < n; i++)
+                out[i] = f0[i] * bary.x + f1[i] * bary.y + f2[i] * bary.z;
+            return result;
+        }
+
+    private:
+        template<class Job>
+        static void runParallel(unsigned int threads, Job job){
+            std::vector<std::thread> workers;
+            for (unsigned int t = 1; t < threads; t++)
+                workers.emplace_back(job, t);
+            job(0u); // the calling thread does its share too
+            for (std::thread &worker : workers)
+                worker.join();
+        }
+
+        // Sutherland-Hodgman clipping of a convex polygon against the plane where distance(vertex) >= 0
+        template<class Distance>
+        static unsigned int clipPolygon(const ClipVertex *in, unsigned int count, ClipVertex *out, Distance distance){
+            unsigned int out_count = 0;
+            for (unsigned int i = 0; i < count; i++) {
+                const ClipVertex &a = in[i], &b = in[(i + 1) % count];
+                float da = distance(a.pos), db = distance(b.pos);
+                if (da >= 0) out[out_count++] = a;
+                if ((da >= 0) != (db >= 0)) {
+                    float t = da / (da - db);
+                    out[out_count++] = ClipVertex{mix(a.pos, b.pos, t), mix(a.bary, b.bary, t)};
+                }
+            }
+            return out_count;
+        }
+
+        // transforms and clips one source triangle, adds the resulting triangles (if any) to "out"
+        void setupTriangle(const std::vector<rt::vertex> &vts, unsigned int tri, const mat4 &mvp,
+                           unsigned int width, unsigned int height, std::vector<SetupTriangle> &out) const {
+            // a triangle clipped by 7 planes has at most 10 vertices
+            ClipVertex poly[16], temp[16];
+            poly[0] = ClipVertex{mvp * vts[tri * 3].pos, vec3(1, 0, 0)};
+            poly[1] = ClipVertex{mvp * vts[tri * 3 + 1].pos, vec3(0, 1, 0)};
+            poly[2] = ClipVertex{mvp * vts[tri * 3 + 2].pos, vec3(0, 0, 1)};
+            unsigned int count = 3;
+
+            // trivial rejection, all vertices outside of the same side of the view frustum
+            for (int axis = 0; axis < 3; axis++) {
+                if (poly[0].pos[axis] > poly[0].pos.w && poly[1].pos[axis] > poly[1].pos.w && poly[2].pos[axis] > poly[2].pos.w)
+                    return;
+                if (poly[0].pos[axis] < -poly[0].pos.w && poly[1].pos[axis] < -poly[1].pos.w && poly[2].pos[axis] < -poly[2].pos.w)
+                    return;
+            }
+
+            // only clip if a vertex is behind the near plane, beyond the far plane, or outside of the guard band
+            bool needs_clipping = false;
+            for (unsigned int i = 0; i < 3; i++) {
+                const vec4 &p = poly[i].pos;
+                float band = guard_band * p.w;
+                needs_clipping |= p.z < -p.w || p.z > p.w || p.x > band || p.x < -band || p.y > band || p.y < -band;
+            }
+            if (needs_clipping) {
+                float g = guard_band;
+                count = clipPolygon(poly, count, temp, [](const vec4 &p){ return p.z + p.w; });
+                count = clipPolygon(temp, count, poly, [](const vec4 &p){ return p.w - p.z; });
+                count = clipPolygon(poly, count, temp, [g](const vec4 &p){ return g * p.w - p.x; });
+                count = clipPolygon(temp, count, poly, [g](const vec4 &p){ return g * p.w + p.x; });
+                count = clipPolygon(poly, count, temp, [g](const vec4 &p){ return g * p.w - p.y; });
+                count = clipPolygon(temp, count, poly, [g](const vec4 &p){ return g * p.w + p.y; });
+                if (count < 3) return;
+            }
+
+            // viewport transformation, pixel centers are at (x + .5, y + .5)
+            vec2 screen[16];
+            float z[16], inv_w[16];
+            for (unsigned int i = 0; i < count; i++) {
+                inv_w[i] = 1.0f / poly[i].pos.w;
+                vec3 ndc = vec3(poly[i].pos) * inv_w[i];
+                screen[i] = vec2((ndc.x * .5f + .5f) * float(width), (ndc.y * .5f + .5f) * float(height));
+                z[i] = ndc.z * .5f + .5f;
+            }
+
+            // triangle fan
+            for (unsigned int i = 1; i + 1 < count; i++) {
+                const unsigned int ids[3] = {0, i, i + 1};
+                const vec2 &p0 = screen[ids[0]], &p1 = screen[ids[1]], &p2 = screen[ids[2]];
+                float area2 = (p1.x - p0.x) * (p2.y - p0.y) - (p1.y - p0.y) * (p2.x - p0.x);
+                if (area2 == 0 || (cull_back_faces && area2 < 0)) continue;
+
+                SetupTriangle st;
+                float orientation = area2 > 0 ? 1.0f : -1.0f;
+                for (unsigned int e = 0; e < 3; e++) {
+                    // edge e is opposite to vertex e
+                    const vec2 &from = screen[ids[(e + 1) % 3]], &to = screen[ids[(e + 2) % 3]];
+                    st.a[e] = -(to.y - from.y) * orientation;
+                    st.b[e] = (to.x - from.x) * orientation;
+                    st.c[e] = -(st.a[e] * from.x + st.b[e] * from.y);
+                    st.top_left[e] = st.a[e] > 0 || (st.a[e] == 0 && st.b[e] < 0);
+                    st.z[e] = z[ids[e]];
+                    st.inv_w[e] = inv_w[ids[e]];
+                    st.bary[e] = poly[ids[e]].bary;
+                }
+                st.inv_area = 1.0f / (area2 * orientation);
+
+                vec2 b_min = min(min(p0, p1), p2), b_max = max(max(p0, p1), p2);
+                st.min_x = std::max(0, (int) std::ceil(b_min.x - .5f));
+                st.min_y = std::max(0, (int) std::ceil(b_min.y - .5f));
+                st.max_x = std::min((int) width - 1, (int) std::floor(b_max.x - .5f));
+                st.max_y = std::min((int) height - 1, (int) std::floor(b_max.y - .5f));
+                if (st.min_x > st.max_x || st.min_y > st.max_y) continue;
+
+                st.source = tri;
+                out.push_back(st);
+            }
+        }
+
+        template<class Fragment>
+        void rasterizeInTile(const SetupTriangle &st, int tile_x0, int tile_y0, int tile_x1, int tile_y1,
+                             FrameBuffer<float> &depth, Fragment &fragment) const {
+            int x0 = std::max(st.min_x, tile_x0), x1 = std::min(st.max_x, tile_x1);
+            int y0 = std::max(st.min_y, tile_y0), y1 = std::min(st.max_y, tile_y1);
+            if (x0 > x1 || y0 > y1) return;
+            unsigned int n = (unsigned int) (x1 - x0 + 1);
+
+            // per pixel values of one row of the tile
+            float l0[tile_size], l1[tile_size], l2[tile_size], pz[tile_size];
+            unsigned char inside[tile_size];
+
+            for (int y = y0; y <= y1; y++) {
+                float py = float(y) + .5f;
+                float row0 = st.b[0] * py + st.c[0], row1 = st.b[1] * py + st.c[1], row2 = st.b[2] * py + st.c[2];
+
+                // edge functions, coverage and depth for the whole row, no branches so it can be vectorized
+                for (unsigned int i = 0; i < n; i++) {
+                    float px = float(x0 + (int) i) + .5f;
+                    float e0 = st.a[0] * px + row0, e1 = st.a[1] * px + row1, e2 = st.a[2] * px + row2;
+                    inside[i] = (unsigned char) ((e0 > 0 || (e0 == 0 && st.top_left[0])) &
+                                                 (e1 > 0 || (e1 == 0 && st.top_left[1])) &
+                                                 (e2 > 0 || (e2 == 0 && st.top_left[2])));
+                    l0[i] = e0 * st.inv_area;
+                    l1[i] = e1 * st.inv_area;
+                    l2[i] = e2 * st.inv_area;
+                    pz[i] = l0[i] * st.z[0] + l1[i] * st.z[1] + l2[i] * st.z[2];
+                }
+
+                float *depth_row = depth.buffer + y * depth.W;
+                for (unsigned int i = 0; i < n; i++) {
+                    unsigned int x = (unsigned int) x0 + i;
+                    if (!inside[i] || pz[i] >= depth_row[x] || pz[i] < 0) continue;
+                    depth_row[x] = pz[i];
+
+                    // perspective correct barycentric coordinates, then mapped back to the source triangle
+                    vec3 p(l0[i] * st.inv_w[0], l1[i] * st.inv_w[1], l2[i] * st.inv_w[2]);
+                    p /= p.x + p.y + p.z;
+                    vec3 bary = st.bary[0] * p.x + st.bary[1] * p.y + st.bary[2] * p.z;
+                    fragment(x, (unsigned int) y, st.source, bary);
+                }
+            }
+        }
+    };
+}
+
+
+#endif //ITU_GRAPHICS_PROGRAMMING_RASTERIZER_H
@@ -0,0 +1,149 @@
+#ifndef ITU_GRAPHICS_PROGRAMMING_RT_LIGHTS_H
+#define ITU_GRAPHICS_PROGRAMMING_RT_LIGHTS_H
+
+#include <vector>
+#include <algorithm>
+#include <glm/glm.hpp>
+#include "rt_types.h"
+
+namespace rt{
+
+    struct PointLight{
+        glm::vec3 position;
+        Colors::color color = Colors::white;
+        float intensity = 1.0f;
+        // distance at which the light reaches half of its intensity, 0 disables the attenuation (exercise 11.3 light)
+        float radius = 0.0f;
+
+        // light reaching a point at distance "dist" from the light source
+        Colors::color emitted(float dist) const {
+            float attenuation = radius > 0 ? 1.0f / (1.0f + (dist * dist) / (radius * radius)) : 1.0f;
+            return color * (intensity * attenuation);
+        }
+
+        // scalar estimate of how much light this source emits, used to build the importance of the light tree
+        float power() const {
+            return intensity * glm::max(glm::dot(glm::vec3(color), glm::vec3(0.2126f, 0.7152f, 0.0722f)), 0.0f);
+        }
+    };
+
+
+    // Binary bounding volume hierarchy over point lights, used to pick one light per shadow ray with a probability
+    // proportional to an estimate of its contribution at the shading point. The cost of a pick is O(log(#lights)),
+    // so the number of shadow rays per hit no longer depends on how many lights are in the scene.
+    class LightBVH{
+
+        struct Node{
+            glm::vec3 bb_min, bb_max;
+            float power = 0;       // sum of the power of all lights in the subtree
+            float max_radius = 0;  // largest attenuation radius in the subtree, negative if any light is not attenuated
+            int left = -1, right = -1; // child node indices, both -1 for a leaf
+            int light = -1;        // light index, only valid in leaves
+        };
+
+        std::vector<Node> nodes;
+        std::vector<unsigned int> order; // light indices sorted during the build
+
+    public:
+        void build(const std::vector<PointLight> &lights){
+            nodes.clear();
+            order.resize(lights.size());
+            for (unsigned int i = 0; i < order.size(); i++)
+                order[i] = i;
+            if (lights.empty()) return;
+            nodes.reserve(lights.size() * 2);
+            buildRecursive(lights, 0, (unsigned int) lights.size());
+        }
+
+        bool empty() const { return nodes.empty(); }
+
+        // traverse the tree from the root, choosing a child proportionally to its importance at the shading point,
+        // u is a uniform random number in [0, 1) that gets rescaled at each step, so one number is enough for the full
+        // descent. Returns the index of the chosen light (or -1 if no light can reach the point) and its probability.
+        int sample(const glm::vec3 &pos, const glm::vec3 &normal, float u, float &pdf) const {
+            pdf = 0;
+            if (nodes.empty()) return -1;
+            if (importance(nodes[0], pos, normal) <= 0) return -1;
+
+            pdf = 1;
+            int current = 0;
+            while (nodes[current].light < 0){
+                const Node &node = nodes[current];
+                float i_left = importance(nodes[node.left], pos, normal);
+                float i_right = importance(nodes[node.right], pos, normal);
+                if (i_left + i_right <= 0){
+                    // the bounds of the parent were too conservative, no light in this subtree faces the point
+                    pdf = 0;
+                    return -1;
+                }
+                float p_left = i_left / (i_left + i_right);
+                if (u < p_left){
+                    u = glm::min(u / p_left, 0.99999994f);
+                    pdf *= p_left;
+                    current = node.left;
+                }
+                else{
+                    u = glm::min((u - p_left) / (1.0f - p_left), 0.99999994f);
+                    pdf *= 1.0f - p_left;
+                    current = node.right;
+                }
+            }
+            return nodes[current].light;
+        }
+
+    private:
+        int buildRecursive(const std::vector<PointLight> &lights, unsigned int begin, unsigned int end){
+            int index = (int) nodes.size();
+            nodes.push_back(Node());
+
+            Node node;
+            node.bb_min = glm::vec3(FLT_MAX);
+            node.bb_max = glm::vec3(-FLT_MAX);
+            for (unsigned int i = begin; i < end; i++){
+                const PointLight &light = lights[order[i]];
+                node.bb_min = glm::min(node.bb_min, light.position);
+                node.bb_max = glm::max(node.bb_max, light.position);
+                node.power += light.power();
+                node.max_radius = (light.radius <= 0 || node.max_radius < 0) ? -1.0f : glm::max(node.max_radius, light.radius);
+            }
+
+            if (end - begin == 1){
+                node.light = (int) order[begin];
+            }
+            else {
+                // median split along the largest axis of the bounding box
+                glm::vec3 extent = node.bb_max - node.bb_min;
+                int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+                unsigned int mid = (begin + end) / 2;
+                std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end,
+                                 [&lights, axis](unsigned int a, unsigned int b){
+                                     return lights[a].position[axis] < lights[b].position[axis];
+                                 });
+                node.left = buildRecursive(lights, begin, mid);
+                node.right = buildRecursive(lights, mid, end);
+            }
+
+            nodes[index] = node;
+            return index;
+        }
+
+        // conservative estimate of the light a subtree delivers at a surface point
+        static float importance(const Node &node, const glm::vec3 &pos, const glm::vec3 &normal){
+            // ignore nodes that are completely behind the surface
+            glm::vec3 farthest = glm::vec3(normal.x > 0 ? node.bb_max.x : node.bb_min.x,
+                                           normal.y > 0 ? node.bb_max.y : node.bb_min.y,
+                                           normal.z > 0 ? node.bb_max.z : node.bb_min.z);
+            if (glm::dot(farthest - pos, normal) <= 0) return 0;
+
+            if (node.max_radius < 0) return node.power;
+
+            // distance from the point to the bounding box of the lights
+            glm::vec3 closest = glm::clamp(pos, node.bb_min, node.bb_max);
+            float dist2 = glm::dot(closest - pos, closest - pos);
+            return node.power / (1.0f + dist2 / (node.max_radius * node.max_radius));
+        }
+    };
+}
+
+
+#endif //ITU_GRAPHICS_PROGRAMMING_RT_LIGHTS_H
@@ -0,0 +1,233 @@
+#ifndef ITU_GRAPHICS_PROGRAMMING_RT_PRIMITIVES_H
+#define ITU_GRAPHICS_PROGRAMMING_RT_PRIMITIVES_H
+
+#include <vector>
+#include <cmath>
+#include <glm/glm.hpp>
+#include "rt_types.h"
+
+namespace rt{
+
+    // Analytic primitives. Each type is stored in its own bucket as a structure of arrays (one array per attribute),
+    // so the intersection loops read contiguous floats and can be vectorized by the compiler. The intersectors work in
+    // blocks: first they compute the hit distance of every primitive in the block without branches (FLT_MAX for a
+    // miss), then they pick the closest one.
+    const unsigned int primitive_block = 16;
+
+    // axis aligned bounding box of a bucket, tested before the primitives in it
+    struct BucketBounds{
+        glm::vec3 bb_min = glm::vec3(FLT_MAX);
+        glm::vec3 bb_max = glm::vec3(-FLT_MAX);
+
+        void grow(const glm::vec3 &p_min, const glm::vec3 &p_max){
+            bb_min = glm::min(bb_min, p_min);
+            bb_max = glm::max(bb_max, p_max);
+        }
+
+        // slab test, returns false if the ray misses the box or the box is further away than max_dist
+        bool intersect(const Ray &ray, float max_dist) const {
+            glm::vec3 inv_dir = 1.0f / ray.direction;
+            glm::vec3 t0 = (bb_min - ray.origin) * inv_dir;
+            glm::vec3 t1 = (bb_max - ray.origin) * inv_dir;
+            glm::vec3 t_near = glm::min(t0, t1), t_far = glm::max(t0, t1);
+            float enter = glm::max(glm::max(t_near.x, t_near.y), glm::max(t_near.z, 0.0f));
+            float exit = glm::min(glm::min(t_far.x, t_far.y), glm::min(t_far.z, max_dist));
+            return enter <= exit;
+        }
+    };
+
+    // closest valid distance in a block, returns the index in the block or -1
+    inline int closestInBlock(const float *t, unsigned int count, float &closest){
+        int found = -1;
+        for (unsigned int i = 0; i < count; i++){
+            if (t[i] < closest){
+                closest = t[i];
+                found = (int) i;
+            }
+        }
+        return found;
+    }
+
+
+    struct SphereBucket{
+        std::vector<float> cx, cy, cz, radius;
+        std::vector<Colors::color> colors;
+        BucketBounds bounds;
+
+        unsigned int size() const { return (unsigned int) radius.size(); }
+
+        void add(const glm::vec3 &center, float r, const Colors::color &col){
+            cx.push_back(center.x); cy.push_back(center.y); cz.push_back(center.z);
+            radius.push_back(r);
+            colors.push_back(col);
+            bounds.grow(center - glm::vec3(r), center + glm::vec3(r));
+        }
+
+        bool intersect(const Ray &ray, Hit &hit) const {
+            if (radius.empty() || !bounds.intersect(ray, hit.dist)) return false;
+            const glm::vec3 o = ray.origin, d = ray.direction; // d is normalized
+            bool found = false;
+            float t[primitive_block];
+            for (unsigned int first = 0; first < size(); first += primitive_block){
+                unsigned int count = glm::min(primitive_block, size() - first);
+                for (unsigned int i = 0; i < count; i++){
+                    unsigned int j = first + i;
+                    // solve |o + t*d - c|^2 = r^2 for the nearest positive t
+                    float ocx = o.x - cx[j], ocy = o.y - cy[j], ocz = o.z - cz[j];
+                    float b = ocx * d.x + ocy * d.y + ocz * d.z;
+                    float c = ocx * ocx + ocy * ocy + ocz * ocz - radius[j] * radius[j];
+                    float disc = b * b - c;
+                    float sq = std::sqrt(glm::max(disc, 0.0f));
+                    float t_near = -b - sq, t_far = -b + sq;
+                    float t_hit = t_near > 0 ? t_near : t_far; // the ray can start inside the sphere
+                    t[i] = (disc >= 0 && t_hit > 0) ? t_hit : FLT_MAX;
+                }
+                int i = closestInBlock(t, count, hit.dist);
+                if (i >= 0){
+                    hit.type = PrimitiveType::Sphere;
+                    hit.hit_ID = (int)(first + i);
+                    found = true;
+                }
+            }
+            return found;
+        }
+
+        void surface(const glm::vec3 &pos, int id, glm::vec3 &normal, Colors::color &col) const {
+            normal = (pos - glm::vec3(cx[id], cy[id], cz[id])) / radius[id];
+            col = colors[id];
+        }
+    };
+
+
+    struct BoxBucket{
+        std::vector<float> min_x, min_y, min_z, max_x, max_y, max_z;
+        std::vector<Colors::color> colors;
+        BucketBounds bounds;
+
+        unsigned int size() const { return (unsigned int) min_x.size(); }
+
+        void add(const glm::vec3 &b_min, const glm::vec3 &b_max, const Colors::color &col){
+            min_x.push_back(b_min.x); min_y.push_back(b_min.y); min_z.push_back(b_min.z);
+            max_x.push_back(b_max.x); max_y.push_back(b_max.y); max_z.push_back(b_max.z);
+            colors.push_back(col);
+            bounds.grow(b_min, b_max);
+        }
+
+        bool intersect(const Ray &ray, Hit &hit) const {
+            if (min_x.empty() || !bounds.intersect(ray, hit.dist)) return false;
+            const glm::vec3 o = ray.origin, inv_d = 1.0f / ray.direction;
+            bool found = false;
+            float t[primitive_block];
+            for (unsigned int first = 0; first < size(); first += primitive_block){
+                unsigned int count = glm::min(primitive_block, size() - first);
+                for (unsigned int i = 0; i < count; i++){
+                    unsigned int j = first + i;
+                    // slab test, one pair of planes per axis
+                    float tx0 = (min_x[j] - o.x) * inv_d.x, tx1 = (max_x[j] - o.x) * inv_d.x;
+                    float ty0 = (min_y[j] - o.y) * inv_d.y, ty1 = (max_y[j] - o.y) * inv_d.y;
+                    float tz0 = (min_z[j] - o.z) * inv_d.z, tz1 = (max_z[j] - o.z) * inv_d.z;
+                    float enter = glm::max(glm::max(glm::min(tx0, tx1), glm::min(ty0, ty1)), glm::min(tz0, tz1));
+                    float exit = glm::min(glm::min(glm::max(tx0, tx1), glm::max(ty0, ty1)), glm::max(tz0, tz1));
+                    float t_hit = enter > 0 ? enter : exit; // the ray can start inside the box
+                    t[i] = (enter <= exit && t_hit > 0) ? t_hit : FLT_MAX;
+                }
+                int i = closestInBlock(t, count, hit.dist);
+                if (i >= 0){
+                    hit.type = PrimitiveType::Box;
+                    hit.hit_ID = (int)(first + i);
+                    found = true;
+                }
+            }
+            return found;
+        }
+
+        void surface(const glm::vec3 &pos, int id, glm::vec3 &normal, Colors::color &col) const {
+            // the normal is the axis in which the hit point is closest to a face of the box
+            glm::vec3 b_min(min_x[id], min_y[id], min_z[id]), b_max(max_x[id], max_y[id], max_z[id]);
+            glm::vec3 center = (b_min + b_max) * .5f, half = (b_max - b_min) * .5f;
+            glm::vec3 local = (pos - center) / half;
+            glm::vec3 a = glm::abs(local);
+            int axis = a.x > a.y ? (a.x > a.z ? 0 : 2) : (a.y > a.z ? 1 : 2);
+            normal = glm::vec3(0);
+            normal[axis] = local[axis] > 0 ? 1.0f : -1.0f;
+            col = colors[id];
+        }
+    };
+
+
+    // planes are infinite, so this bucket has no bounds
+    struct PlaneBucket{
+        // plane equation: dot(normal, p) = offset
+        std::vector<float> nx, ny, nz, offset;
+        std::vector<Colors::color> colors;
+
+        unsigned int size() const { return (unsigned int) offset.size(); }
+
+        void add(const glm::vec3 &point, const glm::vec3 &normal, const Colors::color &col){
+            glm::vec3 n = glm::normalize(normal);
+            nx.push_back(n.x); ny.push_back(n.y); nz.push_back(n.z);
+            offset.push_back(glm::dot(n, point));
+            colors.push_back(col);
+        }
+
+        bool intersect(const Ray &ray, Hit &hit) const {
+            const glm::vec3 o = ray.origin, d = ray.direction;
+            bool found = false;
+            float t[primitive_block];
+            for (unsigned int first = 0; first < size(); first += primitive_block){
+                unsigned int count = glm::min(primitive_block, size() - first);
+                for (unsigned int i = 0; i < count; i++){
+                    unsigned int j = first + i;
+                    float denom = nx[j] * d.x + ny[j] * d.y + nz[j] * d.z;
+                    float t_hit = (offset[j] - (nx[j] * o.x + ny[j] * o.y + nz[j] * o.z)) / denom;
+                    t[i] = (std::abs(denom) > 10e-7f && t_hit > 0) ? t_hit : FLT_MAX;
+                }
+                int i = closestInBlock(t, count, hit.dist);
+                if (i >= 0){
+                    hit.type = PrimitiveType::Plane;
+                    hit.hit_ID = (int)(first + i);
+                    found = true;
+                }
+            }
+            return found;
+        }
+
+        void surface(const glm::vec3 &pos, int id, glm::vec3 &normal, Colors::color &col) const {
+            normal = glm::vec3(nx[id], ny[id], nz[id]);
+            col = colors[id];
+        }
+    };
+
+
+    // all analytic primitives of a scene, one bucket per type
+    struct PrimitiveBuckets{
+        SphereBucket spheres;
+        BoxBucket boxes;
+        PlaneBucket planes;
+
+        bool empty() const { return spheres.size() + boxes.size() + planes.size() == 0; }
+
+        void clear() { *this = PrimitiveBuckets(); }
+
+        // only hits closer than hit.dist are reported, so this can be called after the triangle intersection
+        bool intersect(const Ray &ray, Hit &hit) const {
+            bool found = spheres.intersect(ray, hit);
+            found |= boxes.intersect(ray, hit);
+            found |= planes.intersect(ray, hit);
+            return found;
+        }
+
+        // normal and color at the position where the ray hit an analytic primitive
+        void surface(const glm::vec3 &pos, const Hit &hit, glm::vec3 &normal, Colors::color &col) const {
+            switch (hit.type) {
+                case PrimitiveType::Sphere: spheres.surface(pos, hit.hit_ID, normal, col); break;
+                case PrimitiveType::Box: boxes.surface(pos, hit.hit_ID, normal, col); break;
+                case PrimitiveType::Plane: planes.surface(pos, hit.hit_ID, normal, col); break;
+                default: break;
+            }
+        }
+    };
+}
+
+
+#endif //ITU_GRAPHICS_PROGRAMMING_RT_PRIMITIVES_H
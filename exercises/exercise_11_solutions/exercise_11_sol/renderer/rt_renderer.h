@@ -6,10 +6,15 @@
 #define ITU_GRAPHICS_PROGRAMMING_RT_RENDERER_H
 
 #include <vector>
+#include <memory>
+#include <cstring>
 #include <glm/glm.hpp>
 #include <glm/gtx/transform.hpp>
 #include "rt_types.h"
+#include "rt_lights.h"
+#include "rt_primitives.h"
 #include "frame_buffer.h"
+#include "rasterizer.h"
 
 namespace rt{
     using namespace Colors;
@@ -21,7 +26,89 @@ namespace rt{
         // mixture parameter for combining local illumination and reflected color
         float p_rg = 0.4f;
 
+        // light sources in model space, and the tree used to pick which of them receive a shadow ray
+        std::vector<PointLight> lights;
+        LightBVH light_tree;
+
+        // per pixel output of the rasterization pass of renderHybrid
+        struct VisibilitySample{
+            int hit_ID = -1; // index of the first vertex of the visible triangle, negative if the pixel is empty
+            vec3 barycentric;
+        };
+        std::unique_ptr<FrameBuffer<VisibilitySample> > visibility;
+        std::unique_ptr<FrameBuffer<float> > raster_depth;
+
     public:
+        // number of shadow rays per intersection, independent of the number of lights in the scene
+        unsigned int light_samples = 1;
+
+        // analytic primitives (spheres, boxes and planes) that are traced together with the triangle list
+        PrimitiveBuckets primitives;
+
+        // rasterizer used for the primary visibility of renderHybrid
+        raster::Rasterizer rasterizer;
+
+        Renderer(){
+            // the single point light from exercise 11.3
+            setLights({PointLight{vec3(0,1.9f,0)}});
+        }
+
+        void setLights(const std::vector<PointLight> &scene_lights){
+            lights = scene_lights;
+            light_tree.build(lights);
+        }
+
+        // camera set up shared by render and renderHybrid, so both modes generate exactly the same primary rays
+        struct PrimaryRays{
+            mat4 view_to_model;
+            vec4 lower_left_corner;
+            vec4 cam_pos;
+            vec2 pixel_size;
+
+            PrimaryRays(const glm::mat4 &m, const glm::mat4 &v, const float fov_degrees, unsigned int W, unsigned int H){
+                float aspect_ratio = H / W;
+                // we use the fov and the tangent function to compute where is the bottom of the projection plane,
+                // we assume that the projection place is 1 unit in front of the camera (z == -1)
+                float bottom = - tan(abs(radians(fov_degrees)) * 0.5f);
+
+                // find the transformation that move points from camera space to model space
+                view_to_model = inverse(v * m);
+                // the bottom left corner of the image plane/camera sensor
+                lower_left_corner = vec4(bottom * aspect_ratio, bottom, -1, 1);
+                // we transform the camera position (also the convergence point of light rays) from camera coordinates to MODEL coordinates
+                // notice that we implicitly assume that the camera position is at 0,0,0 in its one coordinate space
+                cam_pos = view_to_model * vec4(0,0,0,1);
+
+                // the distance from the center of one pixel to the next along the horizontal and vertical axes of the screen
+                // notice that * and / are applied component wise
+                pixel_size = abs(vec2(lower_left_corner)) * 2.0f / vec2(H, W);
+            }
+
+            Ray rayAt(unsigned int c, unsigned int r) const {
+                vec4 pixel_pos = lower_left_corner + vec4 (vec2(c, r) * pixel_size,0, 0);
+                pixel_pos = view_to_model * pixel_pos;  // transform from camera coord space to model coord space
+                return Ray(cam_pos, normalize(pixel_pos - cam_pos));
+            }
+
+            // projection matrix that places the center of raster pixel (c, r) exactly where rayAt(c, r) crosses the
+            // image plane, so a rasterizer using it sees the same surface points as the primary rays
+            mat4 projection(unsigned int W, unsigned int H, float near = .001f, float far = 1000.0f) const {
+                // raster pixel centers are at x + .5, so ndc.x = 2 * ((u - lower_left_corner.x) / pixel_size.x + .5) / W - 1,
+                // where u = x / -z is the position on the image plane, and the same for y
+                vec2 scale = 2.0f / (vec2(W, H) * pixel_size);
+                vec2 offset = (1.0f - 2.0f * vec2(lower_left_corner) / pixel_size) / vec2(W, H) - 1.0f;
+                mat4 proj(0);
+                proj[0][0] = scale.x;
+                proj[1][1] = scale.y;
+                proj[2][0] = -offset.x;
+                proj[2][1] = -offset.y;
+                proj[2][2] = -(far + near) / (far - near);
+                proj[2][3] = -1;
+                proj[3][2] = -2.0f * far * near / (far - near);
+                return proj;
+            }
+        };
+
         void render(const std::vector<vertex> &vts,
                     const glm::mat4 &m,
                     const glm::mat4 &v,
@@ -29,23 +116,7 @@ namespace rt{
                     unsigned int depth,
                     FrameBuffer <uint32_t> &fb) {
 
-            float aspect_ratio = fb.H / fb.W;
-            // we use the fov and the tangent function to compute where is the bottom of the projection plane,
-            // we assume that the projection place is 1 unit in front of the camera (z == -1)
-            float bottom = - tan(abs(radians(fov_degrees)) * 0.5f);
-
-            // find the transformation that move points from camera space to model space
-            mat4 view_to_model = inverse(v * m);
-            // the bottom left corner of the image plane/camera sensor
-            vec4 lower_left_corner = vec4(bottom * aspect_ratio, bottom, -1, 1);
-            // we transform the camera position (also the convergence point of light rays) from camera coordinates to MODEL coordinates
-            // notice that we implicitly assume that the camera position is at 0,0,0 in its one coordinate space
-            vec4 cam_pos = view_to_model * vec4(0,0,0,1);
-
-            // the distance from the center of one pixel to the next along the horizontal and vertical axes of the screen
-            // notice that * and / are applied component wise
-            vec2 pixel_size = abs(vec2(lower_left_corner)) * 2.0f / vec2(fb.H, fb.W);
-
+            PrimaryRays rays(m, v, fov_degrees, fb.W, fb.H);
 
             // TODO ex 11.1 iterate through all pixels in the buffer (width: [0, fb.W), height:[0, fb.H])
             //  for each pixel,
@@ -58,9 +129,7 @@ namespace rt{
             //  - call the TraceRay method using that ray, and store the resulting color in the frame buffer (fb)
             for (int c = 0; c < fb.W; c++){
                 for(int r = 0; r < fb.H; r++){
-                    vec4 pixel_pos = lower_left_corner + vec4 (vec2(c, r) * pixel_size,0, 0);
-                    pixel_pos = view_to_model * pixel_pos;  // transform from camera coord space to model coord space
-                    Ray ray(cam_pos, normalize(pixel_pos - cam_pos));
+                    Ray ray = rays.rayAt(c, r);
                     color col = traceRay(ray, depth, vts);  // trace te ray / compute the color
                     fb.paintAt(c, r, toRGBA32(col));        // set the color on the frame buffer
                 }
@@ -68,6 +137,56 @@ namespace rt{
 
         }
 
+        // Same image as render, but primary visibility is rasterized instead of traced. The rasterizer writes the
+        // triangle ID and barycentric coordinates of the closest surface into a visibility buffer, and only the shadow
+        // and reflection rays are traced from those surface points.
+        void renderHybrid(const std::vector<vertex> &vts,
+                          const glm::mat4 &m,
+                          const glm::mat4 &v,
+                          const float fov_degrees,
+                          unsigned int depth,
+                          FrameBuffer <uint32_t> &fb) {
+            depth = depth > max_recursion ? max_recursion : depth;
+            PrimaryRays rays(m, v, fov_degrees, fb.W, fb.H);
+
+            if (!visibility || visibility->W != fb.W || visibility->H != fb.H) {
+                visibility.reset(new FrameBuffer<VisibilitySample>(fb.W, fb.H));
+                raster_depth.reset(new FrameBuffer<float>(fb.W, fb.H));
+            }
+            visibility->clearBuffer(VisibilitySample());
+            raster_depth->clearBuffer(1.0f);
+
+            // 1. visibility buffer
+            VisibilitySample *samples = visibility->buffer;
+            unsigned int width = fb.W;
+            rasterizer.rasterize(vts, rays.projection(fb.W, fb.H) * v * m, *raster_depth,
+                                 [samples, width](unsigned int x, unsigned int y, unsigned int tri, const vec3 &bary){
+                                     samples[x + y * width] = VisibilitySample{(int) tri * 3, bary};
+                                 });
+
+            // 2. shade the visible surface points, tracing only secondary rays
+            for (unsigned int c = 0; c < fb.W; c++){
+                for (unsigned int r = 0; r < fb.H; r++){
+                    Ray ray = rays.rayAt(c, r);
+                    const VisibilitySample &sample = visibility->buffer[c + r * fb.W];
+                    Hit hitInfo;
+                    if (sample.hit_ID >= 0) {
+                        const vec3 &b = sample.barycentric;
+                        vec3 i_pos = vec3(vts[sample.hit_ID].pos) * b.x + vec3(vts[sample.hit_ID+1].pos) * b.y + vec3(vts[sample.hit_ID+2].pos) * b.z;
+                        hitInfo.hit_ID = sample.hit_ID;
+                        hitInfo.barycentric = b;
+                        hitInfo.dist = length(i_pos - ray.origin);
+                    }
+                    // analytic primitives are not rasterized, so they are still intersected with the primary ray
+                    // (only hits closer than the rasterized surface are reported)
+                    primitives.intersect(ray, hitInfo);
+
+                    color col = hitInfo.hit_ID < 0 ? black : shade(ray, hitInfo, depth, vts);
+                    fb.paintAt(c, r, toRGBA32(col));
+                }
+            }
+        }
+
 
         color traceRay(const Ray & ray,
                        unsigned int depth,
@@ -75,34 +194,57 @@ namespace rt{
             // this is here to ensure we don't end up with a long recursion that can freeze the program (or cause a stack overflow)
             depth = depth > max_recursion ? max_recursion : depth;
 
-            color col = black; // used to output a color
             Hit hitInfo; // used to store the hit information
-            if (!rayModelIntersection(ray, vts, hitInfo)) return col; // no hit, return black
-
+            if (!rayIntersection(ray, vts, hitInfo)) return black; // no hit, return black
 
-            // TODO ex 11.2 replace the current i_normal and i_col computation with their interpolated versions
-            vec3 i_normal = vts[hitInfo.hit_ID].norm * hitInfo.barycentric.x + vts[hitInfo.hit_ID+1].norm * hitInfo.barycentric.y + vts[hitInfo.hit_ID+2].norm * hitInfo.barycentric.z;
-            i_normal = normalize(i_normal);
-            color i_col = vts[hitInfo.hit_ID].col * hitInfo.barycentric.x + vts[hitInfo.hit_ID+1].col * hitInfo.barycentric.y + vts[hitInfo.hit_ID+2].col * hitInfo.barycentric.z;
+            return shade(ray, hitInfo, depth, vts);
+        }
 
+        // color of the surface point found by the ray, includes direct lighting and the reflection rays
+        color shade(const Ray & ray,
+                    const Hit & hitInfo,
+                    unsigned int depth,
+                    const std::vector<vertex> &vts){
+            color col = black; // used to output a color
             vec3 i_pos = ray.origin + ray.direction * hitInfo.dist;
 
+            vec3 i_normal;
+            color i_col;
+            if (hitInfo.type == PrimitiveType::Triangle) {
+                // TODO ex 11.2 replace the current i_normal and i_col computation with their interpolated versions
+                i_normal = vts[hitInfo.hit_ID].norm * hitInfo.barycentric.x + vts[hitInfo.hit_ID+1].norm * hitInfo.barycentric.y + vts[hitInfo.hit_ID+2].norm * hitInfo.barycentric.z;
+                i_normal = normalize(i_normal);
+                i_col = vts[hitInfo.hit_ID].col * hitInfo.barycentric.x + vts[hitInfo.hit_ID+1].col * hitInfo.barycentric.y + vts[hitInfo.hit_ID+2].col * hitInfo.barycentric.z;
+            }
+            else
+                primitives.surface(i_pos, hitInfo, i_normal, i_col);
+
             // TODO ex 11.3 implement the phong reflection model for the point light below
             float ambient = 0.1f, diffuse = 0.5f, specular = 0.5f, shininess = 10;
-            vec3 light_pos(0,1.9f,0); // light position in model space
-            vec3 light_dir = normalize(light_pos - i_pos);
 
             col = ambient * i_col;
 
             // TODO ex 11.4 check if the light source is visible from i_pos, we only use the diffuse and specular components if that is the case
-            Ray shadow_ray(i_pos + i_normal * .001f, light_dir); // i_normal * .001f is handling numerical precision issues, it prevents self-intersection
-            float light_dist = length(light_pos - i_pos);
-            Hit shadow_hit;
-            // check if there is geometry in the direction of the light, and if the closest geometry is closer than the light source
-            if (rayModelIntersection(shadow_ray, vts, shadow_hit) && light_dist < shadow_hit.dist) {
-                // the light is visible from i_pos (there is no occlusion), so we compute direct lighting
-                col += diffuse * i_col * max(dot(light_dir, i_normal), .0f) +
-                       specular * pow(max(dot(light_dir, i_normal), .0f), shininess);
+            // instead of one shadow ray per light, we pick light_samples lights with a probability proportional to their
+            // estimated contribution, and divide their contribution by that probability (so the result is unbiased)
+            float u_offset = hashToUnit(i_pos);
+            for (unsigned int s = 0; s < light_samples; s++) {
+                float pdf;
+                int light_ID = light_tree.sample(i_pos, i_normal, fract(u_offset + float(s) / float(light_samples)), pdf);
+                if (light_ID < 0) break; // no light faces this point
+                const PointLight &light = lights[light_ID];
+
+                vec3 light_dir = normalize(light.position - i_pos);
+                Ray shadow_ray(i_pos + i_normal * .001f, light_dir); // i_normal * .001f is handling numerical precision issues, it prevents self-intersection
+                float light_dist = length(light.position - i_pos);
+                Hit shadow_hit;
+                // check if there is geometry in the direction of the light, and if the closest geometry is closer than the light source
+                if (!rayIntersection(shadow_ray, vts, shadow_hit) || light_dist < shadow_hit.dist) {
+                    // the light is visible from i_pos (there is no occlusion), so we compute direct lighting
+                    color direct = diffuse * i_col * max(dot(light_dir, i_normal), .0f) +
+                                   specular * pow(max(dot(light_dir, i_normal), .0f), shininess);
+                    col += direct * light.emitted(light_dist) / (pdf * float(light_samples));
+                }
             }
 
             // the recursion/reflection happens here!
@@ -116,6 +258,29 @@ namespace rt{
             return col;
         }
 
+        // maps a position to a pseudo random number in [0, 1), so light selection is stable from frame to frame
+        static float hashToUnit(const vec3 &p){
+            uint32_t h = 2166136261u;
+            const float coords[3] = {p.x, p.y, p.z};
+            for (float c : coords) {
+                uint32_t bits;
+                std::memcpy(&bits, &c, sizeof(bits));
+                h = (h ^ bits) * 16777619u;
+            }
+            h ^= h >> 16; h *= 0x7feb352du; h ^= h >> 15;
+            return float(h >> 8) / float(1u << 24);
+        }
+
+        // closest intersection with the triangles and with the analytic primitives, returns false if no intersection
+        bool rayIntersection(const Ray & ray,
+                             const std::vector<vertex> &vts,
+                             Hit &hit) const {
+            bool found = rayModelIntersection(ray, vts, hit);
+            // primitive hits only replace the triangle hit if they are closer
+            found |= primitives.intersect(ray, hit);
+            return found;
+        }
+
         // returns false if no intersection
         // intersection results are returned in the "hit" reference variable
         static bool rayModelIntersection(const Ray & ray,
@@ -36,8 +36,12 @@ namespace rt{
         glm::vec3 direction;
     };
 
+    // kinds of geometry a ray can hit, analytic primitives are stored in rt_primitives.h
+    enum class PrimitiveType { Triangle, Sphere, Box, Plane };
+
     struct Hit{
-        int hit_ID = -1; // negative values for no hit, other values for the index of the first vertex in a triangle
+        PrimitiveType type = PrimitiveType::Triangle; // which kind of geometry hit_ID refers to
+        int hit_ID = -1; // negative values for no hit, other values for the index of the first vertex in a triangle (or of the primitive in its bucket)
         glm::vec3 barycentric; // the barycentric coordinates of the triangle that was hit (if any)
         float dist = FLT_MAX;  // used to store the intersection distance
     };
@@ -41,7 +41,7 @@ public:
     }
 
     // draws the model, and thus all its meshes
-    void Draw(Shader shader, GLsizei instanceCount = 1, unsigned int indirectBuffer = 0)
+    void Draw(const Shader &shader, GLsizei instanceCount = 1, unsigned int indirectBuffer = 0)
     {
         for(unsigned int i = 0; i < meshes.size(); i++)
             meshes[i].Draw(shader, instanceCount, indirectBuffer);
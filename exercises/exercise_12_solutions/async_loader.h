@@ -0,0 +1,151 @@
+#ifndef ASYNC_LOADER_H
+#define ASYNC_LOADER_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Loads assets in the background.
+// A job runs on a worker thread (file reading, parsing, image decoding, mesh processing) and returns the list of
+// steps that need the GL context (buffer and texture uploads). The workers hand those steps to the render thread
+// through a lock-free list, and the render thread runs them in ProcessUploads, a few every frame, so the frame time
+// stays within a budget while the assets are loaded.
+class AsyncLoader
+{
+public:
+    typedef std::function<void()> UploadStep;
+    typedef std::function<std::vector<UploadStep>()> Job;
+
+    // threadCount 0 uses every core but one, the render thread keeps that one
+    explicit AsyncLoader(unsigned int threadCount = 0)
+    {
+        if (threadCount == 0)
+            threadCount = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+        for (unsigned int i = 0; i < threadCount; i++)
+            workers.emplace_back(&AsyncLoader::workerLoop, this);
+    }
+
+    AsyncLoader(const AsyncLoader&) = delete;
+    AsyncLoader& operator=(const AsyncLoader&) = delete;
+
+    ~AsyncLoader()
+    {
+        {
+            std::lock_guard<std::mutex> lock(jobMutex);
+            stopping = true;
+        }
+        jobCondition.notify_all();
+        for (std::thread &worker : workers)
+            worker.join();
+
+        UploadBatch* batch = finished.exchange(nullptr);
+        while (batch != nullptr)
+        {
+            UploadBatch* next = batch->next;
+            delete batch;
+            batch = next;
+        }
+    }
+
+    // queues a job for the workers. The steps it returns run on the render thread, in order
+    void Load(Job job)
+    {
+        pendingJobs++;
+        {
+            std::lock_guard<std::mutex> lock(jobMutex);
+            jobs.push_back(std::move(job));
+        }
+        jobCondition.notify_one();
+    }
+
+    // runs the upload steps of the finished jobs until budgetSeconds have passed. At least one step runs every call,
+    // so a step that is bigger than the budget can't stall the loading. Call it from the render thread, once per frame
+    void ProcessUploads(double budgetSeconds)
+    {
+        // take the batches the workers finished, the list is in reverse order
+        UploadBatch* batch = finished.exchange(nullptr, std::memory_order_acquire);
+        std::vector<UploadBatch*> batches;
+        for (; batch != nullptr; batch = batch->next)
+            batches.push_back(batch);
+        for (auto it = batches.rbegin(); it != batches.rend(); ++it)
+        {
+            for (UploadStep &step : (*it)->steps)
+                uploads.push_back(std::move(step));
+            uploads.push_back(nullptr); // end of the job
+            delete *it;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        bool first = true;
+        while (!uploads.empty())
+        {
+            if (!first && std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() >= budgetSeconds)
+                break;
+            UploadStep step = std::move(uploads.front());
+            uploads.pop_front();
+            if (step)
+            {
+                step();
+                first = false;
+            }
+            else
+            {
+                pendingJobs--;
+            }
+        }
+    }
+
+    // true when every job has been loaded and uploaded
+    bool Idle() const
+    {
+        return pendingJobs.load() == 0;
+    }
+
+private:
+    // upload steps of a finished job, pushed to the front of a lock-free singly linked list
+    struct UploadBatch
+    {
+        std::vector<UploadStep> steps;
+        UploadBatch* next;
+    };
+
+    std::vector<std::thread> workers;
+    std::mutex jobMutex;
+    std::condition_variable jobCondition;
+    std::deque<Job> jobs;
+    bool stopping = false;
+
+    std::atomic<UploadBatch*> finished{nullptr};
+    std::deque<UploadStep> uploads; // only used by the render thread
+    std::atomic<int> pendingJobs{0};
+
+    void workerLoop()
+    {
+        while (true)
+        {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(jobMutex);
+                jobCondition.wait(lock, [this]() { return stopping || !jobs.empty(); });
+                if (stopping)
+                    return;
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+
+            UploadBatch* batch = new UploadBatch;
+            batch->steps = job();
+            batch->next = finished.load(std::memory_order_relaxed);
+            while (!finished.compare_exchange_weak(batch->next, batch, std::memory_order_release, std::memory_order_relaxed))
+                ;
+        }
+    }
+};
+
+#endif
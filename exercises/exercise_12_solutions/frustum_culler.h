@@ -0,0 +1,208 @@
+#ifndef FRUSTUM_CULLER_H
+#define FRUSTUM_CULLER_H
+
+#include <glm/glm.hpp>
+
+#include "camera.h"
+#include "worker_pool.h"
+
+#include <algorithm>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define FRUSTUM_CULLER_SSE 1
+#endif
+// the AVX path is compiled for every x86 build, and only used when the processor has AVX, so the build does not need
+// -mavx or /arch:AVX
+#if defined(FRUSTUM_CULLER_SSE) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define FRUSTUM_CULLER_AVX 1
+#define FRUSTUM_CULLER_AVX_TARGET __attribute__((target("avx")))
+#elif defined(FRUSTUM_CULLER_SSE) && defined(_MSC_VER)
+#include <immintrin.h>
+#include <intrin.h>
+#define FRUSTUM_CULLER_AVX 1
+#define FRUSTUM_CULLER_AVX_TARGET
+#endif
+
+// Frustum culling of bounding spheres in batches.
+// The 6 plane equations (normal, distance) are found once per frame with SetPlanes. Cull takes the centers and radii
+// as a structure of arrays, tests 8 spheres at a time with AVX (4 with SSE, when the processor has no AVX) against all
+// the planes without branches, and writes the indices of the visible ones in a compact list. A sphere is visible when
+// its center is in front of every plane or less than its radius behind it, the test of exercise 12.1.
+class FrustumCuller
+{
+public:
+    // statistics of the last Cull
+    unsigned int TestedCount = 0;
+    unsigned int VisibleCount = 0;
+
+    FrustumCuller() : useAvx(hasAvx()) {}
+
+    void SetPlanes(const Camera& camera)
+    {
+        for (int plane = (int)Camera_Planes::FIRST_PLANE; plane < (int)Camera_Planes::PLANE_COUNT; ++plane)
+        {
+            glm::vec3 point, normal;
+            camera.GetFrustumPlane((Camera_Planes)plane, point, normal);
+            planes[plane] = glm::vec4(normal, -glm::dot(normal, point));
+        }
+    }
+
+    // fewer spheres than this in a range cost less than waking up a worker
+    static const unsigned int MIN_RANGE_SIZE = 512;
+
+    // replaces the content of visible with the indices of the visible spheres, in increasing order. With a pool the
+    // spheres are split in up to threadCount ranges of at least MIN_RANGE_SIZE, done by the pool and the calling thread
+    void Cull(const float* centerX, const float* centerY, const float* centerZ, const float* radius, unsigned int count,
+              std::vector<unsigned int>& visible, WorkerPool* pool = nullptr, unsigned int threadCount = 1)
+    {
+        TestedCount = count;
+        visible.resize(count);
+        unsigned int rangeCount = pool ? std::min(std::min(threadCount, pool->ThreadCount()), count / MIN_RANGE_SIZE) : 1;
+        if (rangeCount <= 1)
+        {
+            VisibleCount = cullRange(centerX, centerY, centerZ, radius, 0, count, visible.data());
+            visible.resize(VisibleCount);
+            return;
+        }
+
+        // each range is compacted in its own part of the list, and the parts are moved together after. The ranges are
+        // multiples of 8, so only the last one has a partial batch
+        unsigned int rangeSize = ((count + rangeCount - 1) / rangeCount + 7) & ~7u;
+        rangeCount = (count + rangeSize - 1) / rangeSize;
+        rangeVisible.resize(rangeCount);
+        pool->Run(rangeCount, [&](unsigned int range)
+        {
+            unsigned int begin = range * rangeSize;
+            rangeVisible[range] = cullRange(centerX, centerY, centerZ, radius, begin, std::min(begin + rangeSize, count),
+                                            visible.data() + begin);
+        });
+
+        VisibleCount = rangeVisible[0];
+        for (unsigned int range = 1; range < rangeCount; range++)
+        {
+            const unsigned int* first = visible.data() + range * rangeSize;
+            std::copy(first, first + rangeVisible[range], visible.data() + VisibleCount);
+            VisibleCount += rangeVisible[range];
+        }
+        visible.resize(VisibleCount);
+    }
+
+private:
+    glm::vec4 planes[(int)Camera_Planes::PLANE_COUNT]; // xyz normal, w distance to the origin
+    std::vector<unsigned int> rangeVisible;            // visible spheres of each range of the last Cull
+    bool useAvx;
+
+    static bool hasAvx()
+    {
+#if defined(FRUSTUM_CULLER_AVX) && defined(_MSC_VER) && !defined(__clang__)
+        // AVX in the processor, and the registers saved by the operating system
+        int info[4];
+        __cpuid(info, 1);
+        bool osSaves = (info[2] & (1 << 27)) != 0, avx = (info[2] & (1 << 28)) != 0;
+        return osSaves && avx && (_xgetbv(0) & 6) == 6;
+#elif defined(FRUSTUM_CULLER_AVX)
+        return __builtin_cpu_supports("avx");
+#else
+        return false;
+#endif
+    }
+
+    // writes the indices of the visible spheres in [begin, end) to output, returns how many there are. Every index is
+    // written, and the write position only moves forward past the visible ones
+    unsigned int cullRange(const float* centerX, const float* centerY, const float* centerZ, const float* radius,
+                           unsigned int begin, unsigned int end, unsigned int* output) const
+    {
+        const int planeCount = (int)Camera_Planes::PLANE_COUNT;
+        unsigned int visibleCount = 0;
+        unsigned int i = begin;
+#if defined(FRUSTUM_CULLER_AVX)
+        if (useAvx)
+            i = cullBatchesAvx(centerX, centerY, centerZ, radius, begin, end, output, visibleCount);
+#endif
+#if defined(FRUSTUM_CULLER_SSE)
+        __m128 normalX[planeCount], normalY[planeCount], normalZ[planeCount], distance[planeCount];
+        for (int plane = 0; plane < planeCount; plane++)
+        {
+            normalX[plane] = _mm_set1_ps(planes[plane].x);
+            normalY[plane] = _mm_set1_ps(planes[plane].y);
+            normalZ[plane] = _mm_set1_ps(planes[plane].z);
+            distance[plane] = _mm_set1_ps(planes[plane].w);
+        }
+        const __m128 signBit = _mm_set1_ps(-0.0f);
+        for (; i + 4 <= end; i += 4)
+        {
+            __m128 x = _mm_loadu_ps(centerX + i), y = _mm_loadu_ps(centerY + i), z = _mm_loadu_ps(centerZ + i);
+            __m128 negativeRadius = _mm_xor_ps(_mm_loadu_ps(radius + i), signBit);
+            __m128 inside = _mm_cmpeq_ps(x, x); // all bits set, except for NaN centers
+            for (int plane = 0; plane < planeCount; plane++)
+            {
+                __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(normalX[plane], x), _mm_mul_ps(normalY[plane], y)),
+                                      _mm_add_ps(_mm_mul_ps(normalZ[plane], z), distance[plane]));
+                inside = _mm_and_ps(inside, _mm_cmpgt_ps(d, negativeRadius));
+            }
+            int mask = _mm_movemask_ps(inside);
+            for (unsigned int k = 0; k < 4; k++)
+            {
+                output[visibleCount] = i + k;
+                visibleCount += (mask >> k) & 1;
+            }
+        }
+#endif
+        for (; i < end; i++)
+        {
+            bool inside = true;
+            for (int plane = 0; plane < planeCount; plane++)
+            {
+                const glm::vec4& p = planes[plane];
+                inside = inside && p.x * centerX[i] + p.y * centerY[i] + p.z * centerZ[i] + p.w > -radius[i];
+            }
+            output[visibleCount] = i;
+            visibleCount += inside ? 1 : 0;
+        }
+        return visibleCount;
+    }
+
+#if defined(FRUSTUM_CULLER_AVX)
+    // the batches of 8 spheres of cullRange, returns where the rest starts
+    FRUSTUM_CULLER_AVX_TARGET
+    unsigned int cullBatchesAvx(const float* centerX, const float* centerY, const float* centerZ, const float* radius,
+                                unsigned int begin, unsigned int end, unsigned int* output, unsigned int& visibleCount) const
+    {
+        const int planeCount = (int)Camera_Planes::PLANE_COUNT;
+        __m256 normalX[planeCount], normalY[planeCount], normalZ[planeCount], distance[planeCount];
+        for (int plane = 0; plane < planeCount; plane++)
+        {
+            normalX[plane] = _mm256_set1_ps(planes[plane].x);
+            normalY[plane] = _mm256_set1_ps(planes[plane].y);
+            normalZ[plane] = _mm256_set1_ps(planes[plane].z);
+            distance[plane] = _mm256_set1_ps(planes[plane].w);
+        }
+        const __m256 signBit = _mm256_set1_ps(-0.0f);
+        unsigned int i = begin;
+        for (; i + 8 <= end; i += 8)
+        {
+            __m256 x = _mm256_loadu_ps(centerX + i), y = _mm256_loadu_ps(centerY + i), z = _mm256_loadu_ps(centerZ + i);
+            __m256 negativeRadius = _mm256_xor_ps(_mm256_loadu_ps(radius + i), signBit);
+            __m256 inside = _mm256_cmp_ps(x, x, _CMP_EQ_OQ); // all bits set, except for NaN centers
+            for (int plane = 0; plane < planeCount; plane++)
+            {
+                __m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(normalX[plane], x), _mm256_mul_ps(normalY[plane], y)),
+                                         _mm256_add_ps(_mm256_mul_ps(normalZ[plane], z), distance[plane]));
+                inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, negativeRadius, _CMP_GT_OQ));
+            }
+            int mask = _mm256_movemask_ps(inside);
+            for (unsigned int k = 0; k < 8; k++)
+            {
+                output[visibleCount] = i + k;
+                visibleCount += (mask >> k) & 1;
+            }
+        }
+        return i;
+    }
+#endif
+};
+
+#endif
@@ -10,6 +10,12 @@
 #include "shader.h"
 #include "camera.h"
 #include "model.h"
+#include "occlusion_culler.h"
+#include "async_loader.h"
+#include "uniform_blocks.h"
+#include "worker_pool.h"
+#include "transform_system.h"
+#include "frustum_culler.h"
 
 #include "imgui.h"
 #include "imgui_impl_glfw.h"
@@ -36,16 +42,56 @@ Model* carPaintModel;
 Model* floorModel;
 Camera camera(glm::vec3(0.0f, 1.6f, 5.0f), glm::vec3(0.0f, 1.0f, 0.0f), (float)SCR_WIDTH / SCR_HEIGHT);
 Camera cullingCamera;
+AsyncLoader* loader; // loads the models and textures in the background
+WorkerPool* workerPool; // splits the per frame work on the cars (transforms and culling) in ranges
 
 bool updateCulling = true;
 int cullingShader = -1;
 
+// CPU frustum culling, of the bounding spheres of the cars
+FrustumCuller frustumCuller;
+std::vector<float> carCullingRadii;
+float frustumCullingTime = 0.0f;            // milliseconds spent in the last frame
+
+// CPU occlusion culling
+OcclusionCuller occlusionCuller(256, 128);
+glm::vec3 carBoundsMin, carBoundsMax;       // bounds of the car model in local space, used as occludee
+glm::vec3 carOccluderMin, carOccluderMax;   // smaller box that is completely inside the car, used as occluder
+std::vector<unsigned int> visibleCars;      // indices of the cars that passed the CPU culling
+
+// meshlet culling
+int meshletCullingShader = -1;
+glm::vec3 cullingPlanes[6 * 2];             // frustum planes of cullingCamera, (point, normal) pairs
+std::vector<unsigned int> visibleMeshlets;
+unsigned int meshletsDrawn = 0, meshletsTested = 0;
+
+// level of detail
+float lodFactor = 0.0f;                     // see Mesh::SelectLod
+unsigned int lodCars[MESH_MAX_LODS];        // cars drawn with each LOD, by the CPU paths
+unsigned int trianglesDrawn = 0;
+
+// LOD selection of a whole car: every mesh of a car is drawn with the same level. A mesh
+// with fewer levels uses its last one for the levels it does not have. A level is selected only when every mesh allows
+// it: the errors are the largest ones of the meshes, and the sphere encloses the spheres of all the meshes
+struct CarLodTable
+{
+    unsigned int count = 0;
+    float errors[MESH_MAX_LODS] = {};
+    glm::vec4 sphere = glm::vec4(0.0f);
+};
+
 
 
 
 GLuint sourceInstanceBuffer;
-GLuint visibleInstanceBuffer;
-GLuint indirectDrawBuffer;
+GLuint visibleInstanceBuffer;                // written by the culling compute shader
+BufferRange sourceInstanceRange;             // all of sourceInstanceBuffer, or the animated cars in the stream buffer
+BufferRange visibleCarRange;                 // the cars that passed the CPU culling, in the stream buffer
+BufferRange indirectDrawRange;               // a draw command for each mesh and LOD, in the stream buffer
+unsigned int lodInstanceOffsets[MESH_MAX_LODS]; // first instance of each LOD in the instance buffer of drawCarLods
+
+// data written every frame: uniform blocks, visible cars and indirect commands
+StreamBuffer* streamBuffer;
 
 Shader* skyboxShader;
 unsigned int skyboxVAO; // skybox handle
@@ -93,12 +139,26 @@ struct Config
     float roughness = 0.5f;
     float metalness = 0.0f;
 
-    std::vector<Light> lights;
+    std::vector<Light> lights; // up to MAX_BLOCK_LIGHTS
+
+    float exposure = 1.0f;
 
     bool enableCulling = true;
+    bool enableOcclusionCulling = false;
+    bool enableMeshletCulling = true;
+    bool enableLod = true;
+    float lodErrorPixels = 1.0f; // how far (in pixels) a LOD can be from the original mesh on screen
+
+    // time per frame given to the uploads of the assets that are loading, in milliseconds
+    float loadBudget = 2.0f;
 
     // TODO 12.2 : Change the default value to true
     bool enableInstancing = true;
+
+    // turn the cars around their vertical axis, rebuilding their model matrices every frame
+    bool animateCars = false;
+    int transformThreads = 1;
+    int cullingThreads = 1; // frustum culling of the CPU paths
 } config;
 
 // structure to hold car instances
@@ -109,22 +169,40 @@ struct Car
 };
 std::vector<Car> cars;
 
+// position, rotation and scale of the cars, the model matrices of cars are built from them
+TransformSystem carTransforms;
+std::vector<float> carSpinSpeeds;            // radians per second, when the cars are animated
+float carTransformTime = 0.0f;               // milliseconds spent building the car matrices in the last frame
+
 // function declarations
 // ---------------------
-void setAmbientUniforms(glm::vec3 ambientLightColor);
-void setLightUniforms(Light &light);
+void uploadUniformBlocks(float time);
 void setupForwardAdditionalPass();
 void resetForwardAdditionalPass();
 void drawSkybox();
+void cullCars();
 void drawObjects();
 void drawGui();
 unsigned int initSkyboxBuffers();
 unsigned int loadCubemap(vector<std::string> faces);
 
-bool isFrustumVisibleSphere(const Camera &camera, const glm::mat4& matrix, float radius);
 void createCarInstances();
+void updateCarTransforms(float time);
+void uploadSourceInstances();
+void computeCarBounds();
+void runFrustumCulling();
+void runOcclusionCulling();
+void uploadVisibleCars();
 void createCullingCompute();
 void runCullingCompute();
+void drawCar(const Car& car, const CarLodTable& lodTable);
+CarLodTable buildCarLodTable();
+unsigned int selectCarLod(const CarLodTable& table, const glm::mat4& model);
+void setLodUniforms(int program, const CarLodTable& table);
+void writeCarLodCommands(int* indirectData, const unsigned int* instanceCounts);
+void drawCarLods();
+void createMeshletCullingCompute();
+void runMeshletCullingCompute(const BufferRange& instances, unsigned int instanceCount);
 
 int main()
 {
@@ -172,15 +250,34 @@ int main()
     pbr_shading = new Shader("shaders/common_shading.vert", "shaders/pbr_shading.frag");
     shader = pbr_shading;
 
-    carPaintModel = new Model("car/Paint_LOD0.obj");
+    // the textures are baked to the compressed formats the context supports, the others are uploaded uncompressed
+    TextureCache::Get().SetBakedFormats(supportedBlockFormats());
+
+    // the models load in the background, a placeholder box is drawn until they are ready
+    loader = new AsyncLoader();
+    workerPool = new WorkerPool();
+    carPaintModel = new Model(*loader, "car/Paint_LOD0.obj", false, [](Model& model)
+    {
+        computeCarBounds();
+
+        // meshlet culling on GPU, every meshlet can be drawn once for each car
+        for (Mesh& mesh : model.meshes)
+            mesh.SetupMeshletInstances((unsigned int)cars.size());
+    });
 
-    floorModel = new Model("floor/floor.obj");
+    floorModel = new Model(*loader, "floor/floor.obj");
 
     // create all cars
     createCarInstances();
 
+    // space of a frame in the stream buffer: each light pass can upload every car and the draw commands, and the
+    // uniform blocks and the animated cars are written once
+    streamBuffer = new StreamBuffer();
+    streamBuffer->Create((GLsizeiptr)(config.lights.size() + 1) * (GLsizeiptr)(cars.size() * sizeof(Car) + 4096) + 16384);
+
     // create compute shader for frustum culling on GPU
     createCullingCompute();
+    createMeshletCullingCompute();
 
     // init skybox
     vector<std::string> faces
@@ -225,12 +322,22 @@ int main()
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
 
-        glm::mat4 projection = camera.GetProjectionMatrix();
-        glm::mat4 view = camera.GetViewMatrix();
-        glm::mat4 viewProjection = projection * view;
+        // finish loading the assets that are ready, within the budget
+        loader->ProcessUploads(config.loadBudget / 1000.0);
 
         processInput(window);
 
+        // waits for the GPU to finish the frame that used the same part of the stream buffer
+        streamBuffer->BeginFrame();
+
+        // the frame, camera and lights are the same for every draw of the frame
+        uploadUniformBlocks(currentFrame);
+
+        updateCarTransforms(currentFrame);
+
+        // the visible cars are found once, and every light pass draws them
+        cullCars();
+
         glClearColor(0.3f, 0.3f, 0.3f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -240,27 +347,32 @@ int main()
 
 
         // First light + ambient
-        setAmbientUniforms(glm::vec3(1.0f));
-        setLightUniforms(config.lights[0]);
+        shader->setInt("lightIndex", 0);
         drawObjects();
 
         // Additional additive lights
         setupForwardAdditionalPass();
-        for (int i = 1; i < config.lights.size(); ++i)
+        int lightCount = (int)std::min(config.lights.size(), (size_t)MAX_BLOCK_LIGHTS);
+        for (int i = 1; i < lightCount; ++i)
         {
-            setLightUniforms(config.lights[i]);
+            shader->setInt("lightIndex", i);
             drawObjects();
         }
         resetForwardAdditionalPass();
 
         drawGui();
 
+        // the part of the stream buffer of this frame can be reused when the GPU reaches this point
+        streamBuffer->EndFrame();
+
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
 
     // Cleanup
     // -------
+    delete loader;
+    delete workerPool;
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
@@ -268,6 +380,7 @@ int main()
     delete carPaintModel;
     delete floorModel;
     delete pbr_shading;
+    delete streamBuffer;
 
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
@@ -297,8 +410,38 @@ void drawGui(){
         ImGui::SliderFloat("metalness", &config.metalness, 0.0f, 1.0f);
         ImGui::Separator();
 
+        ImGui::SliderFloat("exposure", &config.exposure, 0.1f, 4.0f);
+        ImGui::Separator();
+
         ImGui::Checkbox("Frustum Culling", &config.enableCulling);
+        ImGui::Checkbox("CPU Occlusion Culling", &config.enableOcclusionCulling);
+        ImGui::Checkbox("Meshlet Culling", &config.enableMeshletCulling);
         ImGui::Checkbox("Instancing",  &config.enableInstancing);
+        ImGui::Checkbox("Animate cars", &config.animateCars);
+        ImGui::SliderInt("transform threads", &config.transformThreads, 1, 8);
+        ImGui::SliderInt("culling threads", &config.cullingThreads, 1, 8);
+        if (config.animateCars)
+            ImGui::Text("Car transforms: %.3f ms", carTransformTime);
+        if (config.enableMeshletCulling && !config.enableInstancing)
+            ImGui::Text("Meshlets: %u of %u drawn", meshletsDrawn, meshletsTested);
+        if (!loader->Idle())
+            ImGui::Text("Loading...");
+        ImGui::SliderFloat("load budget (ms)", &config.loadBudget, 0.5f, 16.0f);
+        ImGui::Separator();
+
+        ImGui::Checkbox("LOD", &config.enableLod);
+        ImGui::SliderFloat("LOD error (pixels)", &config.lodErrorPixels, 0.25f, 8.0f);
+        if (!config.enableInstancing || (config.enableOcclusionCulling && !config.enableMeshletCulling))
+        {
+            ImGui::Text("Cars per LOD: %u %u %u %u %u", lodCars[0], lodCars[1], lodCars[2], lodCars[3], lodCars[4]);
+            ImGui::Text("Triangles drawn: %u", trianglesDrawn);
+        }
+        if (config.enableCulling && (!config.enableInstancing || config.enableOcclusionCulling))
+            ImGui::Text("Frustum: %u of %u cars visible, %.3f ms", frustumCuller.VisibleCount, frustumCuller.TestedCount,
+                        frustumCullingTime);
+        if (config.enableOcclusionCulling)
+            ImGui::Text("Occlusion: %u of %u tested cars culled, %u occluders", occlusionCuller.CulledCount,
+                        occlusionCuller.TestedCount, occlusionCuller.OccluderCount);
 
         ImGui::End();
     }
@@ -315,28 +458,45 @@ void drawGui(){
 }
 
 
-void setAmbientUniforms(glm::vec3 ambientLightColor)
+// writes the frame, view and light blocks, read by every shader that declares them
+void uploadUniformBlocks(float time)
 {
-    // ambient uniforms
-    shader->setVec4("ambientLightColor", glm::vec4(ambientLightColor, glm::length(ambientLightColor) > 0.0f ? 1.0f : 0.0f));
-}
+    FrameData frame = {};
+    frame.time = time;
+    frame.deltaTime = deltaTime;
+    frame.exposure = config.exposure;
+    uploadUniformBlock(*streamBuffer, FRAME_BLOCK_BINDING, frame);
+
+    ViewData view;
+    view.view = camera.GetViewMatrix();
+    view.projection = camera.GetProjectionMatrix();
+    view.viewProjection = view.projection * view.view;
+    view.inverseProjection = glm::inverse(view.projection);
+    view.cameraPosition = glm::vec4(camera.Position, 1.0f);
+    uploadUniformBlock(*streamBuffer, VIEW_BLOCK_BINDING, view);
+
+    LightData lights = {};
+    // ambient and reflections, only added by the pass of the first light
+    lights.ambientLightColor = glm::vec4(1.0f);
+    lights.lightCount = (int)std::min(config.lights.size(), (size_t)MAX_BLOCK_LIGHTS);
+    for (int i = 0; i < lights.lightCount; ++i)
+    {
+        const Light& light = config.lights[i];
+        glm::vec3 lightEnergy = light.color * light.intensity;
 
-void setLightUniforms(Light& light)
-{
-    glm::vec3 lightEnergy = light.color * light.intensity;
+        lightEnergy *= glm::pi<float>();
 
-    lightEnergy *= glm::pi<float>();
+        lights.lights[i].position = glm::vec4(light.position, light.radius);
+        lights.lights[i].color = glm::vec4(lightEnergy, 1.0f);
+    }
+    uploadUniformBlock(*streamBuffer, LIGHT_BLOCK_BINDING, lights);
 
-    // light uniforms
-    shader->setVec3("lightPosition", light.position);
-    shader->setVec3("lightColor", lightEnergy);
-    shader->setFloat("lightRadius", light.radius);
+    streamBuffer->Flush();
 }
 
 void setupForwardAdditionalPass()
 {
-    // Remove ambient from additional passes
-    setAmbientUniforms(glm::vec3(0.0f));
+    // the ambient is removed from additional passes by the shader, from the index of the light
 
     // Enable additive blending
     glEnable(GL_BLEND);
@@ -349,9 +509,6 @@ void setupForwardAdditionalPass()
 
 void resetForwardAdditionalPass()
 {
-    // Restore ambient
-    setAmbientUniforms(glm::vec3(1.0f));
-
     //Disable blend and restore default blend function
     glDisable(GL_BLEND);
     glBlendFunc(GL_ONE, GL_ZERO);
@@ -436,36 +593,70 @@ unsigned int initSkyboxBuffers() {
 // +Z (front)
 // -Z (back)
 // -------------------------------------------------------
+// returns a cubemap of 1x1 grey pixels right away, and loads the faces in the background. When they are ready, the
+// placeholder is replaced by the loaded cubemap in cubemapTexture
 unsigned int loadCubemap(vector<std::string> faces)
 {
     unsigned int textureID;
     glGenTextures(1, &textureID);
     glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+    unsigned char grey[3] = { 128, 128, 128 };
+    for (unsigned int i = 0; i < 6; i++)
+        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_SRGB, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, grey);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
 
-    int width, height, nrComponents;
-    for (unsigned int i = 0; i < faces.size(); i++)
+    loader->Load([faces]()
     {
-        unsigned char* data = stbi_load(faces[i].c_str(), &width, &height, &nrComponents, 0);
-        if (data)
+        // decode the faces in parallel on the threads of the texture cache
+        vector<std::shared_future<ImageData>> decoding;
+        for (const std::string& face : faces)
+            decoding.push_back(TextureCache::Get().Decode(face));
+        shared_ptr<vector<ImageData>> images = make_shared<vector<ImageData>>();
+        for (unsigned int i = 0; i < faces.size(); i++)
         {
-            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_SRGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-            stbi_image_free(data);
+            images->push_back(decoding[i].get());
+            if (!images->back().data)
+                std::cout << "Cubemap texture failed to load at path: " << faces[i] << std::endl;
         }
-        else
+
+        // upload them in a new texture, one face per step
+        shared_ptr<unsigned int> loadedID = make_shared<unsigned int>(0);
+        vector<AsyncLoader::UploadStep> steps;
+        steps.push_back([loadedID]() { glGenTextures(1, loadedID.get()); });
+        for (unsigned int i = 0; i < images->size(); i++)
         {
-            std::cout << "Cubemap texture failed to load at path: " << faces[i] << std::endl;
-            stbi_image_free(data);
+            steps.push_back([images, loadedID, i]()
+            {
+                ImageData& image = (*images)[i];
+                if (!image.data)
+                    return;
+                glBindTexture(GL_TEXTURE_CUBE_MAP, *loadedID);
+                glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_SRGB, image.width, image.height, 0, GL_RGB, GL_UNSIGNED_BYTE, image.data);
+                glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+                freeImage(image);
+            });
         }
-    }
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        steps.push_back([loadedID]()
+        {
+            glBindTexture(GL_TEXTURE_CUBE_MAP, *loadedID);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 
-    glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+            glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
 
-    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+            glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+            // replace the placeholder
+            glDeleteTextures(1, &cubemapTexture);
+            cubemapTexture = *loadedID;
+        });
+        return steps;
+    });
 
     return textureID;
 }
@@ -477,10 +668,7 @@ void drawSkybox()
     // render skybox
     glDepthFunc(GL_LEQUAL);  // change depth function so depth test passes when values are equal to depth buffer's content
     skyboxShader->use();
-    glm::mat4 projection = camera.GetProjectionMatrix();
-    glm::mat4 view = camera.GetViewMatrix();
-    skyboxShader->setMat4("projection", projection);
-    skyboxShader->setMat4("view", view);
+    // the camera matrices come from the view block
     skyboxShader->setInt("skybox", 0);
 
     // skybox cube
@@ -492,22 +680,35 @@ void drawSkybox()
     glDepthFunc(GL_LESS); // set depth function back to default
 }
 
-void drawObjects()
+// updates the culling camera and its planes, and finds the visible cars of the CPU paths in visibleCars. Once per
+// frame, before the passes that draw the cars
+void cullCars()
 {
-    // the typical transformation uniforms are already set for you, these are:
-    // projection (perspective projection matrix)
-    // view (to map world space coordinates to the camera space, so the camera position becomes the origin)
-    // model (for each model part we draw)
+    // Copy current camera to culling camera, if culling update is enabled
+    // Normally you would use the camera directly, we do it in this way so you can pause culling, move the camera, and observe the culling results easily
+    if (updateCulling)
+        cullingCamera = camera;
+
+    for (int plane = (int)Camera_Planes::FIRST_PLANE; plane < (int)Camera_Planes::PLANE_COUNT; ++plane)
+        cullingCamera.GetFrustumPlane((Camera_Planes)plane, cullingPlanes[plane * 2], cullingPlanes[plane * 2 + 1]);
+    frustumCuller.SetPlanes(cullingCamera);
 
-    // camera parameters
-    glm::mat4 projection = camera.GetProjectionMatrix();
-    glm::mat4 view = camera.GetViewMatrix();
-    glm::mat4 viewProjection = projection * view;
+    // projected error of a LOD: error * screen height / (2 * tan(fov / 2) * distance), compared to lodErrorPixels
+    lodFactor = config.enableLod ? (float)SCR_HEIGHT / (2.0f * std::tan(glm::radians(cullingCamera.Zoom) * 0.5f) * config.lodErrorPixels) : 0.0f;
 
-    // camera position
-    shader->setVec3("camPosition", camera.Position);
-    // set viewProjection matrix uniform
-    shader->setMat4("viewProjection", viewProjection);
+    if (!carPaintModel->IsResident())
+        return;
+    // CPU occlusion culling (it includes frustum culling), or frustum culling alone when the cars are not instanced
+    if (config.enableOcclusionCulling)
+        runOcclusionCulling();
+    else if (!config.enableInstancing)
+        runFrustumCulling();
+}
+
+void drawObjects()
+{
+    // the camera (viewProjection and camera position) and the lights are in the uniform blocks, uploaded once per
+    // frame by uploadUniformBlocks. Only the model matrix is set for each model part we draw
 
     // set up skybox texture
     shader->setInt("skybox", 5);
@@ -518,25 +719,63 @@ void drawObjects()
     shader->setFloat("roughness", config.roughness);
     shader->setFloat("metalness", config.metalness);
 
-    // Copy current camera to culling camera, if culling update is enabled
-    // Normally you would use the camera directly, we do it in this way so you can pause culling, move the camera, and observe the culling results easily
-    if (updateCulling)
-        cullingCamera = camera;
+    meshletsDrawn = meshletsTested = 0;
+    trianglesDrawn = 0;
+    std::fill(lodCars, lodCars + MESH_MAX_LODS, 0u);
 
     // Draw all cars
-    if (!config.enableInstancing)
+    if (!carPaintModel->IsResident())
     {
-        for (const Car& car : cars)
+        // the car is still loading, draw its placeholder in the place of every car
+        glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 0, sourceInstanceRange.buffer, sourceInstanceRange.offset, sourceInstanceRange.size);
+        carPaintModel->Draw(*shader, (int)cars.size());
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, 0);
+    }
+    else if (!config.enableInstancing)
+    {
+        // TODO 12.1 : Only draw the cars if culling is not enabled or if the bounding sphere is visible in cullingCamera
+        // (visibleCars, found by cullCars with frustum culling, or with occlusion culling when it is enabled)
+        CarLodTable lodTable = buildCarLodTable();
+        for (unsigned int carIndex : visibleCars)
         {
-            // TODO 12.1 : Only execute this block if culling is not enabled or if the bounding sphere is visible in cullingCamera
-            if (!config.enableCulling || isFrustumVisibleSphere(cullingCamera, car.modelMatrix, 2.5f))
-            {
-                shader->setMat4("model", car.modelMatrix);
-                shader->setVec4("reflectionColor", car.color);
-                carPaintModel->Draw(*shader);
-            }
+            const Car& car = cars[carIndex];
+            shader->setMat4("model", car.modelMatrix);
+            shader->setVec4("reflectionColor", car.color);
+            drawCar(car, lodTable);
         }
     }
+    else if (config.enableOcclusionCulling)
+    {
+        // the visible cars were found on the CPU, upload them and draw them with an indirect call per LOD
+        uploadVisibleCars();
+        if (config.enableMeshletCulling)
+        {
+            // the meshlets of the visible cars are culled on the GPU
+            runMeshletCullingCompute(visibleCarRange, (unsigned int)visibleCars.size());
+            glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 0, visibleCarRange.buffer, visibleCarRange.offset, visibleCarRange.size);
+            shader->setBool("useMeshletInstance", true);
+            for (Mesh& mesh : carPaintModel->meshes)
+                mesh.DrawMeshlets(*shader);
+            shader->setBool("useMeshletInstance", false);
+        }
+        else
+        {
+            glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 0, visibleCarRange.buffer, visibleCarRange.offset, visibleCarRange.size);
+            drawCarLods();
+        }
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, 0);
+    }
+    else if (config.enableMeshletCulling)
+    {
+        // frustum culling of the cars and frustum and cone culling of their meshlets, in a single compute dispatch
+        runMeshletCullingCompute(sourceInstanceRange, (unsigned int)cars.size());
+        glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 0, sourceInstanceRange.buffer, sourceInstanceRange.offset, sourceInstanceRange.size);
+        shader->setBool("useMeshletInstance", true);
+        for (Mesh& mesh : carPaintModel->meshes)
+            mesh.DrawMeshlets(*shader);
+        shader->setBool("useMeshletInstance", false);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, 0);
+    }
     else
     {
         // TODO 12.3 : if culling is enabled, run culling compute
@@ -548,11 +787,18 @@ void drawObjects()
 
         // TODO 12.3 : Bind the visible instance buffer, if culling is enabled, or source instance buffer, if it is not
         // TODO 12.2 : Bind the source instance buffer as GL_SHADER_STORAGE_BUFFER, with index 0
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, config.enableCulling ? visibleInstanceBuffer : sourceInstanceBuffer);
+        if (config.enableCulling)
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, visibleInstanceBuffer);
+        else
+            glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 0, sourceInstanceRange.buffer, sourceInstanceRange.offset, sourceInstanceRange.size);
 
         // TODO 12.3 : Add an extra parameter with the indirect buffer, if culling is enabled, or 0, if it is not
         // TODO 12.2 : Draw the carPaintModel, using the same shader, but with an extra parameter for the number of cars
-        carPaintModel->Draw(*shader, (int)cars.size(), config.enableCulling ? indirectDrawBuffer : 0);
+        // the culling compute also selects the LODs, and writes an indirect command for each one
+        if (config.enableCulling)
+            drawCarLods();
+        else
+            carPaintModel->Draw(*shader, (int)cars.size());
 
         // TODO 12.2 : Unbind the GL_SHADER_STORAGE_BUFFER
         glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, 0);
@@ -569,26 +815,6 @@ void drawObjects()
     }
 }
 
-// Checks if a bounding sphere (determined by its transform matrix and radius) is visible inside the frustum of a camera
-bool isFrustumVisibleSphere(const Camera& camera, const glm::mat4& matrix, float radius)
-{
-    bool visible = true;
-
-    glm::vec3 center = matrix[3];
-    glm::vec3 planePoint, planeNormal;
-    for (int plane = (int)Camera_Planes::FIRST_PLANE; plane < (int)Camera_Planes::PLANE_COUNT; ++plane)
-    {
-        camera.GetFrustumPlane((Camera_Planes)plane, planePoint, planeNormal);
-
-        // TODO 12.1 : Get the distance of the center to the plane and compare it to the radius. If it is not visible, return false.
-        visible = glm::dot(center - planePoint, planeNormal) > -radius;
-
-        if (!visible)
-            break;
-    }
-    return visible;
-}
-
 void createCarInstances()
 {
     const glm::ivec2 side(40, 15); // Create a grid of 81 x 31 cars ~ 2500 cars
@@ -600,28 +826,207 @@ void createCarInstances()
         for (int i = -side.x; i <= side.x; ++i)
         {
             Car car;
-            // Model transformation matrix. No rotation or scale, just translation
-            car.modelMatrix = glm::translate(glm::mat4(1.0f), glm::vec3(i * separation.x, 0.0f, j * separation.y));
+            // Transform of the car, its model matrix is built below. No rotation or scale, just translation
+            carTransforms.Add(glm::vec3(i * separation.x, 0.0f, j * separation.y));
+            carSpinSpeeds.push_back((float)(((i * 7 + j * 13) % 11 + 11) % 11 - 5) * 0.2f);
             // Random color
             car.color = glm::vec4(rand() / double(RAND_MAX), rand() / double(RAND_MAX), rand() / double(RAND_MAX), 1.0f);
             cars.push_back(car);
         }
     }
+    carTransforms.ComposeMatrices(&cars[0].modelMatrix, sizeof(Car));
+    // the cars turn around their center, their bounding sphere doesn't move
+    carCullingRadii.assign(cars.size(), 2.5f);
 
-    // create a buffer that contains all the instance data. It is STATIC because we won't modify it
+    // create a buffer that contains all the instance data. It is STATIC because it is only written again when the
+    // animation of the cars stops
     glGenBuffers(1, &sourceInstanceBuffer);
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, sourceInstanceBuffer);
     glBufferData(GL_SHADER_STORAGE_BUFFER, cars.size() * sizeof(Car), cars.data(), GL_STATIC_DRAW);
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    sourceInstanceRange.buffer = sourceInstanceBuffer;
+    sourceInstanceRange.size = (GLsizeiptr)(cars.size() * sizeof(Car));
 
-    // create a buffer that can contain all the instance data. It is DYNAMIC because we will copy only the visible instances every frame
+    // create a buffer that can contain all the instance data for each LOD. It is only written by the culling compute
+    // shader, the cars culled on the CPU are written in the stream buffer
     glGenBuffers(1, &visibleInstanceBuffer);
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, visibleInstanceBuffer);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, cars.size() * sizeof(Car), cars.data(), GL_DYNAMIC_DRAW);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, MESH_MAX_LODS * cars.size() * sizeof(Car), nullptr, GL_DYNAMIC_COPY);
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 
-    // create the indirect draw buffer
-    glGenBuffers(1, &indirectDrawBuffer);
+    // the indirect draw commands are written in the stream buffer every frame
+}
+
+// turns the animated cars: their rotations are set, and their model matrices are rebuilt in batches. The cars are
+// written in the stream buffer, and the GPU paths read them from there instead of from sourceInstanceBuffer
+void updateCarTransforms(float time)
+{
+    static bool wasAnimated = false;
+    if (!config.animateCars)
+    {
+        // the cars stay where the animation left them
+        if (wasAnimated)
+            uploadSourceInstances();
+        wasAnimated = false;
+        return;
+    }
+    wasAnimated = true;
+
+    double start = glfwGetTime();
+    for (unsigned int i = 0; i < carTransforms.Size(); i++)
+    {
+        // rotation around the y axis: (0, sin(angle / 2), 0, cos(angle / 2))
+        float halfAngle = carSpinSpeeds[i] * time * 0.5f;
+        carTransforms.rotationY[i] = std::sin(halfAngle);
+        carTransforms.rotationW[i] = std::cos(halfAngle);
+    }
+    carTransforms.ComposeMatrices(&cars[0].modelMatrix, sizeof(Car), workerPool, (unsigned int)config.transformThreads);
+    carTransformTime = (float)((glfwGetTime() - start) * 1000.0);
+
+    sourceInstanceRange = streamBuffer->Write(cars.data(), (GLsizeiptr)(cars.size() * sizeof(Car)));
+    streamBuffer->Flush();
+    if (sourceInstanceRange.buffer == 0)
+        uploadSourceInstances(); // the stream buffer is full
+}
+
+// copies the cars to sourceInstanceBuffer, and makes all of it the source instances
+void uploadSourceInstances()
+{
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, sourceInstanceBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, cars.size() * sizeof(Car), cars.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    sourceInstanceRange.buffer = sourceInstanceBuffer;
+    sourceInstanceRange.offset = 0;
+    sourceInstanceRange.size = (GLsizeiptr)(cars.size() * sizeof(Car));
+}
+
+// bounds of the car in local space, and a box inside of the car body that is used as occluder
+void computeCarBounds()
+{
+    carBoundsMin = glm::vec3(std::numeric_limits<float>::max());
+    carBoundsMax = glm::vec3(-std::numeric_limits<float>::max());
+    std::vector<glm::vec3> triangles;
+    for (const Mesh& mesh : carPaintModel->meshes)
+    {
+        for (const Vertex& vertex : mesh.vertices)
+        {
+            carBoundsMin = glm::min(carBoundsMin, vertex.Position);
+            carBoundsMax = glm::max(carBoundsMax, vertex.Position);
+        }
+        // the triangles of the full detail mesh, the first LOD
+        size_t indexCount = mesh.lods.empty() ? mesh.indices.size() : mesh.lods[0].indexCount;
+        for (size_t i = 0; i < indexCount; i++)
+            triangles.push_back(mesh.vertices[mesh.indices[i]].Position);
+    }
+
+    // the car does not fill its bounding box (windows, wheel arches, the gap under the body), so the occluder is a
+    // box that the surface of the car encloses. The paint surface is open (the windows have no paint), so its holes
+    // are closed, the smallest ones first, until it encloses a volume. Then a car can hide what is seen through the
+    // windows of another
+    const int resolution = 32, maxClosing = 4;
+    for (int closing = 0; closing <= maxClosing; closing++)
+    {
+        if (OcclusionCuller::FindEnclosedBox(triangles, carBoundsMin, carBoundsMax, carOccluderMin, carOccluderMax,
+                                             resolution, closing))
+        {
+            if (closing > 0)
+                std::cout << "Car occluder: holes in the car surface closed up to " << closing * 2 << "/" << resolution
+                          << " of its size, the occluder can hide cars seen through them" << std::endl;
+            return;
+        }
+    }
+
+    // no enclosed volume at all, use the middle of the bounding box, half of its size on each axis
+    std::cout << "Car occluder: the car surface encloses no volume, the occluder is half of the bounding box" << std::endl;
+    glm::vec3 center = (carBoundsMin + carBoundsMax) * 0.5f, quarter = (carBoundsMax - carBoundsMin) * 0.25f;
+    carOccluderMin = center - quarter;
+    carOccluderMax = center + quarter;
+}
+
+// stores the indices of the cars whose bounding sphere is in the view of cullingCamera in visibleCars, or of all the
+// cars if culling is disabled. The centers are the positions of the car transforms
+void runFrustumCulling()
+{
+    if (!config.enableCulling)
+    {
+        visibleCars.resize(cars.size());
+        for (unsigned int i = 0; i < cars.size(); i++)
+            visibleCars[i] = i;
+        return;
+    }
+    double start = glfwGetTime();
+    frustumCuller.Cull(carTransforms.positionX.data(), carTransforms.positionY.data(), carTransforms.positionZ.data(),
+                       carCullingRadii.data(), carTransforms.Size(), visibleCars, workerPool, (unsigned int)config.cullingThreads);
+    frustumCullingTime = (float)((glfwGetTime() - start) * 1000.0);
+}
+
+// frustum and occlusion culling on the CPU, front to back: each car is tested against the cars in front of it, and if
+// it is visible it becomes an occluder for the ones behind it. Stores the indices of the visible cars in visibleCars
+void runOcclusionCulling()
+{
+    runFrustumCulling();
+
+    // sort front to back
+    glm::vec3 cameraPosition = cullingCamera.Position;
+    std::sort(visibleCars.begin(), visibleCars.end(), [&cameraPosition](unsigned int a, unsigned int b)
+    {
+        glm::vec3 toA = glm::vec3(cars[a].modelMatrix[3]) - cameraPosition;
+        glm::vec3 toB = glm::vec3(cars[b].modelMatrix[3]) - cameraPosition;
+        return glm::dot(toA, toA) < glm::dot(toB, toB);
+    });
+
+    occlusionCuller.BeginFrame(cullingCamera.GetProjectionMatrix() * cullingCamera.GetViewMatrix());
+    unsigned int visibleCount = 0;
+    for (unsigned int carIndex : visibleCars)
+    {
+        const glm::mat4& model = cars[carIndex].modelMatrix;
+        if (occlusionCuller.IsVisibleBox(model, carBoundsMin, carBoundsMax))
+        {
+            visibleCars[visibleCount++] = carIndex;
+            if (carOccluderMax.x > carOccluderMin.x)
+                occlusionCuller.AddOccluderBox(model, carOccluderMin, carOccluderMax);
+        }
+    }
+    visibleCars.resize(visibleCount);
+}
+
+// copies the cars that passed the CPU culling to the stream buffer, grouped by LOD, and writes the indirect draw
+// arguments. When the meshlets are culled on the GPU, the meshlet culling selects the LODs, and all are in LOD 0
+void uploadVisibleCars()
+{
+    CarLodTable lodTable = buildCarLodTable();
+    static std::vector<Car> visibleCarData[MESH_MAX_LODS];
+    for (std::vector<Car>& lodCarData : visibleCarData)
+        lodCarData.clear();
+    for (unsigned int carIndex : visibleCars)
+    {
+        unsigned int lod = config.enableMeshletCulling ? 0 : selectCarLod(lodTable, cars[carIndex].modelMatrix);
+        visibleCarData[lod].push_back(cars[carIndex]);
+    }
+
+    // the LODs one after the other, with room for one car so the range is never empty
+    Car* visibleCarCopy = (Car*)streamBuffer->Allocate((GLsizeiptr)(std::max<size_t>(visibleCars.size(), 1) * sizeof(Car)), visibleCarRange);
+    if (!visibleCarCopy)
+    {
+        // the stream buffer is full, nothing is drawn
+        visibleCars.clear();
+        visibleCarRange = BufferRange();
+    }
+    unsigned int instanceCount = 0;
+    for (unsigned int lod = 0; visibleCarCopy && lod < lodTable.count; lod++)
+    {
+        std::copy(visibleCarData[lod].begin(), visibleCarData[lod].end(), visibleCarCopy + instanceCount);
+        lodInstanceOffsets[lod] = instanceCount;
+        instanceCount += (unsigned int)visibleCarData[lod].size();
+        lodCars[lod] = (unsigned int)visibleCarData[lod].size();
+        for (const Mesh& mesh : carPaintModel->meshes)
+            trianglesDrawn += lodCars[lod] * mesh.lods[std::min(lod, (unsigned int)mesh.lods.size() - 1)].indexCount / 3;
+    }
+    std::vector<int> indirectData(carPaintModel->meshes.size() * MESH_MAX_LODS * 5);
+    writeCarLodCommands(indirectData.data(), visibleCarCopy ? lodCars : nullptr);
+
+    indirectDrawRange = streamBuffer->Write(indirectData.data(), (GLsizeiptr)(indirectData.size() * sizeof(int)));
+    streamBuffer->Flush();
 }
 
 void createCullingCompute()
@@ -648,18 +1053,17 @@ void createCullingCompute()
 
 void runCullingCompute()
 {
-    // Fill the indirect buffer with the initial data
-    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectDrawBuffer);
-    int indirectData[5] =
-    {
-        (int)carPaintModel->meshes[0].indices.size(),
-        0, // instance count
-        0, // first index
-        0, // base vertex
-        0  // base instance
-    };
-    glBufferData(GL_DRAW_INDIRECT_BUFFER, 5 * sizeof(int), indirectData, GL_DYNAMIC_DRAW);
-    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    // Fill the indirect buffer with the initial data, a command for each mesh and LOD. It is written in the stream
+    // buffer, the compute shader counts the instances in it
+    CarLodTable lodTable = buildCarLodTable();
+    for (unsigned int lod = 0; lod < MESH_MAX_LODS; lod++)
+        lodInstanceOffsets[lod] = lod * (unsigned int)cars.size();
+    std::vector<int> indirectData(carPaintModel->meshes.size() * MESH_MAX_LODS * 5);
+    writeCarLodCommands(indirectData.data(), nullptr);
+    indirectDrawRange = streamBuffer->Write(indirectData.data(), (GLsizeiptr)(indirectData.size() * sizeof(int)));
+    streamBuffer->Flush();
+    if (indirectDrawRange.buffer == 0)
+        return;
 
     // Set the compute shader as the active shader
     glUseProgram(cullingShader);
@@ -673,19 +1077,193 @@ void runCullingCompute()
     // Pass the uniforms
     glUniform1f(glGetUniformLocation(cullingShader, "cullingRadius"), 2.5f);
     glUniform3fv(glGetUniformLocation(cullingShader, "frustumPlanes"), 6 * 2, (const float*)planes);
+    glUniform3fv(glGetUniformLocation(cullingShader, "cameraPosition"), 1, &cullingCamera.Position[0]);
+    glUniform1ui(glGetUniformLocation(cullingShader, "instanceCapacity"), (unsigned int)cars.size());
+    glUniform1ui(glGetUniformLocation(cullingShader, "meshCount"), (unsigned int)carPaintModel->meshes.size());
+    setLodUniforms(cullingShader, lodTable);
 
     // Bind the buffers:
-    // - sourceInstanceBuffer: the instance data of all the cars
-    // - visibleInstanceBuffer: the destination buffer, to store only the visible cars
-    // - indirectDrawBuffer: the indirect buffer, to modify the count of visible instances
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, sourceInstanceBuffer);
+    // - sourceInstanceRange: the instance data of all the cars
+    // - visibleInstanceBuffer: the destination buffer, to store only the visible cars, grouped by LOD
+    // - indirectDrawRange: the indirect commands, to modify the count of visible instances of each mesh and LOD
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 0, sourceInstanceRange.buffer, sourceInstanceRange.offset, sourceInstanceRange.size);
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, visibleInstanceBuffer);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, indirectDrawBuffer);
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 2, indirectDrawRange.buffer, indirectDrawRange.offset, indirectDrawRange.size);
     // Dispatch the cars, in groups of 64
     glDispatchCompute(((int)cars.size() + 63) / 64, 1, 1);
 
-    // Make sure that the visibleInstanceBuffer and indirectDrawBuffer are finished being written to
-    glMemoryBarrier(GL_ATOMIC_COUNTER_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+    // Make sure that the visibleInstanceBuffer and the indirect commands are finished being written to
+    glMemoryBarrier(GL_ATOMIC_COUNTER_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+
+    // restore pbr shader
+    shader->use();
+}
+
+// draws a car with the LOD that fits its distance, and only the meshlets of it that can be visible
+void drawCar(const Car& car, const CarLodTable& lodTable)
+{
+    // the same LOD for every mesh of the car, as in the instanced paths
+    unsigned int lod = selectCarLod(lodTable, car.modelMatrix);
+    lodCars[lod]++;
+    for (Mesh& mesh : carPaintModel->meshes)
+    {
+        unsigned int meshLodIndex = std::min(lod, (unsigned int)mesh.lods.size() - 1);
+        const MeshLod& meshLod = mesh.lods[meshLodIndex];
+        if (!config.enableMeshletCulling)
+        {
+            trianglesDrawn += meshLod.indexCount / 3;
+            mesh.Draw(*shader, 1, 0, meshLodIndex);
+            continue;
+        }
+
+        visibleMeshlets.clear();
+        for (unsigned int i = meshLod.firstMeshlet; i < meshLod.firstMeshlet + meshLod.meshletCount; i++)
+        {
+            if (isMeshletVisible(mesh.meshlets[i], car.modelMatrix, cullingCamera.Position, config.enableCulling ? cullingPlanes : nullptr))
+            {
+                visibleMeshlets.push_back(i);
+                trianglesDrawn += mesh.meshlets[i].indexCount / 3;
+            }
+        }
+        meshletsTested += meshLod.meshletCount;
+        meshletsDrawn += (unsigned int)visibleMeshlets.size();
+        mesh.DrawMeshletList(*shader, visibleMeshlets);
+    }
+}
+
+CarLodTable buildCarLodTable()
+{
+    CarLodTable table;
+    for (const Mesh& mesh : carPaintModel->meshes)
+        table.count = std::max(table.count, (unsigned int)mesh.lods.size());
+    for (size_t i = 0; i < carPaintModel->meshes.size(); i++)
+    {
+        const Mesh& mesh = carPaintModel->meshes[i];
+        for (unsigned int lod = 0; lod < table.count; lod++)
+            table.errors[lod] = std::max(table.errors[lod], mesh.lods[std::min(lod, (unsigned int)mesh.lods.size() - 1)].error);
+
+        // smallest sphere around the current one and the one of the mesh
+        glm::vec4 sphere = mesh.boundingSphere;
+        float distance = glm::length(glm::vec3(sphere) - glm::vec3(table.sphere));
+        if (i == 0 || sphere.w >= distance + table.sphere.w)
+            table.sphere = sphere;
+        else if (table.sphere.w < distance + sphere.w)
+        {
+            float radius = (distance + table.sphere.w + sphere.w) * 0.5f;
+            glm::vec3 center = glm::vec3(table.sphere) + (glm::vec3(sphere) - glm::vec3(table.sphere)) * ((radius - table.sphere.w) / distance);
+            table.sphere = glm::vec4(center, radius);
+        }
+    }
+    return table;
+}
+
+// the same selection as Mesh::SelectLod, with the errors and the sphere of the table
+unsigned int selectCarLod(const CarLodTable& table, const glm::mat4& model)
+{
+    if (!config.enableLod)
+        return 0;
+    float scale = glm::length(glm::vec3(model[0]));
+    glm::vec3 center = glm::vec3(model * glm::vec4(glm::vec3(table.sphere), 1.0f));
+    float distance = glm::max(glm::length(center - cullingCamera.Position) - table.sphere.w * scale, 0.0f);
+    unsigned int lod = 0;
+    while (lod + 1 < table.count && table.errors[lod + 1] * scale * lodFactor <= distance)
+        lod++;
+    return lod;
+}
+
+// uniforms of the LOD selection in the culling compute shaders, see Mesh::SelectLod
+void setLodUniforms(int program, const CarLodTable& table)
+{
+    glUniform1ui(glGetUniformLocation(program, "lodCount"), config.enableLod ? table.count : 1);
+    glUniform1fv(glGetUniformLocation(program, "lodErrors"), MESH_MAX_LODS, table.errors);
+    glUniform4fv(glGetUniformLocation(program, "lodSphere"), 1, &table.sphere[0]);
+    glUniform1f(glGetUniformLocation(program, "lodFactor"), lodFactor);
+}
+
+// writes the indirect commands of the car, MESH_MAX_LODS for each mesh (see Model::Draw). Each mesh takes the index
+// range of its own LODs, and its last LOD for the levels it does not have. instanceCounts has the number of cars of each
+// level, or is null when the culling compute shader counts them
+void writeCarLodCommands(int* indirectData, const unsigned int* instanceCounts)
+{
+    for (size_t i = 0; i < carPaintModel->meshes.size(); i++)
+    {
+        const Mesh& mesh = carPaintModel->meshes[i];
+        for (unsigned int lod = 0; lod < MESH_MAX_LODS; lod++)
+        {
+            const MeshLod& meshLod = mesh.lods[std::min(lod, (unsigned int)mesh.lods.size() - 1)];
+            int* command = indirectData + (i * MESH_MAX_LODS + lod) * 5;
+            command[0] = (int)meshLod.indexCount;
+            command[1] = instanceCounts ? (int)instanceCounts[lod] : 0; // instance count
+            command[2] = (int)meshLod.firstIndex;
+        }
+    }
+}
+
+// draws the commands of indirectDrawRange, one for each LOD. The instances of each LOD start at lodInstanceOffsets[lod]
+// in the bound instance buffer
+void drawCarLods()
+{
+    if (indirectDrawRange.buffer == 0)
+        return; // the stream buffer was full
+    unsigned int lodCount = buildCarLodTable().count;
+    for (unsigned int lod = 0; lod < lodCount; lod++)
+    {
+        shader->setInt("instanceOffset", (int)lodInstanceOffsets[lod]);
+        carPaintModel->Draw(*shader, 0, indirectDrawRange.buffer, lod, indirectDrawRange.offset);
+    }
+    shader->setInt("instanceOffset", 0);
+}
+
+void createMeshletCullingCompute()
+{
+    meshletCullingShader = glCreateProgram();
+
+    int computeShader = glCreateShader(GL_COMPUTE_SHADER);
+
+    std::ifstream shaderStream("shaders/meshlet_culling.glsl");
+    std::ostringstream stringStream;
+    stringStream << shaderStream.rdbuf();
+    string shaderCodeStr = stringStream.str();
+    const char* shaderCode = shaderCodeStr.c_str();
+    glShaderSource(computeShader, 1, &shaderCode, nullptr);
+    glCompileShader(computeShader);
+    Shader::checkCompileErrors(computeShader, "COMPUTE");
+    glAttachShader(meshletCullingShader, computeShader);
+
+    glLinkProgram(meshletCullingShader);
+    Shader::checkCompileErrors(meshletCullingShader, "PROGRAM");
+
+    glDeleteShader(computeShader);
+}
+
+// fills the meshlet draw commands of every mesh of the car with the instances where that meshlet is visible, and is
+// part of the LOD selected for the instance
+void runMeshletCullingCompute(const BufferRange& instances, unsigned int instanceCount)
+{
+    glUseProgram(meshletCullingShader);
+
+    glUniform1ui(glGetUniformLocation(meshletCullingShader, "instanceCount"), instanceCount);
+    glUniform1ui(glGetUniformLocation(meshletCullingShader, "instanceCapacity"), (unsigned int)cars.size());
+    glUniform1f(glGetUniformLocation(meshletCullingShader, "cullingRadius"), 2.5f);
+    glUniform3fv(glGetUniformLocation(meshletCullingShader, "frustumPlanes"), 6 * 2, (const float*)cullingPlanes);
+    glUniform1i(glGetUniformLocation(meshletCullingShader, "frustumCulling"), config.enableCulling);
+    glUniform3fv(glGetUniformLocation(meshletCullingShader, "cameraPosition"), 1, &cullingCamera.Position[0]);
+
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 0, instances.buffer, instances.offset, instances.size);
+    // one LOD per car for all the meshes, a mesh with fewer LODs uses its last one
+    setLodUniforms(meshletCullingShader, buildCarLodTable());
+    for (Mesh& mesh : carPaintModel->meshes)
+    {
+        mesh.ResetMeshletCommands();
+        mesh.BindMeshletCullingBuffers();
+        glUniform1ui(glGetUniformLocation(meshletCullingShader, "meshLodCount"), (unsigned int)mesh.lods.size());
+        // one invocation per car and meshlet, the cars in groups of 64
+        if (instanceCount > 0)
+            glDispatchCompute((instanceCount + 63) / 64, (GLuint)mesh.meshlets.size(), 1);
+    }
+
+    // the draw commands are read as indirect arguments, and the instance lists as a vertex attribute
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
 
     // restore pbr shader
     shader->use();
@@ -7,12 +7,17 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <shader.h>
+#include "meshlets.h"
+#include "mesh_simplifier.h"
+#include "vertex_quantization.h"
 
+#include <algorithm>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <vector>
+#include <limits>
 using namespace std;
 
 struct Vertex {
@@ -28,6 +33,18 @@ struct Vertex {
     glm::vec3 Bitangent;
 };
 
+// maximum number of levels of detail of a mesh, LOD 0 is the original mesh
+const unsigned int MESH_MAX_LODS = 5;
+
+// a level of detail is a range of the index buffer, and the range of meshlets made from it
+struct MeshLod {
+    unsigned int firstIndex;
+    unsigned int indexCount;
+    float error; // how far the LOD can be from the original surface, in model units
+    unsigned int firstMeshlet;
+    unsigned int meshletCount;
+};
+
 struct Texture {
     unsigned int id;
     string type;
@@ -38,50 +55,43 @@ class Mesh {
 public:
     /*  Mesh Data  */
     vector<Vertex> vertices;
-    vector<unsigned int> indices;
+    vector<unsigned int> indices; // the indices of all the LODs, one after the other
     vector<Texture> textures;
+    vector<Meshlet> meshlets;
+    vector<MeshLod> lods;
+    glm::vec4 boundingSphere;     // xyz center, w radius, in model space
+    VertexQuantization quantization; // the GPU gets the vertices as PackedVertex, see vertex_quantization.h
     unsigned int VAO;
 
     /*  Functions  */
     // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    // upload can be false to build the mesh on a thread without the OpenGL context, then Upload creates the buffers
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, bool upload = true)
     {
         this->vertices = vertices;
         this->indices = indices;
         this->textures = textures;
 
+        // simplify the mesh into LODs, and split each LOD in meshlets
+        generateLods();
+
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
+        if (upload)
+            setupMesh();
+    }
+
+    // creates the buffers of a mesh that was built with upload = false, on the thread that has the OpenGL context
+    void Upload()
+    {
         setupMesh();
     }
 
     // render the mesh
-    void Draw(Shader shader, GLsizei instanceCount = 1, unsigned int indirectBuffer = 0)
+    void Draw(const Shader &shader, GLsizei instanceCount = 1, unsigned int indirectBuffer = 0, unsigned int lod = 0,
+              GLintptr indirectOffset = 0)
     {
-        // bind appropriate textures
-        unsigned int diffuseNr  = 1;
-        unsigned int specularNr = 1;
-        unsigned int normalNr   = 1;
-        unsigned int ambientNr   = 1;
-        for(unsigned int i = 0; i < textures.size(); i++)
-        {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
-            // retrieve texture number (the N in diffuse_textureN)
-            string number;
-            string name = textures[i].type;
-            if(name == "texture_diffuse")
-                number = std::to_string(diffuseNr++);
-            else if(name == "texture_specular")
-                number = std::to_string(specularNr++); // transfer unsigned int to stream
-            else if(name == "texture_normal")
-                number = std::to_string(normalNr++); // transfer unsigned int to stream
-            else if(name == "texture_ambient")
-                number = std::to_string(ambientNr++); // transfer unsigned int to stream
-
-            // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
-        }
+        bindTextures(shader);
+        setQuantizationUniforms(shader);
 
         // draw mesh
         glBindVertexArray(VAO);
@@ -92,7 +102,8 @@ public:
             glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
 
             // TODO 12.3 : Do the indirect drawing using glDrawElementsIndirect
-            glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, 0);
+            // the indirect buffer has a command for each LOD, from indirectOffset
+            glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)(indirectOffset + lod * 5 * sizeof(unsigned int)));
 
             // TODO 12.3 : Unbind the GL_DRAW_INDIRECT_BUFFER
             glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
@@ -100,10 +111,11 @@ public:
         else
         {
             // TODO 12.2 : if instance count is greater than one, we want to use glDrawElementsInstanced instead
+            const void* offset = (void*)(lods[lod].firstIndex * sizeof(unsigned int));
             if (instanceCount > 1)
-                glDrawElementsInstanced(GL_TRIANGLES, (int)indices.size(), GL_UNSIGNED_INT, 0, instanceCount);
+                glDrawElementsInstanced(GL_TRIANGLES, (int)lods[lod].indexCount, GL_UNSIGNED_INT, offset, instanceCount);
             else
-                glDrawElements(GL_TRIANGLES, (int)indices.size(), GL_UNSIGNED_INT, 0);
+                glDrawElements(GL_TRIANGLES, (int)lods[lod].indexCount, GL_UNSIGNED_INT, offset);
         }
 
         glBindVertexArray(0);
@@ -112,11 +124,236 @@ public:
         glActiveTexture(GL_TEXTURE0);
     }
 
+    // picks the coarsest LOD whose error is smaller than a pixel (or the error that lodFactor was made for) on screen.
+    // lodFactor is the size of the screen in pixels divided by 2 tan(fov / 2) and by the error allowed in pixels
+    unsigned int SelectLod(const glm::mat4 &model, const glm::vec3 &cameraPosition, float lodFactor) const
+    {
+        float scale = glm::length(glm::vec3(model[0]));
+        glm::vec3 center = glm::vec3(model * glm::vec4(glm::vec3(boundingSphere), 1.0f));
+        float distance = glm::max(glm::length(center - cameraPosition) - boundingSphere.w * scale, 0.0f);
+        unsigned int lod = 0;
+        while (lod + 1 < lods.size() && lods[lod + 1].error * scale * lodFactor <= distance)
+            lod++;
+        return lod;
+    }
+
+    // creates the draw commands of the meshlets (one glDrawElementsIndirect command per meshlet), and the lists of
+    // instances of each meshlet, with room for maxInstances per meshlet. The lists are read in the vertex shader as the
+    // per instance attribute 5, each command selects its list with baseInstance
+    void SetupMeshletInstances(unsigned int maxInstances)
+    {
+        meshletCommands.resize(meshlets.size());
+        for (unsigned int i = 0; i < meshlets.size(); i++)
+        {
+            meshletCommands[i].count = meshlets[i].indexCount;
+            meshletCommands[i].instanceCount = 0; // filled by the culling compute shader
+            meshletCommands[i].firstIndex = meshlets[i].firstIndex;
+            meshletCommands[i].baseVertex = 0;
+            meshletCommands[i].baseInstance = i * maxInstances;
+        }
+
+        glGenBuffers(1, &meshletCommandBuffer);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, meshletCommandBuffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, meshletCommands.size() * sizeof(MeshletDrawCommand), meshletCommands.data(), GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+        glGenBuffers(1, &meshletInstanceBuffer);
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, meshletInstanceBuffer);
+        glBufferData(GL_ARRAY_BUFFER, meshlets.size() * maxInstances * sizeof(unsigned int), nullptr, GL_DYNAMIC_COPY);
+        glEnableVertexAttribArray(5);
+        glVertexAttribIPointer(5, 1, GL_UNSIGNED_INT, sizeof(unsigned int), (void*)0);
+        glVertexAttribDivisor(5, 1);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // sets the instance count of every meshlet command back to 0, before culling
+    void ResetMeshletCommands()
+    {
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, meshletCommandBuffer);
+        glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, meshletCommands.size() * sizeof(MeshletDrawCommand), meshletCommands.data());
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+
+    // binds the buffers used by shaders/meshlet_culling.glsl (1: meshlets, 2: commands, 3: instance lists)
+    void BindMeshletCullingBuffers()
+    {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, meshletBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, meshletCommandBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, meshletInstanceBuffer);
+    }
+
+    // draws the instances that the culling compute shader added to the list of each meshlet, with a single call
+    void DrawMeshlets(const Shader &shader)
+    {
+        bindTextures(shader);
+        setQuantizationUniforms(shader);
+
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, meshletCommandBuffer);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, 0, (GLsizei)meshlets.size(), 0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        glBindVertexArray(0);
+
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // draws the given meshlets of a single instance, with a single call
+    void DrawMeshletList(const Shader &shader, const vector<unsigned int> &visibleMeshlets)
+    {
+        if (visibleMeshlets.empty())
+            return;
+        bindTextures(shader);
+        setQuantizationUniforms(shader);
+
+        meshletCounts.clear();
+        meshletOffsets.clear();
+        for (unsigned int i : visibleMeshlets)
+        {
+            meshletCounts.push_back((GLsizei)meshlets[i].indexCount);
+            meshletOffsets.push_back((const void*)(meshlets[i].firstIndex * sizeof(unsigned int)));
+        }
+
+        glBindVertexArray(VAO);
+        glMultiDrawElements(GL_TRIANGLES, meshletCounts.data(), GL_UNSIGNED_INT, meshletOffsets.data(), (GLsizei)meshletCounts.size());
+        glBindVertexArray(0);
+
+        glActiveTexture(GL_TEXTURE0);
+    }
+
 private:
+    // same layout as the arguments of glDrawElementsIndirect
+    struct MeshletDrawCommand
+    {
+        unsigned int count;
+        unsigned int instanceCount;
+        unsigned int firstIndex;
+        int baseVertex;
+        unsigned int baseInstance;
+    };
+
     /*  Render data  */
     unsigned int VBO, EBO;
+    unsigned int meshletBuffer = 0, meshletCommandBuffer = 0, meshletInstanceBuffer = 0;
+    vector<MeshletDrawCommand> meshletCommands;
+    vector<GLsizei> meshletCounts;
+    vector<const void*> meshletOffsets;
+
+    // the transform from the packed positions to model space
+    void setQuantizationUniforms(const Shader &shader)
+    {
+        shader.setVec3("positionOffset", quantization.offset);
+        shader.setVec3("positionScale", quantization.scale);
+    }
+
+    // texture unit of each texture. Every mesh uses the same units: the first texture of each type uses units 0 to 3
+    // (texture_diffuse1, texture_specular1, texture_normal1, texture_ambient1), the next ones units 8 and up, clear
+    // of the units the exercises use for their other textures
+    vector<unsigned int> textureUnits;
+    // the shaders whose samplers have been set to those units
+    vector<unsigned int> samplerShaders;
+
+    // binds the textures to their units. The samplers of a shader are set the first time the mesh is drawn with it,
+    // and they keep their value because all the meshes use the same units
+    void bindTextures(const Shader &shader)
+    {
+        if (std::find(samplerShaders.begin(), samplerShaders.end(), shader.ID) == samplerShaders.end())
+        {
+            setSamplers(shader);
+            samplerShaders.push_back(shader.ID);
+        }
+        for(unsigned int i = 0; i < textures.size(); i++)
+        {
+            glActiveTexture(GL_TEXTURE0 + textureUnits[i]); // active proper texture unit before binding
+            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+        }
+    }
+
+    // finds the unit and the sampler of each texture, and sets the samplers of the shader in use to the units
+    void setSamplers(const Shader &shader)
+    {
+        static const char* types[4] = { "texture_diffuse", "texture_specular", "texture_normal", "texture_ambient" };
+        unsigned int typeCount[4] = { 0, 0, 0, 0 };
+        textureUnits.resize(textures.size());
+        for(unsigned int i = 0; i < textures.size(); i++)
+        {
+            // retrieve texture number (the N in diffuse_textureN)
+            string name = textures[i].type;
+            unsigned int type = 0;
+            while (type < 4 && name != types[type])
+                type++;
+            if (type < 4)
+            {
+                unsigned int number = ++typeCount[type];
+                name += std::to_string(number);
+                textureUnits[i] = number == 1 ? type : 8 + (number - 2) * 4 + type;
+            }
+            else
+                textureUnits[i] = 4; // not a sampler of the exercise shaders
+            // now set the sampler to the texture unit
+            glUniform1i(shader.getUniformLocation(name), textureUnits[i]);
+        }
+    }
 
     /*  Functions    */
+    // makes each LOD with half of the triangles of the previous one, until the simplification gets stuck or
+    // MESH_MAX_LODS is reached. All the LODs use the same vertices
+    void generateLods()
+    {
+        glm::vec3 boxMin(std::numeric_limits<float>::max()), boxMax(-std::numeric_limits<float>::max());
+        for (const Vertex &vertex : vertices)
+        {
+            boxMin = glm::min(boxMin, vertex.Position);
+            boxMax = glm::max(boxMax, vertex.Position);
+        }
+        glm::vec3 center = (boxMin + boxMax) * 0.5f;
+        float radius = 0.0f;
+        for (const Vertex &vertex : vertices)
+            radius = glm::max(radius, glm::length(vertex.Position - center));
+        boundingSphere = glm::vec4(center, radius);
+
+        // each LOD is simplified from the original mesh, so its error is measured against the original surface
+        vector<vector<unsigned int>> levels(1, indices);
+        vector<float> errors(1, 0.0f);
+        while (levels.size() < MESH_MAX_LODS)
+        {
+            size_t target = levels.back().size() / 6 * 3;
+            float error = 0.0f;
+            vector<unsigned int> level = simplifyMesh(vertices, indices, target, &error);
+            if (level.empty() || level.size() > levels.back().size() * 3 / 4)
+                break;
+            levels.push_back(level);
+            errors.push_back(glm::max(error, errors.back()));
+        }
+
+        indices.clear();
+        meshlets.clear();
+        lods.clear();
+        cout << "Mesh LODs:";
+        for (size_t i = 0; i < levels.size(); i++)
+        {
+            // meshlets reorder the indices of the level, their index ranges are moved to where the level starts
+            vector<Meshlet> levelMeshlets = buildMeshlets(vertices, levels[i]);
+            MeshLod lod;
+            lod.firstIndex = (unsigned int)indices.size();
+            lod.indexCount = (unsigned int)levels[i].size();
+            lod.error = errors[i];
+            lod.firstMeshlet = (unsigned int)meshlets.size();
+            lod.meshletCount = (unsigned int)levelMeshlets.size();
+            for (Meshlet &meshlet : levelMeshlets)
+            {
+                meshlet.firstIndex += lod.firstIndex;
+                meshlet.lod = (unsigned int)i;
+            }
+            indices.insert(indices.end(), levels[i].begin(), levels[i].end());
+            meshlets.insert(meshlets.end(), levelMeshlets.begin(), levelMeshlets.end());
+            lods.push_back(lod);
+            cout << " " << lod.indexCount / 3 << " triangles (error " << lod.error << ")";
+        }
+        cout << endl;
+    }
+
     // initializes all the buffer objects/arrays
     void setupMesh()
     {
@@ -126,34 +363,38 @@ private:
         glGenBuffers(1, &EBO);
 
         glBindVertexArray(VAO);
-        // load data into vertex buffers
+        // load data into vertex buffers, packed in the compact format
+        quantization = computeVertexQuantization(vertices);
+        vector<PackedVertex> packedVertices(vertices.size());
+        for (size_t i = 0; i < vertices.size(); i++)
+            packedVertices[i] = packVertex(vertices[i], quantization);
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        // A great thing about structs is that their memory layout is sequential for all its items.
-        // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
-        // again translates to 3/2 floats which translates to a byte array.
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+        glBufferData(GL_ARRAY_BUFFER, packedVertices.size() * sizeof(PackedVertex), packedVertices.data(), GL_STATIC_DRAW);
 
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
         glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
 
-        // set the vertex attribute pointers
-        // vertex Positions
+        // set the vertex attribute pointers, the normalized shorts arrive in the shader as floats in [-1, 1]
+        // vertex Positions, and bitangent sign in w
         glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-        // vertex normals
+        glVertexAttribPointer(0, 4, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, position));
+        // vertex normals, octahedral
         glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+        glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, normal));
         // vertex texture coords
         glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-        // vertex tangent
+        glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, texCoords));
+        // vertex tangent, octahedral
         glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-        // vertex bitangent
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+        glVertexAttribPointer(3, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, tangent));
 
         glBindVertexArray(0);
+
+        // meshlet bounds, read by the culling compute shader
+        glGenBuffers(1, &meshletBuffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, meshletBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, meshlets.size() * sizeof(Meshlet), meshlets.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
     }
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,483 @@
+#ifndef MESH_SIMPLIFIER_H
+#define MESH_SIMPLIFIER_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <unordered_map>
+
+// Quadric error mesh simplification (Garland and Heckbert, "Surface Simplification Using Quadric Error Metrics").
+// Edges are collapsed into one of their two vertices, so the simplified index buffers can reuse the vertex buffer of
+// the original mesh. Vertices that share a position with other vertices (seams, where the normal or the texture
+// coordinates change) and vertices on the border of an open surface can only move along their seam or border, so the
+// outline and the seams keep their shape. Vertices where seams or borders meet are never moved.
+
+// sum of squared distances to a set of planes, weighted by the area of the triangles the planes come from
+struct SimplifierQuadric
+{
+    double xx = 0, xy = 0, xz = 0, yy = 0, yz = 0, zz = 0; // n * n^T
+    double x = 0, y = 0, z = 0;                           // n * d
+    double c = 0;                                         // d * d
+    double area = 0;
+};
+
+inline void addPlaneQuadric(SimplifierQuadric &q, const glm::dvec3 &n, double d, double weight)
+{
+    q.xx += n.x * n.x * weight; q.xy += n.x * n.y * weight; q.xz += n.x * n.z * weight;
+    q.yy += n.y * n.y * weight; q.yz += n.y * n.z * weight; q.zz += n.z * n.z * weight;
+    q.x += n.x * d * weight; q.y += n.y * d * weight; q.z += n.z * d * weight;
+    q.c += d * d * weight;
+}
+
+inline void addQuadric(SimplifierQuadric &q, const SimplifierQuadric &other)
+{
+    q.xx += other.xx; q.xy += other.xy; q.xz += other.xz; q.yy += other.yy; q.yz += other.yz; q.zz += other.zz;
+    q.x += other.x; q.y += other.y; q.z += other.z;
+    q.c += other.c;
+    q.area += other.area;
+}
+
+inline double evaluateQuadric(const SimplifierQuadric &q, const glm::dvec3 &p)
+{
+    double value = q.xx * p.x * p.x + q.yy * p.y * p.y + q.zz * p.z * p.z +
+                   2.0 * (q.xy * p.x * p.y + q.xz * p.x * p.z + q.yz * p.y * p.z) +
+                   2.0 * (q.x * p.x + q.y * p.y + q.z * p.z) + q.c;
+    return std::max(value, 0.0);
+}
+
+// distance from p to the closest point of the triangle abc (Ericson, "Real-Time Collision Detection", 5.1.5)
+inline double pointTriangleDistance(const glm::dvec3 &p, const glm::dvec3 &a, const glm::dvec3 &b, const glm::dvec3 &c)
+{
+    glm::dvec3 ab = b - a, ac = c - a, ap = p - a;
+    double d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+    if (d1 <= 0.0 && d2 <= 0.0)
+        return glm::length(p - a);
+    glm::dvec3 bp = p - b;
+    double d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+    if (d3 >= 0.0 && d4 <= d3)
+        return glm::length(p - b);
+    double vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0)
+        return glm::length(p - (a + ab * (d1 / (d1 - d3))));
+    glm::dvec3 cp = p - c;
+    double d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+    if (d6 >= 0.0 && d5 <= d6)
+        return glm::length(p - c);
+    double vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0)
+        return glm::length(p - (a + ac * (d2 / (d2 - d6))));
+    double va = d3 * d6 - d5 * d4;
+    if (va <= 0.0 && d4 - d3 >= 0.0 && d5 - d6 >= 0.0)
+        return glm::length(p - (b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)))));
+    double denominator = 1.0 / (va + vb + vc);
+    return glm::length(p - (a + ab * (vb * denominator) + ac * (vc * denominator)));
+}
+
+
+// simplifies a triangle list until it has targetIndexCount indices or no more edges can be collapsed. The result uses
+// the same vertices. resultError gets how far the result is from the original surface, in the units of the mesh:
+// the largest distance from an original vertex to the simplified triangles near the vertex it was collapsed into.
+// The simplified vertices are original vertices, so they are on the original surface. The quadric errors only order
+// the collapses, they are area weighted averages and can be smaller than the real distance
+template<typename Vertex>
+std::vector<unsigned int> simplifyMesh(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices,
+                                       size_t targetIndexCount, float *resultError = nullptr)
+{
+    const size_t triangleCount = indices.size() / 3;
+
+    // group the vertices by position, and use the same index for the vertices that are equal in every attribute
+    std::vector<unsigned int> order(vertices.size());
+    for (unsigned int v = 0; v < vertices.size(); v++)
+        order[v] = v;
+    auto positionLess = [&vertices](unsigned int a, unsigned int b)
+    {
+        return memcmp(&vertices[a].Position, &vertices[b].Position, sizeof(glm::vec3)) < 0;
+    };
+    std::sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b)
+    {
+        int compare = memcmp(&vertices[a].Position, &vertices[b].Position, sizeof(glm::vec3));
+        return compare != 0 ? compare < 0 : memcmp(&vertices[a], &vertices[b], sizeof(Vertex)) < 0;
+    });
+    std::vector<unsigned int> position(vertices.size()), canonical(vertices.size());
+    std::vector<std::vector<unsigned int>> twins; // different vertices at each position
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        unsigned int v = order[i];
+        if (i == 0 || positionLess(order[i - 1], v))
+            twins.emplace_back();
+        if (i > 0 && memcmp(&vertices[order[i - 1]], &vertices[v], sizeof(Vertex)) == 0)
+        {
+            canonical[v] = canonical[order[i - 1]];
+        }
+        else
+        {
+            canonical[v] = v;
+            twins.back().push_back(v);
+        }
+        position[v] = (unsigned int)twins.size() - 1;
+    }
+    const size_t positionCount = twins.size();
+
+    std::vector<unsigned int> corners(indices.size());
+    for (size_t i = 0; i < indices.size(); i++)
+        corners[i] = canonical[indices[i]];
+    auto cornerPosition = [&](size_t triangle, int corner) { return position[corners[triangle * 3 + corner]]; };
+    auto positionOf = [&](unsigned int p) { return glm::dvec3(vertices[twins[p][0]].Position); };
+
+    // quadrics of the planes of the triangles around each position, and the triangles around each position
+    std::vector<SimplifierQuadric> quadrics(positionCount);
+    std::vector<std::vector<unsigned int>> positionTriangles(positionCount);
+    std::vector<char> removed(triangleCount, 0);
+    size_t liveTriangles = 0;
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        glm::dvec3 p0 = positionOf(cornerPosition(t, 0)), p1 = positionOf(cornerPosition(t, 1)), p2 = positionOf(cornerPosition(t, 2));
+        glm::dvec3 normal = glm::cross(p1 - p0, p2 - p0);
+        double length = glm::length(normal);
+        if (cornerPosition(t, 0) == cornerPosition(t, 1) || cornerPosition(t, 1) == cornerPosition(t, 2) ||
+            cornerPosition(t, 0) == cornerPosition(t, 2))
+        {
+            removed[t] = 1; // degenerate in the input already
+            continue;
+        }
+        liveTriangles++;
+        if (length > 0.0)
+        {
+            normal /= length;
+            for (int c = 0; c < 3; c++)
+            {
+                SimplifierQuadric &q = quadrics[cornerPosition(t, c)];
+                addPlaneQuadric(q, normal, -glm::dot(normal, p0), length * 0.5);
+                q.area += length * 0.5;
+            }
+        }
+        for (int c = 0; c < 3; c++)
+            positionTriangles[cornerPosition(t, c)].push_back((unsigned int)t);
+    }
+
+    // edges of the current triangles, to find the borders and the seams
+    struct Edge
+    {
+        unsigned int count;
+        unsigned int vertex0, vertex1; // vertices of the first triangle that uses the edge
+        bool seam;
+        unsigned int triangle;
+    };
+    std::unordered_map<uint64_t, Edge> edges;
+    auto edgeKey = [](unsigned int a, unsigned int b)
+    {
+        return a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+    };
+
+    // border planes keep open borders in place, they are perpendicular to the triangle of the border edge
+    const double borderWeight = 10.0;
+    std::vector<SimplifierQuadric> borderQuadrics(positionCount);
+    enum Kind : char { INTERIOR, BORDER, SEAM, LOCKED };
+    std::vector<char> kind(positionCount);
+    std::vector<unsigned int> borderCount(positionCount), seamCount(positionCount);
+
+    std::vector<char> touched(positionCount);
+    std::vector<unsigned int> neighbourMark(positionCount, ~0u);
+    struct Collapse
+    {
+        unsigned int from, to;
+        float error;
+    };
+    std::vector<Collapse> collapses;
+    std::vector<unsigned int> collapsedInto(positionCount);
+    for (unsigned int p = 0; p < positionCount; p++)
+        collapsedInto[p] = p;
+    bool firstPass = true;
+
+    while (liveTriangles * 3 > targetIndexCount)
+    {
+        edges.clear();
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            if (removed[t])
+                continue;
+            for (int c = 0; c < 3; c++)
+            {
+                unsigned int v0 = corners[t * 3 + c], v1 = corners[t * 3 + (c + 1) % 3];
+                unsigned int p0 = position[v0], p1 = position[v1];
+                if (p0 > p1)
+                {
+                    std::swap(p0, p1);
+                    std::swap(v0, v1);
+                }
+                auto inserted = edges.insert({edgeKey(p0, p1), Edge{1, v0, v1, false, (unsigned int)t}});
+                if (!inserted.second)
+                {
+                    Edge &edge = inserted.first->second;
+                    edge.count++;
+                    edge.seam = edge.seam || edge.vertex0 != v0 || edge.vertex1 != v1;
+                }
+            }
+        }
+
+        std::fill(borderCount.begin(), borderCount.end(), 0);
+        std::fill(seamCount.begin(), seamCount.end(), 0);
+        std::fill(kind.begin(), kind.end(), (char)INTERIOR);
+        for (const auto &entry : edges)
+        {
+            unsigned int p0 = (unsigned int)(entry.first >> 32), p1 = (unsigned int)entry.first;
+            const Edge &edge = entry.second;
+            if (edge.count > 2)
+            {
+                kind[p0] = kind[p1] = LOCKED; // non-manifold
+                continue;
+            }
+            if (edge.count == 1)
+            {
+                borderCount[p0]++;
+                borderCount[p1]++;
+                if (firstPass)
+                {
+                    // plane through the edge, perpendicular to its triangle
+                    glm::dvec3 a = positionOf(p0), b = positionOf(p1);
+                    size_t t = edge.triangle;
+                    glm::dvec3 normal = glm::cross(positionOf(cornerPosition(t, 1)) - positionOf(cornerPosition(t, 0)),
+                                                   positionOf(cornerPosition(t, 2)) - positionOf(cornerPosition(t, 0)));
+                    glm::dvec3 plane = glm::cross(b - a, normal);
+                    double length = glm::length(plane);
+                    if (length > 0.0)
+                    {
+                        plane /= length;
+                        double weight = glm::dot(b - a, b - a) * borderWeight;
+                        addPlaneQuadric(borderQuadrics[p0], plane, -glm::dot(plane, a), weight);
+                        addPlaneQuadric(borderQuadrics[p1], plane, -glm::dot(plane, a), weight);
+                    }
+                }
+            }
+            else if (edge.seam)
+            {
+                seamCount[p0]++;
+                seamCount[p1]++;
+            }
+        }
+        if (firstPass)
+        {
+            for (size_t p = 0; p < positionCount; p++)
+            {
+                double area = quadrics[p].area;
+                addQuadric(quadrics[p], borderQuadrics[p]);
+                quadrics[p].area = area;
+            }
+            firstPass = false;
+        }
+        for (size_t p = 0; p < positionCount; p++)
+        {
+            if (kind[p] == LOCKED)
+                continue;
+            if (borderCount[p] == 0 && seamCount[p] == 0)
+                kind[p] = twins[p].size() > 1 ? LOCKED : INTERIOR;
+            else if (borderCount[p] == 2 && seamCount[p] == 0)
+                kind[p] = BORDER;
+            else if (seamCount[p] == 2 && borderCount[p] == 0)
+                kind[p] = SEAM;
+            else
+                kind[p] = LOCKED;
+        }
+
+        // cheapest allowed direction of every edge
+        collapses.clear();
+        for (const auto &entry : edges)
+        {
+            unsigned int p0 = (unsigned int)(entry.first >> 32), p1 = (unsigned int)entry.first;
+            const Edge &edge = entry.second;
+            Collapse best = {0, 0, -1.0f};
+            for (int direction = 0; direction < 2; direction++)
+            {
+                unsigned int from = direction == 0 ? p0 : p1, to = direction == 0 ? p1 : p0;
+                bool allowed = kind[from] == INTERIOR || (kind[from] == BORDER && edge.count == 1) ||
+                               (kind[from] == SEAM && edge.count == 2 && edge.seam);
+                if (!allowed)
+                    continue;
+                SimplifierQuadric q = quadrics[from];
+                addQuadric(q, quadrics[to]);
+                float error = (float)std::sqrt(evaluateQuadric(q, positionOf(to)) / std::max(q.area, 1e-30));
+                if (best.error < 0.0f || error < best.error)
+                    best = {from, to, error};
+            }
+            if (best.error >= 0.0f)
+                collapses.push_back(best);
+        }
+        if (collapses.empty())
+            break;
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse &a, const Collapse &b) { return a.error < b.error; });
+
+        // collapse the cheapest edges, each position is changed once per pass so the costs stay valid
+        std::fill(touched.begin(), touched.end(), 0);
+        size_t collapsed = 0;
+        for (const Collapse &collapse : collapses)
+        {
+            if (liveTriangles * 3 <= targetIndexCount)
+                break;
+            unsigned int from = collapse.from, to = collapse.to;
+            if (touched[from] || touched[to])
+                continue;
+
+            // link condition: the two positions can only share the neighbours of the triangles of the edge,
+            // otherwise the collapse would fold the surface onto itself
+            unsigned int shared = 0, edgeTriangles = 0;
+            for (unsigned int t : positionTriangles[from])
+            {
+                if (removed[t])
+                    continue;
+                for (int c = 0; c < 3; c++)
+                    neighbourMark[cornerPosition(t, c)] = from;
+            }
+            for (unsigned int t : positionTriangles[to])
+            {
+                if (removed[t])
+                    continue;
+                bool hasFrom = false;
+                for (int c = 0; c < 3; c++)
+                    hasFrom = hasFrom || cornerPosition(t, c) == from;
+                edgeTriangles += hasFrom;
+                for (int c = 0; c < 3; c++)
+                {
+                    unsigned int p = cornerPosition(t, c);
+                    if (p != from && p != to && neighbourMark[p] == from)
+                    {
+                        neighbourMark[p] = ~0u;
+                        shared++;
+                    }
+                }
+            }
+            for (unsigned int t : positionTriangles[from])
+            {
+                for (int c = 0; c < 3 && !removed[t]; c++)
+                    neighbourMark[cornerPosition(t, c)] = ~0u;
+            }
+            if (shared != edgeTriangles)
+                continue;
+
+            // the triangles that stay must not flip or become too thin
+            glm::dvec3 target = positionOf(to);
+            bool flips = false;
+            for (unsigned int t : positionTriangles[from])
+            {
+                if (removed[t])
+                    continue;
+                glm::dvec3 p[3], moved[3];
+                bool hasTo = false;
+                for (int c = 0; c < 3; c++)
+                {
+                    p[c] = positionOf(cornerPosition(t, c));
+                    moved[c] = cornerPosition(t, c) == from ? target : p[c];
+                    hasTo = hasTo || cornerPosition(t, c) == to;
+                }
+                if (hasTo)
+                    continue;
+                glm::dvec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+                glm::dvec3 after = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+                if (glm::dot(before, after) <= 0.25 * glm::length(before) * glm::length(after) || glm::length(after) == 0.0)
+                {
+                    flips = true;
+                    break;
+                }
+            }
+            if (flips)
+                continue;
+
+            // move the corners to the target position. With seams the target has several vertices, each corner
+            // takes the one with the closest attributes
+            for (unsigned int t : positionTriangles[from])
+            {
+                if (removed[t])
+                    continue;
+                bool hasTo = false;
+                for (int c = 0; c < 3; c++)
+                    hasTo = hasTo || cornerPosition(t, c) == to;
+                if (hasTo)
+                {
+                    removed[t] = 1;
+                    liveTriangles--;
+                    continue;
+                }
+                for (int c = 0; c < 3; c++)
+                {
+                    unsigned int &corner = corners[t * 3 + c];
+                    if (position[corner] != from)
+                        continue;
+                    unsigned int best = twins[to][0];
+                    float bestDistance = -1.0f;
+                    for (unsigned int twin : twins[to])
+                    {
+                        float distance = glm::length(vertices[twin].Normal - vertices[corner].Normal) +
+                                         glm::length(vertices[twin].TexCoords - vertices[corner].TexCoords);
+                        if (bestDistance < 0.0f || distance < bestDistance)
+                        {
+                            bestDistance = distance;
+                            best = twin;
+                        }
+                    }
+                    corner = best;
+                }
+                positionTriangles[to].push_back(t);
+                for (int c = 0; c < 3; c++)
+                    touched[cornerPosition(t, c)] = 1;
+            }
+            positionTriangles[from].clear();
+            addQuadric(quadrics[to], quadrics[from]);
+            touched[from] = touched[to] = 1;
+            collapsedInto[from] = to;
+            collapsed++;
+        }
+        if (collapsed == 0)
+            break;
+    }
+
+    std::vector<unsigned int> result;
+    result.reserve(liveTriangles * 3);
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        if (!removed[t])
+            result.insert(result.end(), &corners[t * 3], &corners[t * 3] + 3);
+    }
+    if (resultError != nullptr)
+    {
+        // the closest triangle is searched around the position a vertex ended in and around the neighbours of that
+        // position. It is not always the closest one of the whole mesh, so this can only be larger than the real
+        // distance
+        double maxError = 0.0;
+        for (unsigned int p = 0; p < positionCount; p++)
+        {
+            if (positionTriangles[p].empty() && collapsedInto[p] == p)
+                continue; // only in degenerate triangles
+            unsigned int end = p;
+            while (collapsedInto[end] != end)
+                end = collapsedInto[end];
+            collapsedInto[p] = end;
+            if (end == p)
+                continue; // still a vertex of the result
+            glm::dvec3 point = positionOf(p);
+            double distance = glm::length(point - positionOf(end));
+            for (unsigned int t : positionTriangles[end])
+            {
+                for (int c = 0; c < 3 && !removed[t]; c++)
+                {
+                    for (unsigned int neighbourTriangle : positionTriangles[cornerPosition(t, c)])
+                    {
+                        if (removed[neighbourTriangle])
+                            continue;
+                        distance = std::min(distance, pointTriangleDistance(point,
+                                                                            positionOf(cornerPosition(neighbourTriangle, 0)),
+                                                                            positionOf(cornerPosition(neighbourTriangle, 1)),
+                                                                            positionOf(cornerPosition(neighbourTriangle, 2))));
+                    }
+                }
+            }
+            maxError = std::max(maxError, distance);
+        }
+        *resultError = (float)maxError;
+    }
+    return result;
+}
+
+#endif
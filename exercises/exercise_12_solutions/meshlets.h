@@ -0,0 +1,195 @@
+#ifndef MESHLETS_H
+#define MESHLETS_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// Meshlets (clusters) are small groups of neighbour triangles that are culled together.
+// Each meshlet is a range of the index buffer of its mesh, with a bounding sphere for frustum culling and a normal
+// cone for back-face culling: if the viewer is inside the "back" of the cone, every triangle of the meshlet faces away.
+
+const unsigned int MESHLET_MAX_VERTICES = 64;
+const unsigned int MESHLET_MAX_TRIANGLES = 124;
+
+// the layout matches the Meshlet struct in shaders/meshlet_culling.glsl (std430)
+struct Meshlet
+{
+    glm::vec4 boundingSphere; // xyz center, w radius
+    glm::vec4 coneApex;       // xyz apex, w unused
+    glm::vec4 coneAxisCutoff; // xyz axis, w cutoff, a cutoff greater than 1 means the cone can't be used for culling
+    unsigned int firstIndex;
+    unsigned int indexCount;
+    unsigned int vertexCount;
+    unsigned int lod;         // level of detail of the mesh the meshlet belongs to
+};
+
+
+// splits a triangle list in meshlets, the triangles are reordered so each meshlet is a contiguous range of indices.
+// Meshlets grow by adding the neighbour triangle that brings the fewest new vertices, until a limit is reached
+template<typename Vertex>
+std::vector<Meshlet> buildMeshlets(const std::vector<Vertex> &vertices, std::vector<unsigned int> &indices)
+{
+    std::vector<Meshlet> meshlets;
+    const size_t triangleCount = indices.size() / 3;
+
+    // triangles that use each vertex
+    std::vector<unsigned int> offsets(vertices.size() + 1, 0);
+    for (unsigned int index : indices)
+        offsets[index + 1]++;
+    for (size_t v = 0; v < vertices.size(); v++)
+        offsets[v + 1] += offsets[v];
+    std::vector<unsigned int> adjacency(indices.size()), filled(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); i++)
+        adjacency[filled[indices[i]]++] = (unsigned int)(i / 3);
+
+    std::vector<char> used(triangleCount, 0);
+    std::vector<int> vertexMeshlet(vertices.size(), -1); // last meshlet that used each vertex
+    std::vector<unsigned int> meshletVertices, meshletTriangles, result;
+    result.reserve(indices.size());
+    size_t nextTriangle = 0;
+
+    while (true)
+    {
+        while (nextTriangle < triangleCount && used[nextTriangle])
+            nextTriangle++;
+        if (nextTriangle == triangleCount)
+            break;
+
+        int id = (int)meshlets.size();
+        meshletVertices.clear();
+        meshletTriangles.clear();
+        long long candidate = (long long)nextTriangle;
+        while (candidate >= 0)
+        {
+            unsigned int triangle = (unsigned int)candidate;
+            used[triangle] = 1;
+            meshletTriangles.push_back(triangle);
+            for (int c = 0; c < 3; c++)
+            {
+                unsigned int v = indices[triangle * 3 + c];
+                if (vertexMeshlet[v] != id)
+                {
+                    vertexMeshlet[v] = id;
+                    meshletVertices.push_back(v);
+                }
+            }
+            if (meshletTriangles.size() == MESHLET_MAX_TRIANGLES)
+                break;
+
+            // next triangle: a neighbour that fits and adds the fewest vertices
+            candidate = -1;
+            int bestNewVertices = 4;
+            for (unsigned int v : meshletVertices)
+            {
+                for (unsigned int i = offsets[v]; i < offsets[v + 1]; i++)
+                {
+                    unsigned int t = adjacency[i];
+                    if (used[t])
+                        continue;
+                    int newVertices = (vertexMeshlet[indices[t * 3]] != id) + (vertexMeshlet[indices[t * 3 + 1]] != id) +
+                                      (vertexMeshlet[indices[t * 3 + 2]] != id);
+                    if (newVertices < bestNewVertices && meshletVertices.size() + newVertices <= MESHLET_MAX_VERTICES)
+                    {
+                        bestNewVertices = newVertices;
+                        candidate = t;
+                    }
+                }
+            }
+        }
+
+        Meshlet meshlet;
+        meshlet.firstIndex = (unsigned int)result.size();
+        meshlet.indexCount = (unsigned int)meshletTriangles.size() * 3;
+        meshlet.vertexCount = (unsigned int)meshletVertices.size();
+        meshlet.lod = 0;
+        for (unsigned int t : meshletTriangles)
+            result.insert(result.end(), &indices[t * 3], &indices[t * 3] + 3);
+
+        // bounding sphere around the center of the bounding box
+        glm::vec3 boxMin(std::numeric_limits<float>::max()), boxMax(-std::numeric_limits<float>::max());
+        for (unsigned int v : meshletVertices)
+        {
+            boxMin = glm::min(boxMin, vertices[v].Position);
+            boxMax = glm::max(boxMax, vertices[v].Position);
+        }
+        glm::vec3 center = (boxMin + boxMax) * 0.5f;
+        float radius = 0.0f;
+        for (unsigned int v : meshletVertices)
+            radius = std::max(radius, glm::length(vertices[v].Position - center));
+        meshlet.boundingSphere = glm::vec4(center, radius);
+
+        // normal cone, the axis is the average of the triangle normals and the cutoff comes from the widest one
+        std::vector<glm::vec3> normals;
+        glm::vec3 axis(0.0f);
+        for (unsigned int t : meshletTriangles)
+        {
+            const glm::vec3 &p0 = vertices[indices[t * 3]].Position;
+            const glm::vec3 &p1 = vertices[indices[t * 3 + 1]].Position;
+            const glm::vec3 &p2 = vertices[indices[t * 3 + 2]].Position;
+            glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+            float length = glm::length(normal);
+            normal = length > 0.0f ? normal / length : glm::vec3(0.0f); // degenerate triangles don't face anywhere
+            normals.push_back(normal);
+            axis += normal;
+        }
+        float axisLength = glm::length(axis);
+        axis = axisLength > 0.0f ? axis / axisLength : glm::vec3(0.0f, 1.0f, 0.0f);
+        float minDot = axisLength > 0.0f ? 1.0f : -1.0f;
+        for (const glm::vec3 &normal : normals)
+            minDot = std::min(minDot, glm::dot(axis, normal));
+
+        if (minDot <= 0.0f)
+        {
+            // the normals spread over more than a half sphere, some triangle always faces the viewer
+            meshlet.coneApex = glm::vec4(center, 0.0f);
+            meshlet.coneAxisCutoff = glm::vec4(axis, 2.0f);
+        }
+        else
+        {
+            // apex behind the planes of all the triangles, so that a viewer on the front side of any triangle is
+            // outside of the cone
+            float apexDistance = 0.0f;
+            for (size_t i = 0; i < meshletTriangles.size(); i++)
+            {
+                const glm::vec3 &p0 = vertices[indices[meshletTriangles[i] * 3]].Position;
+                float denominator = glm::dot(axis, normals[i]);
+                if (denominator > 0.0f)
+                    apexDistance = std::max(apexDistance, glm::dot(center - p0, normals[i]) / denominator);
+            }
+            meshlet.coneApex = glm::vec4(center - axis * apexDistance, 0.0f);
+            // the cone of view directions that see all the triangles from behind has half angle 90 - spread of the normals
+            meshlet.coneAxisCutoff = glm::vec4(axis, std::sqrt(1.0f - minDot * minDot));
+        }
+
+        meshlets.push_back(meshlet);
+    }
+
+    indices.swap(result);
+    return meshlets;
+}
+
+
+// frustum and normal cone test of a meshlet of an instance. The planes are 6 (point, normal) pairs, like the ones in
+// Camera::GetFrustumPlane, or null to skip the frustum test. The model matrix can rotate, translate and scale uniformly
+inline bool isMeshletVisible(const Meshlet &meshlet, const glm::mat4 &model, const glm::vec3 &cameraPosition,
+                             const glm::vec3 *frustumPlanes)
+{
+    float scale = glm::length(glm::vec3(model[0]));
+    glm::vec3 center = glm::vec3(model * glm::vec4(glm::vec3(meshlet.boundingSphere), 1.0f));
+    float radius = meshlet.boundingSphere.w * scale;
+    for (int plane = 0; frustumPlanes && plane < 6; plane++)
+    {
+        if (glm::dot(center - frustumPlanes[plane * 2], frustumPlanes[plane * 2 + 1]) <= -radius)
+            return false;
+    }
+
+    glm::vec3 apex = glm::vec3(model * glm::vec4(glm::vec3(meshlet.coneApex), 1.0f));
+    glm::vec3 axis = glm::normalize(glm::vec3(model * glm::vec4(glm::vec3(meshlet.coneAxisCutoff), 0.0f)));
+    return glm::dot(glm::normalize(apex - cameraPosition), axis) < meshlet.coneAxisCutoff.w;
+}
+
+#endif
@@ -13,6 +13,8 @@
 
 #include <mesh.h>
 #include <shader.h>
+#include "async_loader.h"
+#include "texture_cache.h"
 
 #include <string>
 #include <fstream>
@@ -20,6 +22,8 @@
 #include <iostream>
 #include <map>
 #include <vector>
+#include <memory>
+#include <unordered_map>
 using namespace std;
 
 unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false);
@@ -38,23 +42,146 @@ public:
     Model(string const &path, bool gamma = false) : gammaCorrection(gamma)
     {
         loadModel(path);
+        uploadTextures();
     }
 
-    // draws the model, and thus all its meshes
-    void Draw(Shader shader, GLsizei instanceCount = 1, unsigned int indirectBuffer = 0)
+    // loads the model in the background: the file is imported, the meshes are processed and the textures decoded on a
+    // worker thread of the loader, and the meshes and textures are uploaded by loader.ProcessUploads. Until then the
+    // model has no meshes and draws a placeholder box. onResident is called on the render thread once it is loaded.
+    // The model must stay alive until it is resident
+    Model(AsyncLoader &loader, string const &path, bool gamma = false, std::function<void(Model&)> onResident = nullptr)
+        : gammaCorrection(gamma), resident(false)
     {
+        loader.Load([this, path, gamma, onResident]()
+        {
+            // the worker fills a model of its own, so the render thread never sees a model that is half loaded
+            shared_ptr<Model> loaded(new Model(gamma));
+            loaded->loadModel(path);
+            // the images are decoded by the texture cache, the upload steps must not wait for them
+            for (CachedTexture *texture : loaded->cachedTextures)
+                TextureCache::Get().WaitDecoded(texture);
+
+            vector<AsyncLoader::UploadStep> steps;
+            for (size_t i = 0; i < loaded->cachedTextures.size(); i++)
+                steps.push_back([loaded, i]() { TextureCache::Get().Upload(loaded->cachedTextures[i]); });
+            for (size_t i = 0; i < loaded->meshes.size(); i++)
+                steps.push_back([loaded, i]() { loaded->meshes[i].Upload(); });
+            steps.push_back([this, loaded, onResident]()
+            {
+                loaded->uploadTextures();
+                meshes = std::move(loaded->meshes);
+                textures_loaded = std::move(loaded->textures_loaded);
+                cachedTextures.swap(loaded->cachedTextures);
+                directory = loaded->directory;
+                resident = true;
+                if (onResident)
+                    onResident(*this);
+            });
+            return steps;
+        });
+    }
+
+    Model(const Model&) = delete;
+    Model& operator=(const Model&) = delete;
+
+    // gives the textures back to the cache
+    ~Model()
+    {
+        for (CachedTexture *texture : cachedTextures)
+            TextureCache::Get().Release(texture);
+    }
+
+    // false while the model is being loaded in the background
+    bool IsResident() const
+    {
+        return resident;
+    }
+
+    // draws the model, and thus all its meshes. The indirect buffer has MESH_MAX_LODS commands for each mesh, from
+    // indirectOffset
+    void Draw(const Shader &shader, GLsizei instanceCount = 1, unsigned int indirectBuffer = 0, unsigned int lod = 0,
+              GLintptr indirectOffset = 0)
+    {
+        if (!resident)
+        {
+            placeholder().Draw(shader, instanceCount);
+            return;
+        }
         for(unsigned int i = 0; i < meshes.size(); i++)
-            meshes[i].Draw(shader, instanceCount, indirectBuffer);
+            meshes[i].Draw(shader, instanceCount, indirectBuffer, lod,
+                           indirectOffset + (GLintptr)(i * MESH_MAX_LODS * 5 * sizeof(unsigned int)));
     }
 
 private:
+    bool resident = true;
+    // background loading: the meshes are not uploaded
+    bool deferUploads = false;
+    // the textures of the model in the cache, in the order of textures_loaded
+    vector<CachedTexture*> cachedTextures;
+    unordered_map<string, unsigned int> textureIndices; // path in the material to index in textures_loaded
+
+    explicit Model(bool gamma) : gammaCorrection(gamma), deferUploads(true)
+    {
+    }
+
+    // a box of size 1 around the origin, drawn while a model is loading
+    static Mesh& placeholder()
+    {
+        static Mesh* mesh = nullptr;
+        if (mesh == nullptr)
+        {
+            vector<Vertex> vertices;
+            vector<unsigned int> indices;
+            for (int face = 0; face < 6; face++)
+            {
+                glm::vec3 normal(0.0f), tangent(0.0f);
+                normal[face / 2] = face % 2 == 0 ? 1.0f : -1.0f;
+                tangent[(face / 2 + 1) % 3] = 1.0f;
+                glm::vec3 bitangent = glm::cross(normal, tangent);
+                unsigned int first = (unsigned int)vertices.size();
+                for (int corner = 0; corner < 4; corner++)
+                {
+                    glm::vec2 uv(corner & 1, corner >> 1);
+                    Vertex vertex;
+                    vertex.Position = (normal + tangent * (uv.x * 2.0f - 1.0f) + bitangent * (uv.y * 2.0f - 1.0f)) * 0.5f;
+                    vertex.Normal = normal;
+                    vertex.TexCoords = uv;
+                    vertex.Tangent = tangent;
+                    vertex.Bitangent = bitangent;
+                    vertices.push_back(vertex);
+                }
+                unsigned int quad[6] = { first, first + 1, first + 3, first, first + 3, first + 2 };
+                indices.insert(indices.end(), quad, quad + 6);
+            }
+            mesh = new Mesh(vertices, indices, vector<Texture>());
+        }
+        return *mesh;
+    }
+
+    // uploads the textures the cache doesn't have yet, waiting for the images that are still being decoded. While the
+    // model is loaded, the id of each texture is its index in textures_loaded, it is replaced with the OpenGL id
+    void uploadTextures()
+    {
+        vector<unsigned int> ids(cachedTextures.size());
+        for (size_t i = 0; i < cachedTextures.size(); i++)
+            ids[i] = TextureCache::Get().Upload(cachedTextures[i]);
+        for (Mesh &mesh : meshes)
+        {
+            for (Texture &texture : mesh.textures)
+                texture.id = ids[texture.id];
+        }
+        for (Texture &texture : textures_loaded)
+            texture.id = ids[texture.id];
+    }
+
     /*  Functions   */
     // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
     void loadModel(string const &path)
     {
         // read file via ASSIMP
         Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace |
+                                                       aiProcess_JoinIdenticalVertices); // shared vertices, needed to simplify the meshes
         // check for errors
         if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
         {
@@ -164,7 +291,19 @@ private:
         textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
 
         // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        return Mesh(vertices, indices, textures, !deferUploads);
+    }
+
+    // the usage of the textures of each type, it decides how they are compressed
+    static TextureUsage textureUsage(aiTextureType type)
+    {
+        switch (type)
+        {
+            case aiTextureType_DIFFUSE: return TextureUsage::DIFFUSE;
+            case aiTextureType_HEIGHT: return TextureUsage::NORMAL; // the normal maps, see processMesh
+            case aiTextureType_SPECULAR: return TextureUsage::SPECULAR;
+            default: return TextureUsage::AMBIENT;
+        }
     }
 
     // checks all material textures of a given type and loads the textures if they're not loaded yet.
@@ -177,25 +316,22 @@ private:
             aiString str;
             mat->GetTexture(type, i, &str);
             // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            bool skip = false;
-            for(unsigned int j = 0; j < textures_loaded.size(); j++)
+            auto loaded = textureIndices.find(str.C_Str());
+            if(loaded != textureIndices.end())
             {
-                if(std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-                {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                    break;
-                }
-            }
-            if(!skip)
-            {   // if texture hasn't been loaded already, load it
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory, type == aiTextureType_DIFFUSE);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
+                textures.push_back(textures_loaded[loaded->second]);
+                continue;
             }
+            // get the texture from the cache, it starts decoding the image if no other model uses it. The id is the
+            // index of the texture until uploadTextures
+            Texture texture;
+            texture.id = (unsigned int)textures_loaded.size();
+            texture.type = typeName;
+            texture.path = str.C_Str();
+            cachedTextures.push_back(TextureCache::Get().Acquire(this->directory + '/' + texture.path, textureUsage(type)));
+            textureIndices[texture.path] = texture.id;
+            textures.push_back(texture);
+            textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
         }
         return textures;
     }
@@ -207,11 +343,34 @@ unsigned int TextureFromFile(const char *path, const string &directory, bool gam
     string filename = string(path);
     filename = directory + '/' + filename;
 
+    ImageData image = decodeImage(filename);
+    return uploadTexture(image, gamma);
+}
+
+// reads an image file, it doesn't use OpenGL so it can run on any thread
+ImageData decodeImage(const string &filename)
+{
+    ImageData image;
+    image.data = stbi_load(filename.c_str(), &image.width, &image.height, &image.components, 0);
+    if (!image.data)
+        std::cout << "Texture failed to load at path: " << filename << std::endl;
+    return image;
+}
+
+void freeImage(ImageData &image)
+{
+    stbi_image_free(image.data);
+    image.data = nullptr;
+}
+
+// creates a texture with the image, and frees the image data
+unsigned int uploadTexture(ImageData &image, bool gamma)
+{
     unsigned int textureID;
     glGenTextures(1, &textureID);
 
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
+    int width = image.width, height = image.height, nrComponents = image.components;
+    unsigned char *data = image.data;
     if (data)
     {
         GLenum format, internalFormat;
@@ -237,13 +396,8 @@ unsigned int TextureFromFile(const char *path, const string &directory, bool gam
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
     }
+    freeImage(image);
 
     return textureID;
 }
@@ -0,0 +1,315 @@
+#ifndef OCCLUSION_CULLER_H
+#define OCCLUSION_CULLER_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// Software occlusion culling on the CPU.
+// Occluders are rasterized into a small depth buffer that stores, for each pixel, the distance (clip space w) of the
+// nearest occluder. To stay conservative each occluder triangle is written with the distance of its farthest vertex,
+// only to the pixels it covers completely, and an object is only culled if every pixel of its screen space rectangle
+// has an occluder closer than the nearest point of the object. Rows are padded to a multiple of 8 floats and both the rasterization and the test work on
+// whole rows without branches, so the inner loops can be vectorized by the compiler.
+class OcclusionCuller
+{
+public:
+    // statistics of the last frame
+    unsigned int TestedCount = 0;
+    unsigned int CulledCount = 0;
+    unsigned int OccluderCount = 0;
+
+    OcclusionCuller(int width = 256, int height = 128)
+        : width(width), height(height), stride((width + 7) & ~7), depth(stride * height)
+    {
+    }
+
+    // clears the depth buffer, must be called every frame before adding occluders
+    void BeginFrame(const glm::mat4& viewProjection)
+    {
+        this->viewProjection = viewProjection;
+        std::fill(depth.begin(), depth.end(), std::numeric_limits<float>::max());
+        TestedCount = CulledCount = OccluderCount = 0;
+    }
+
+    // rasterizes a box, given by its bounds in local space and its model matrix, into the depth buffer
+    void AddOccluderBox(const glm::mat4& model, const glm::vec3& boxMin, const glm::vec3& boxMax)
+    {
+        glm::vec3 screen[8];
+        if (!projectBox(model, boxMin, boxMax, screen))
+            return; // the box crosses the near plane, skip it instead of clipping (an occluder is optional)
+
+        // two triangles per face of the box, corners are indexed by their bits: x = 1, y = 2, z = 4
+        static const int faces[12][3] = {
+            {0, 1, 3}, {0, 3, 2}, {4, 6, 7}, {4, 7, 5}, // -z, +z
+            {0, 4, 5}, {0, 5, 1}, {2, 3, 7}, {2, 7, 6}, // -y, +y
+            {0, 2, 6}, {0, 6, 4}, {1, 5, 7}, {1, 7, 3}  // -x, +x
+        };
+        for (const int* face : faces)
+            rasterizeTriangle(screen[face[0]], screen[face[1]], screen[face[2]]);
+        OccluderCount++;
+    }
+
+    // returns false only if the box is completely hidden behind the occluders added so far
+    bool IsVisibleBox(const glm::mat4& model, const glm::vec3& boxMin, const glm::vec3& boxMax)
+    {
+        TestedCount++;
+        glm::vec3 screen[8];
+        if (!projectBox(model, boxMin, boxMax, screen))
+            return true; // the box crosses the near plane, assume it is visible
+
+        glm::vec3 rectMin = screen[0], rectMax = screen[0];
+        for (int i = 1; i < 8; i++)
+        {
+            rectMin = glm::min(rectMin, screen[i]);
+            rectMax = glm::max(rectMax, screen[i]);
+        }
+        int x0 = std::max(0, (int)std::floor(rectMin.x)), x1 = std::min(width - 1, (int)std::floor(rectMax.x));
+        int y0 = std::max(0, (int)std::floor(rectMin.y)), y1 = std::min(height - 1, (int)std::floor(rectMax.y));
+        if (x0 > x1 || y0 > y1)
+        {
+            CulledCount++;
+            return false; // off screen
+        }
+
+        // the box is visible if any pixel of its rectangle has no occluder in front of its nearest point
+        float nearest = rectMin.z;
+        for (int y = y0; y <= y1; y++)
+        {
+            const float* row = &depth[y * stride];
+            int visible = 0;
+            for (int x = x0; x <= x1; x++)
+                visible |= row[x] > nearest;
+            if (visible)
+                return true;
+        }
+        CulledCount++;
+        return false;
+    }
+
+    // finds a box that is enclosed by the surface of a mesh, given as a list of triangles (3 positions each) inside
+    // boundsMin, boundsMax. Any line of sight into such a box crosses the surface first, so the box can be used as
+    // an occluder without hiding anything the mesh doesn't. The bounds are split in resolution^3 voxels, the voxels
+    // the triangles go through are marked, and the voxels that can't be reached from the outside without crossing a
+    // marked one are enclosed. The box grows from the enclosed voxel nearest to the center while its faces stay
+    // enclosed. Returns false if no voxel is enclosed (a mesh with holes, like a car body with open windows).
+    // closing thickens the surface by that many voxels first, which closes the holes up to twice as wide. The box is
+    // then behind the surface or behind a closed hole, so it can hide what is seen through the hole
+    static bool FindEnclosedBox(const std::vector<glm::vec3>& triangles, glm::vec3 boundsMin, glm::vec3 boundsMax,
+                                glm::vec3& boxMin, glm::vec3& boxMax, int resolution = 32, int closing = 0)
+    {
+        const int n = resolution;
+        glm::vec3 voxelSize = (boundsMax - boundsMin) / (float)n;
+        if (!(voxelSize.x > 0.0f && voxelSize.y > 0.0f && voxelSize.z > 0.0f))
+            return false;
+        auto index = [n](int x, int y, int z) { return (x * n + y) * n + z; };
+
+        // 0 unknown, 1 surface, 2 outside, 3 enclosed next to the surface. Triangles are sampled at a quarter of the
+        // smallest voxel side: a voxel that is only touched between samples stays unmarked, which can only make the
+        // enclosed region smaller
+        std::vector<unsigned char> voxels((size_t)n * n * n, 0);
+        float spacing = 0.25f * std::min(voxelSize.x, std::min(voxelSize.y, voxelSize.z));
+        for (size_t t = 0; t + 2 < triangles.size(); t += 3)
+        {
+            const glm::vec3 &p0 = triangles[t], &p1 = triangles[t + 1], &p2 = triangles[t + 2];
+            float longest = std::max(glm::length(p1 - p0), std::max(glm::length(p2 - p1), glm::length(p0 - p2)));
+            int steps = std::max(1, (int)std::ceil(longest / spacing));
+            for (int i = 0; i <= steps; i++)
+                for (int j = 0; i + j <= steps; j++)
+                {
+                    glm::vec3 p = p0 + (p1 - p0) * ((float)i / steps) + (p2 - p0) * ((float)j / steps);
+                    glm::ivec3 cell = glm::ivec3((p - boundsMin) / voxelSize);
+                    cell = glm::clamp(cell, glm::ivec3(0), glm::ivec3(n - 1));
+                    voxels[index(cell.x, cell.y, cell.z)] = 1;
+                }
+        }
+        for (int step = 0; step < closing; step++)
+        {
+            std::vector<unsigned char> surface(voxels);
+            for (int x = 0; x < n; x++)
+                for (int y = 0; y < n; y++)
+                    for (int z = 0; z < n; z++)
+                    {
+                        if (surface[index(x, y, z)] != 1)
+                            continue;
+                        for (int dx = std::max(x - 1, 0); dx <= std::min(x + 1, n - 1); dx++)
+                            for (int dy = std::max(y - 1, 0); dy <= std::min(y + 1, n - 1); dy++)
+                                for (int dz = std::max(z - 1, 0); dz <= std::min(z + 1, n - 1); dz++)
+                                    voxels[index(dx, dy, dz)] = 1;
+                    }
+        }
+
+        // flood fill the outside from the voxels on the border of the grid, through faces only
+        std::vector<glm::ivec3> stack;
+        for (int x = 0; x < n; x++)
+            for (int y = 0; y < n; y++)
+                for (int z = 0; z < n; z++)
+                    if ((x == 0 || y == 0 || z == 0 || x == n - 1 || y == n - 1 || z == n - 1) && voxels[index(x, y, z)] == 0)
+                    {
+                        voxels[index(x, y, z)] = 2;
+                        stack.push_back(glm::ivec3(x, y, z));
+                    }
+        const glm::ivec3 neighbors[6] = { {1, 0, 0}, {-1, 0, 0}, {0, 1, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1} };
+        while (!stack.empty())
+        {
+            glm::ivec3 cell = stack.back();
+            stack.pop_back();
+            for (const glm::ivec3& offset : neighbors)
+            {
+                glm::ivec3 next = cell + offset;
+                if (next.x < 0 || next.y < 0 || next.z < 0 || next.x >= n || next.y >= n || next.z >= n)
+                    continue;
+                unsigned char& voxel = voxels[index(next.x, next.y, next.z)];
+                if (voxel == 0)
+                {
+                    voxel = 2;
+                    stack.push_back(next);
+                }
+            }
+        }
+
+        // the enclosed voxels are the unknown ones that are left. The ones next to a surface voxel are not used: the
+        // surface could cross them between two samples
+        for (int x = 0; x < n; x++)
+            for (int y = 0; y < n; y++)
+                for (int z = 0; z < n; z++)
+                {
+                    if (voxels[index(x, y, z)] != 0)
+                        continue;
+                    for (const glm::ivec3& offset : neighbors)
+                    {
+                        glm::ivec3 next = glm::ivec3(x, y, z) + offset;
+                        if (voxels[index(next.x, next.y, next.z)] == 1)
+                            voxels[index(x, y, z)] = 3;
+                    }
+                }
+
+        // start from the enclosed voxel nearest to the center
+        glm::ivec3 start(-1);
+        float nearest = std::numeric_limits<float>::max();
+        glm::vec3 center = glm::vec3((float)(n - 1) * 0.5f);
+        for (int x = 0; x < n; x++)
+            for (int y = 0; y < n; y++)
+                for (int z = 0; z < n; z++)
+                {
+                    glm::vec3 toCenter = glm::vec3((float)x, (float)y, (float)z) - center;
+                    if (voxels[index(x, y, z)] == 0 && glm::dot(toCenter, toCenter) < nearest)
+                    {
+                        nearest = glm::dot(toCenter, toCenter);
+                        start = glm::ivec3(x, y, z);
+                    }
+                }
+        if (start.x < 0)
+            return false;
+
+        // grow one face at a time, by a layer of voxels, while the whole layer is enclosed
+        glm::ivec3 low = start, high = start;
+        auto layerEnclosed = [&](glm::ivec3 from, glm::ivec3 to)
+        {
+            if (from.x < 0 || from.y < 0 || from.z < 0 || to.x >= n || to.y >= n || to.z >= n)
+                return false;
+            for (int x = from.x; x <= to.x; x++)
+                for (int y = from.y; y <= to.y; y++)
+                    for (int z = from.z; z <= to.z; z++)
+                        if (voxels[index(x, y, z)] != 0)
+                            return false;
+            return true;
+        };
+        for (bool grown = true; grown;)
+        {
+            grown = false;
+            for (int axis = 0; axis < 3; axis++)
+            {
+                glm::ivec3 from = low, to = high;
+                from[axis] = to[axis] = low[axis] - 1;
+                if (layerEnclosed(from, to))
+                {
+                    low[axis]--;
+                    grown = true;
+                }
+                from = low;
+                to = high;
+                from[axis] = to[axis] = high[axis] + 1;
+                if (layerEnclosed(from, to))
+                {
+                    high[axis]++;
+                    grown = true;
+                }
+            }
+        }
+        boxMin = boundsMin + glm::vec3(low) * voxelSize;
+        boxMax = boundsMin + glm::vec3(high + 1) * voxelSize;
+        return true;
+    }
+
+private:
+    int width, height, stride;
+    std::vector<float> depth;
+    glm::mat4 viewProjection;
+
+    // projects the 8 corners of a box to pixel coordinates, z stores the distance to the camera plane
+    // returns false if a corner is behind the camera
+    bool projectBox(const glm::mat4& model, const glm::vec3& boxMin, const glm::vec3& boxMax, glm::vec3* screen) const
+    {
+        glm::mat4 mvp = viewProjection * model;
+        for (int i = 0; i < 8; i++)
+        {
+            glm::vec4 corner((i & 1) ? boxMax.x : boxMin.x, (i & 2) ? boxMax.y : boxMin.y, (i & 4) ? boxMax.z : boxMin.z, 1.0f);
+            glm::vec4 clip = mvp * corner;
+            if (clip.w <= 1e-4f)
+                return false;
+            screen[i] = glm::vec3((clip.x / clip.w * 0.5f + 0.5f) * (float)width,
+                                  (clip.y / clip.w * 0.5f + 0.5f) * (float)height,
+                                  clip.w);
+        }
+        return true;
+    }
+
+    // half-space rasterization of the pixels the triangle covers completely, keeping the nearest occluder distance per
+    // pixel. An edge function at the pixel center is compared to its largest change within half a pixel, so a pixel
+    // is only written when its 4 corners are inside the triangle
+    void rasterizeTriangle(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2)
+    {
+        float area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+        if (area == 0.0f)
+            return;
+        // both windings are accepted, so the edge functions are flipped for clockwise triangles
+        float orientation = area > 0.0f ? 1.0f : -1.0f;
+        const glm::vec3* v[3] = {&v0, &v1, &v2};
+        float a[3], b[3], c[3];
+        for (int e = 0; e < 3; e++)
+        {
+            const glm::vec3& from = *v[(e + 1) % 3];
+            const glm::vec3& to = *v[(e + 2) % 3];
+            a[e] = -(to.y - from.y) * orientation;
+            b[e] = (to.x - from.x) * orientation;
+            c[e] = -(a[e] * from.x + b[e] * from.y) - 0.5f * (std::fabs(a[e]) + std::fabs(b[e]));
+        }
+        // conservative depth, the farthest point of the triangle
+        float z = std::max(v0.z, std::max(v1.z, v2.z));
+
+        // pixels whose whole square is inside the bounding rectangle of the triangle
+        int x0 = std::max(0, (int)std::ceil(std::min(v0.x, std::min(v1.x, v2.x))));
+        int x1 = std::min(width - 1, (int)std::floor(std::max(v0.x, std::max(v1.x, v2.x))) - 1);
+        int y0 = std::max(0, (int)std::ceil(std::min(v0.y, std::min(v1.y, v2.y))));
+        int y1 = std::min(height - 1, (int)std::floor(std::max(v0.y, std::max(v1.y, v2.y))) - 1);
+
+        for (int y = y0; y <= y1; y++)
+        {
+            float py = (float)y + 0.5f;
+            float row0 = b[0] * py + c[0], row1 = b[1] * py + c[1], row2 = b[2] * py + c[2];
+            float* row = &depth[y * stride];
+            for (int x = x0; x <= x1; x++)
+            {
+                float px = (float)x + 0.5f;
+                bool inside = (a[0] * px + row0 >= 0.0f) & (a[1] * px + row1 >= 0.0f) & (a[2] * px + row2 >= 0.0f);
+                row[x] = inside ? std::min(row[x], z) : row[x];
+            }
+        }
+    }
+};
+
+#endif
@@ -1,18 +1,34 @@
 #version 430 core
-layout (location = 0) in vec3 vertex;
-layout (location = 1) in vec3 normal;
+// packed vertex, see vertex_quantization.h
+layout (location = 0) in vec4 packedPosition; // xyz in [-1, 1] inside the bounding box of the mesh, w bitangent sign
+layout (location = 1) in vec2 packedNormal;   // octahedral
 layout (location = 2) in vec2 textCoord;
-layout (location = 3) in vec3 tangent;
+layout (location = 3) in vec2 packedTangent;  // octahedral
+layout (location = 5) in uint meshletInstance; // instance index, when drawing the meshlet lists made by meshlet_culling.glsl
 
 uniform mat4 model; // represents model coordinates in the world coord space
-uniform mat4 viewProjection;  // represents the view and projection matrices combined
+
+// camera, written once per frame, see uniform_blocks.h
+layout(std140) uniform ViewData
+{
+   mat4 view;
+   mat4 projection;
+   mat4 viewProjection; // represents the view and projection matrices combined
+   mat4 inverseProjection;
+   vec4 cameraPosition;
+};
 
 uniform vec4 reflectionColor;
+uniform vec3 positionOffset; // bounding box of the mesh, to decode the positions
+uniform vec3 positionScale;
+uniform bool useMeshletInstance;
+uniform int instanceOffset; // start of the instances of the LOD being drawn
 
 
 out vec4 worldPos;
 out vec3 worldNormal;
 out vec3 worldTangent;
+out float bitangentSign; // -1 where the texture coordinates are mirrored
 out vec2 textureCoordinates;
 out vec4 vertexColor;
 
@@ -29,7 +45,19 @@ layout(std430, binding = 0) buffer instanceData
 };
 
 
+vec3 decodeOctahedral(vec2 e)
+{
+   vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+   float t = max(-n.z, 0.0);
+   n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+   return normalize(n);
+}
+
 void main() {
+   vec3 vertex = positionOffset + packedPosition.xyz * positionScale;
+   vec3 normal = decodeOctahedral(packedNormal);
+   vec3 tangent = decodeOctahedral(packedTangent);
+
    // vertex in world space (for lighting computation)
    worldPos = model * vec4(vertex, 1.0);
 
@@ -39,14 +67,16 @@ void main() {
    // if there is a buffer, use it to find the model matrix and the color for this instance
    if (instances.length() > 0)
    {
-      worldPos = instances[gl_InstanceID].model * vec4(vertex, 1.0);
-      vertexColor = instances[gl_InstanceID].color;
+      uint instance = useMeshletInstance ? meshletInstance : uint(instanceOffset + gl_InstanceID);
+      worldPos = instances[instance].model * vec4(vertex, 1.0);
+      vertexColor = instances[instance].color;
    }
 
    // normal in world space (for lighting computation)
    worldNormal = (model * vec4(normal, 0.0)).xyz;
    // tangent in world space (for lighting computation)
    worldTangent = (model * vec4(tangent, 0.0)).xyz;
+   bitangentSign = packedPosition.w < 0.0 ? -1.0 : 1.0;
 
    textureCoordinates = textCoord;
 
@@ -18,7 +18,7 @@ layout(std430, binding = 1) buffer visibleInstanceData
    InstanceData visibles[];
 };
 
-layout(std430, binding = 2) buffer indirectData
+struct DrawCommand
 {
     uint count;
     uint instanceCount;
@@ -27,8 +27,35 @@ layout(std430, binding = 2) buffer indirectData
     uint baseInstance;
 };
 
+// 5 commands per mesh, one per LOD, all the meshes of a car use the same LOD. The visible instances of LOD i are stored
+// from visibles[i * instanceCapacity]
+layout(std430, binding = 2) buffer indirectData
+{
+    DrawCommand commands[];
+};
+
 uniform float cullingRadius;
 uniform vec3 frustumPlanes[12];
+uniform vec3 cameraPosition;
+uniform uint instanceCapacity;
+uniform uint meshCount;
+
+// level of detail, the same selection as Mesh::SelectLod
+uniform uint lodCount;
+uniform float lodErrors[5];
+uniform vec4 lodSphere;
+uniform float lodFactor;
+
+uint selectLod(mat4 model, vec3 cameraPosition)
+{
+    float scale = length(model[0].xyz);
+    vec3 center = (model * vec4(lodSphere.xyz, 1.0)).xyz;
+    float distance = max(length(center - cameraPosition) - lodSphere.w * scale, 0.0);
+    uint lod = 0;
+    while (lod + 1 < lodCount && lodErrors[lod + 1] * scale * lodFactor <= distance)
+        lod++;
+    return lod;
+}
 
 void main()
 {
@@ -49,8 +76,11 @@ void main()
 
         if (isVisible)
         {
-            uint index = atomicAdd(instanceCount, 1);
-            visibles[index] = instances[gl_GlobalInvocationID.x];
+            uint lod = selectLod(instances[gl_GlobalInvocationID.x].model, cameraPosition);
+            uint index = atomicAdd(commands[lod].instanceCount, 1);
+            for (uint mesh = 1; mesh < meshCount; mesh++)
+                atomicAdd(commands[mesh * 5 + lod].instanceCount, 1);
+            visibles[lod * instanceCapacity + index] = instances[gl_GlobalInvocationID.x];
         }
     }
 }
\ No newline at end of file
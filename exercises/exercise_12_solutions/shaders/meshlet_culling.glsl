@@ -0,0 +1,122 @@
+#version 430 core
+
+// one invocation per instance (x) and meshlet (y). The meshlets of all the LODs are tested, and only the ones of the
+// LOD selected for the instance are kept. Each visible pair adds the instance to the list of the meshlet, and
+// increments the instance count of the draw command of the meshlet. The draw commands read the list through an
+// instanced vertex attribute, so baseInstance selects the list of each meshlet
+layout(local_size_x = 64) in;
+
+struct InstanceData
+{
+   mat4 model;
+   vec4 color;
+};
+
+struct Meshlet
+{
+   vec4 boundingSphere;
+   vec4 coneApex;
+   vec4 coneAxisCutoff;
+   uint firstIndex;
+   uint indexCount;
+   uint vertexCount;
+   uint lod;
+};
+
+struct DrawCommand
+{
+   uint count;
+   uint instanceCount;
+   uint firstIndex;
+   int  baseVertex;
+   uint baseInstance;
+};
+
+layout(std430, binding = 0) readonly buffer sourceInstanceData
+{
+   InstanceData instances[];
+};
+
+layout(std430, binding = 1) readonly buffer meshletData
+{
+   Meshlet meshlets[];
+};
+
+layout(std430, binding = 2) buffer drawCommandData
+{
+   DrawCommand commands[];
+};
+
+layout(std430, binding = 3) writeonly buffer meshletInstanceData
+{
+   uint meshletInstances[];
+};
+
+uniform uint instanceCount;
+uniform uint instanceCapacity;
+uniform float cullingRadius;
+uniform vec3 frustumPlanes[12];
+uniform bool frustumCulling; // the "Frustum Culling" option, when false only the LOD and the normal cones cull
+uniform vec3 cameraPosition;
+
+// level of detail, the same selection as Mesh::SelectLod
+uniform uint lodCount;
+uniform float lodErrors[5];
+uniform vec4 lodSphere;
+uniform float lodFactor;
+uniform uint meshLodCount; // LODs of the mesh of the meshlets, the car LOD is clamped to them
+
+uint selectLod(mat4 model, vec3 cameraPosition)
+{
+    float scale = length(model[0].xyz);
+    vec3 center = (model * vec4(lodSphere.xyz, 1.0)).xyz;
+    float distance = max(length(center - cameraPosition) - lodSphere.w * scale, 0.0);
+    uint lod = 0;
+    while (lod + 1 < lodCount && lodErrors[lod + 1] * scale * lodFactor <= distance)
+        lod++;
+    return lod;
+}
+
+bool isSphereVisible(vec3 center, float radius)
+{
+    if (!frustumCulling)
+        return true;
+    for(int i = 0; i < 6; ++i)
+    {
+        if (dot(center - frustumPlanes[i * 2], frustumPlanes[i * 2 + 1]) <= -radius)
+            return false;
+    }
+    return true;
+}
+
+void main()
+{
+    uint instance = gl_GlobalInvocationID.x;
+    uint meshlet = gl_GlobalInvocationID.y;
+    if (instance >= instanceCount)
+        return;
+
+    mat4 model = instances[instance].model;
+
+    // whole instance first, it is the same test as in culling.glsl
+    if (!isSphereVisible(model[3].xyz, cullingRadius))
+        return;
+
+    if (meshlets[meshlet].lod != min(selectLod(model, cameraPosition), meshLodCount - 1))
+        return;
+
+    // meshlet bounding sphere
+    float scale = length(model[0].xyz);
+    vec3 center = (model * vec4(meshlets[meshlet].boundingSphere.xyz, 1.0)).xyz;
+    if (!isSphereVisible(center, meshlets[meshlet].boundingSphere.w * scale))
+        return;
+
+    // normal cone, all the triangles face away from the camera
+    vec3 apex = (model * vec4(meshlets[meshlet].coneApex.xyz, 1.0)).xyz;
+    vec3 axis = normalize((model * vec4(meshlets[meshlet].coneAxisCutoff.xyz, 0.0)).xyz);
+    if (dot(normalize(apex - cameraPosition), axis) >= meshlets[meshlet].coneAxisCutoff.w)
+        return;
+
+    uint index = atomicAdd(commands[meshlet].instanceCount, 1);
+    meshletInstances[meshlet * instanceCapacity + index] = instance;
+}
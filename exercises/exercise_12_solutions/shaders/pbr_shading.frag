@@ -1,13 +1,47 @@
 #version 430 core
 
-uniform vec3 camPosition; // so we can compute the view vector
 out vec4 FragColor; // the output color of this fragment
 
-// light uniform variables
-uniform vec4 ambientLightColor;
-uniform vec3 lightPosition;
-uniform vec3 lightColor;
-uniform float lightRadius;
+// frame, camera and lights, written once per frame, see uniform_blocks.h
+layout(std140) uniform FrameData
+{
+   float time;
+   float deltaTime;
+   float exposure;
+};
+
+layout(std140) uniform ViewData
+{
+   mat4 view;
+   mat4 projection;
+   mat4 viewProjection;
+   mat4 inverseProjection;
+   vec4 cameraPosition; // so we can compute the view vector
+};
+
+const int MAX_BLOCK_LIGHTS = 16;
+
+struct BlockLight
+{
+   vec4 position; // xyz position or direction, w radius (0 for directional lights)
+   vec4 color;
+};
+
+layout(std140) uniform LightData
+{
+   vec4 ambientLightColor;
+   BlockLight lights[MAX_BLOCK_LIGHTS];
+   int lightCount;
+};
+
+// light of the current pass, the ambient and reflections are only added by the pass of the first light
+uniform int lightIndex;
+
+// light uniform variables, read from the light of the pass
+vec3 lightPosition;
+vec3 lightColor;
+float lightRadius;
+float ambientAmount;
 
 // material properties
 uniform float roughness;
@@ -24,6 +58,7 @@ uniform samplerCube skybox;
 in vec4 worldPos;
 in vec3 worldNormal;
 in vec3 worldTangent;
+in float bitangentSign;
 in vec2 textureCoordinates;
 in vec4 vertexColor;
 
@@ -96,18 +131,21 @@ vec3 GetNormalMap()
 {
    //NEW! Normal map
 
-   // Sample normal map
-   vec3 normalMap = texture(texture_normal1, textureCoordinates).rgb;
+   // Sample normal map, only X and Y: the baked normal maps are compressed with two channels
+   vec3 normalMap;
+   normalMap.xy = texture(texture_normal1, textureCoordinates).rg;
    // Unpack from range [0, 1] to [-1 , 1]
-   normalMap = normalMap * 2.0 - 1.0;
+   normalMap.xy = normalMap.xy * 2.0 - 1.0;
 
-   // This time we are storing Z component in the texture, no need to compute it. Instead we normalize just in case
+   // Z is positive in tangent space, we compute it from the length of the normal
+   normalMap.z = sqrt(max(1.0 - dot(normalMap.xy, normalMap.xy), 0.0));
    normalMap = normalize(normalMap);
 
    // Create tangent space matrix
    vec3 N = normalize(worldNormal);
    vec3 B = normalize(cross(worldTangent, N)); // Orthogonal to both N and T
    vec3 T = cross(N, B); // Orthogonal to both N and B. Since N and B are normalized and orthogonal, T is already normalized
+   B *= bitangentSign; // mirrored texture coordinates flip the bitangent, not the tangent
    mat3 TBN = mat3(T, B, N);
 
    // Transform normal map from tangent space to world space
@@ -121,7 +159,7 @@ vec3 GetAmbientLighting(vec3 albedo, vec3 normal)
    ambient *= albedo / PI;
 
    // Only apply ambient during the first light pass
-   ambient *= ambientLightColor.a; 
+   ambient *= ambientAmount;
 
    float ambientOcclusion = texture(texture_ambient1, textureCoordinates).r;
    ambient *= ambientOcclusion;
@@ -140,7 +178,7 @@ vec3 GetEnvironmentLighting(vec3 N, vec3 V)
 
    // We packed the amount of reflection in ambientLightColor.a
    // Only apply reflection (and ambient) during the first light pass
-   reflection *= ambientLightColor.a; 
+   reflection *= ambientAmount;
 
    return reflection;
 }
@@ -166,6 +204,11 @@ float GetAttenuation(vec4 P)
 
 void main()
 {
+   lightPosition = lights[lightIndex].position.xyz;
+   lightColor = lights[lightIndex].color.rgb;
+   lightRadius = lights[lightIndex].position.w;
+   ambientAmount = lightIndex == 0 ? ambientLightColor.a : 0.0f;
+
    vec4 P = worldPos;
 
    vec3 N = GetNormalMap();
@@ -176,7 +219,7 @@ void main()
    bool positional = lightRadius > 0;
 
    vec3 L = normalize(lightPosition - (positional ? P.xyz : vec3(0.0f)));
-   vec3 V = normalize(camPosition - P.xyz);
+   vec3 V = normalize(cameraPosition.xyz - P.xyz);
 
    vec3 ambient = GetAmbientLighting(albedo, N);
    vec3 environment = GetEnvironmentLighting(N, V);
@@ -215,5 +258,5 @@ void main()
    // lighting = indirect lighting (ambient + environment) + direct lighting (diffuse + specular)
    vec3 lighting = indirectLight + directLight;
 
-   FragColor = vec4(lighting, 1.0f);
+   FragColor = vec4(lighting * exposure, 1.0f);
 }
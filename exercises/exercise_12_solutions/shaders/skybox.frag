@@ -5,7 +5,15 @@ in vec3 TexCoords;
 
 uniform samplerCube skybox;
 
+layout(std140) uniform FrameData
+{
+   float time;
+   float deltaTime;
+   float exposure;
+};
+
 void main()
 {
    FragColor = texture(skybox, TexCoords);
+   FragColor.rgb *= exposure;
 }
\ No newline at end of file
@@ -3,8 +3,15 @@ layout (location = 0) in vec3 vertex;
 
 out vec3 TexCoords;
 
-uniform mat4 projection;
-uniform mat4 view;
+// camera, written once per frame, see uniform_blocks.h
+layout(std140) uniform ViewData
+{
+   mat4 view;
+   mat4 projection;
+   mat4 viewProjection;
+   mat4 inverseProjection;
+   vec4 cameraPosition;
+};
 
 void main()
 {
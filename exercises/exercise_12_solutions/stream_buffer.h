@@ -0,0 +1,192 @@
+#ifndef STREAM_BUFFER_H
+#define STREAM_BUFFER_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+// buffer storage is core since OpenGL 4.4, the loader may not declare glBufferStorage or define its flags. Without the
+// function the buffer is always written with glBufferSubData
+#if defined(GL_VERSION_4_4) || defined(GL_ARB_buffer_storage)
+#define STREAM_BUFFER_HAS_STORAGE
+#endif
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+// a part of a buffer, as bound with glBindBufferRange
+struct BufferRange
+{
+    GLuint buffer = 0;
+    GLintptr offset = 0;
+    GLsizeiptr size = 0;
+};
+
+// Ring buffer for the data that is written every frame: instance data, indirect draw commands and uniform blocks.
+// The buffer is split in STREAM_FRAMES parts, one for each frame in flight. A frame writes its data in its part with a
+// plain memcpy, through a pointer that stays mapped for the life of the buffer (glBufferStorage with
+// GL_MAP_PERSISTENT_BIT and GL_MAP_COHERENT_BIT, so there is nothing to flush). A fence is inserted at the end of the
+// frame, and the part is only written again, STREAM_FRAMES frames later, once the GPU has passed that fence.
+// Without buffer storage (before OpenGL 4.4 and no GL_ARB_buffer_storage, in the context or in the loader) the data is
+// written to a copy on the CPU, and Flush copies what was written since the previous Flush with glBufferSubData. The
+// buffer is never reallocated.
+class StreamBuffer
+{
+public:
+    static const unsigned int STREAM_FRAMES = 3;
+
+    StreamBuffer() = default;
+    StreamBuffer(const StreamBuffer&) = delete;
+    StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+    ~StreamBuffer()
+    {
+        for (GLsync &fence : fences)
+            if (fence)
+                glDeleteSync(fence);
+        if (buffer != 0)
+        {
+            if (persistent)
+            {
+                glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+                glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+                glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            }
+            glDeleteBuffers(1, &buffer);
+        }
+    }
+
+    // frameSize is the space of each frame. Render thread only, with a current context
+    void Create(GLsizeiptr frameSize)
+    {
+        GLint uniformAlignment = 0, storageAlignment = 0;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformAlignment);
+        glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &storageAlignment);
+        // every allocation can be bound as any kind of buffer
+        alignment = std::max<GLsizeiptr>(16, std::max(uniformAlignment, storageAlignment));
+        this->frameSize = (frameSize + alignment - 1) / alignment * alignment;
+        GLsizeiptr size = this->frameSize * STREAM_FRAMES;
+
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        persistent = hasBufferStorage();
+#ifdef STREAM_BUFFER_HAS_STORAGE
+        if (persistent)
+        {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_COPY_WRITE_BUFFER, size, nullptr, flags);
+            mapped = (char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, flags);
+        }
+        else
+#endif
+        {
+            glBufferData(GL_COPY_WRITE_BUFFER, size, nullptr, GL_STREAM_DRAW);
+            staging.resize((size_t)size);
+            mapped = staging.data();
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    GLuint ID() const { return buffer; }
+
+    // waits until the GPU is done with the part of the frame, the allocations of the frame are taken from it
+    void BeginFrame()
+    {
+        frame = (frame + 1) % STREAM_FRAMES;
+        GLsync &fence = fences[frame];
+        if (fence)
+        {
+            // in most frames the fence was passed long ago, and this returns right away
+            GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+            while (glClientWaitSync(fence, flags, 1000000) == GL_TIMEOUT_EXPIRED)
+                flags = 0;
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+        head = flushed = frame * frameSize;
+    }
+
+    // after the last command that reads the data of the frame
+    void EndFrame()
+    {
+        Flush();
+        fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    // space for size bytes in the part of the frame, or a null pointer if the part is full. The range can be bound
+    // as uniform, shader storage or indirect buffer
+    void* Allocate(GLsizeiptr size, BufferRange &range)
+    {
+        GLintptr end = (frame + 1) * frameSize;
+        if (head + size > end)
+        {
+            std::cout << "ERROR::STREAM_BUFFER::OUT_OF_SPACE for " << size << " bytes, the frame has "
+                      << frameSize << std::endl;
+            return nullptr;
+        }
+        range.buffer = buffer;
+        range.offset = head;
+        range.size = size;
+        void* data = mapped + head;
+        head = std::min<GLintptr>(end, head + (size + alignment - 1) / alignment * alignment);
+        return data;
+    }
+
+    // allocates and copies the data, the range is empty if there was no space
+    BufferRange Write(const void* data, GLsizeiptr size)
+    {
+        BufferRange range;
+        void* destination = Allocate(size, range);
+        if (destination)
+            std::memcpy(destination, data, (size_t)size);
+        return range;
+    }
+
+    // makes the data written so far visible to the GPU, before the commands that read it. Does nothing when the
+    // buffer is persistently mapped
+    void Flush()
+    {
+        if (!persistent && head > flushed)
+        {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+            glBufferSubData(GL_COPY_WRITE_BUFFER, flushed, head - flushed, staging.data() + flushed);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        }
+        flushed = head;
+    }
+
+private:
+    GLuint buffer = 0;
+    char* mapped = nullptr;
+    bool persistent = false;
+    std::vector<char> staging; // copy of the buffer on the CPU, without buffer storage
+    GLsizeiptr frameSize = 0;
+    GLsizeiptr alignment = 16;
+    unsigned int frame = 0;
+    GLintptr head = 0, flushed = 0;
+    GLsync fences[STREAM_FRAMES] = {};
+
+    static bool hasBufferStorage()
+    {
+#ifdef STREAM_BUFFER_HAS_STORAGE
+        GLint major = 0, minor = 0, extensionCount = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        if (major > 4 || (major == 4 && minor >= 4))
+            return true;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+        for (GLint i = 0; i < extensionCount; i++)
+            if (std::strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), "GL_ARB_buffer_storage") == 0)
+                return true;
+#endif
+        return false;
+    }
+};
+
+#endif
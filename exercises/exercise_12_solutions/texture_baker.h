@@ -0,0 +1,824 @@
+#ifndef TEXTURE_BAKER_H
+#define TEXTURE_BAKER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// S3TC is an extension, and BPTC is only core since OpenGL 4.2, the loader may not define them
+#ifndef GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT 0x8C4C
+#endif
+#ifndef GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+#endif
+#ifndef GL_COMPRESSED_RG_RGTC2
+#define GL_COMPRESSED_RG_RGTC2 0x8DBD
+#endif
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+#endif
+
+// Texture baking.
+// The images are decoded once, their mip chain is generated on the CPU and every level is block compressed. The
+// result is saved next to the image as "<image>.<usage>.baked", and the next runs map that file and upload it with
+// glCompressedTexImage2D, without decoding or compressing anything. A baked file is used while it is newer than its
+// image, and while its usage and format are the ones the image would be baked with.
+//
+// The format depends on what the texture is used for:
+// - diffuse: BC1 in sRGB, or BC3 if the image has transparency. The mips are averaged in linear space
+// - normal: BC5, x and y with 8 bits of precision each. The shader computes z, and the mips are renormalized
+// - specular and ambient: BC7, with the single subset RGBA mode
+
+enum class TextureUsage
+{
+    DIFFUSE,
+    NORMAL,
+    SPECULAR,
+    AMBIENT
+};
+
+// the part of the baked file name for the usage, an image used in two ways has two baked files
+inline const char* textureUsageName(TextureUsage usage)
+{
+    switch (usage)
+    {
+    case TextureUsage::NORMAL: return "normal";
+    case TextureUsage::SPECULAR: return "specular";
+    case TextureUsage::AMBIENT: return "ambient";
+    default: return "diffuse";
+    }
+}
+
+enum class BlockFormat : uint32_t
+{
+    BC1_SRGB,
+    BC3_SRGB,
+    BC5,
+    BC7
+};
+
+// bit of the format in the masks of supportedBlockFormats
+inline unsigned int blockFormatBit(BlockFormat format)
+{
+    return 1u << (unsigned int)format;
+}
+
+inline unsigned int blockSize(BlockFormat format)
+{
+    return format == BlockFormat::BC1_SRGB ? 8 : 16;
+}
+
+inline GLenum blockFormatGL(BlockFormat format)
+{
+    switch (format)
+    {
+        case BlockFormat::BC1_SRGB: return GL_COMPRESSED_SRGB_S3TC_DXT1_EXT;
+        case BlockFormat::BC3_SRGB: return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT;
+        case BlockFormat::BC5: return GL_COMPRESSED_RG_RGTC2;
+        default: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+    }
+}
+
+// the formats the context can upload, to be called on the render thread
+inline unsigned int supportedBlockFormats()
+{
+    GLint major = 0, minor = 0, extensionCount = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+    bool s3tc = false, s3tcSrgb = false, bptc = major > 4 || (major == 4 && minor >= 2);
+    for (GLint i = 0; i < extensionCount; i++)
+    {
+        const char* name = (const char*)glGetStringi(GL_EXTENSIONS, i);
+        if (std::strcmp(name, "GL_EXT_texture_compression_s3tc") == 0)
+            s3tc = true;
+        else if (std::strcmp(name, "GL_EXT_texture_sRGB") == 0 || std::strcmp(name, "GL_EXT_texture_compression_s3tc_srgb") == 0)
+            s3tcSrgb = true;
+        else if (std::strcmp(name, "GL_ARB_texture_compression_bptc") == 0)
+            bptc = true;
+    }
+    unsigned int formats = blockFormatBit(BlockFormat::BC5); // RGTC is core since OpenGL 3.0
+    if (s3tc && s3tcSrgb)
+        formats |= blockFormatBit(BlockFormat::BC1_SRGB) | blockFormatBit(BlockFormat::BC3_SRGB);
+    if (bptc)
+        formats |= blockFormatBit(BlockFormat::BC7);
+    return formats;
+}
+
+// the format for a decoded image with the given use
+inline BlockFormat chooseBlockFormat(TextureUsage usage, const unsigned char *pixels, int width, int height, int components)
+{
+    if (usage == TextureUsage::NORMAL)
+        return BlockFormat::BC5;
+    if (usage != TextureUsage::DIFFUSE)
+        return BlockFormat::BC7;
+    if (components == 2 || components == 4)
+    {
+        for (int i = 0; i < width * height; i++)
+        {
+            if (pixels[i * components + components - 1] != 255)
+                return BlockFormat::BC3_SRGB;
+        }
+    }
+    return BlockFormat::BC1_SRGB;
+}
+
+// true if chooseBlockFormat can pick the format for the usage, whatever the pixels are
+inline bool isBlockFormatFor(TextureUsage usage, BlockFormat format)
+{
+    if (usage == TextureUsage::NORMAL)
+        return format == BlockFormat::BC5;
+    if (usage != TextureUsage::DIFFUSE)
+        return format == BlockFormat::BC7;
+    return format == BlockFormat::BC1_SRGB || format == BlockFormat::BC3_SRGB;
+}
+
+
+// -------------------------------------------------------------------------------------------------------------------
+// block encoders, the blocks have 4x4 RGBA pixels in rows
+
+// BC1 color endpoints, 5:6:5 bits
+inline uint16_t packRgb565(glm::vec3 color)
+{
+    int r = glm::clamp((int)std::lround(color.r * (31.0f / 255.0f)), 0, 31);
+    int g = glm::clamp((int)std::lround(color.g * (63.0f / 255.0f)), 0, 63);
+    int b = glm::clamp((int)std::lround(color.b * (31.0f / 255.0f)), 0, 31);
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+inline glm::vec3 unpackRgb565(uint16_t packed)
+{
+    int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+    return glm::vec3((r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2));
+}
+
+// the dominant direction of a set of points, with a few iterations of the power method on their covariance
+template<typename Vector, typename Matrix>
+Vector principalAxis(const Vector *points, int count, Vector mean)
+{
+    Matrix covariance(0.0f);
+    for (int i = 0; i < count; i++)
+    {
+        Vector d = points[i] - mean;
+        for (int column = 0; column < Vector::length(); column++)
+            covariance[column] += d * d[column];
+    }
+    // start from the channel that varies the most
+    int widest = 0;
+    for (int column = 1; column < Vector::length(); column++)
+    {
+        if (covariance[column][column] > covariance[widest][widest])
+            widest = column;
+    }
+    Vector axis = covariance[widest];
+    for (int iteration = 0; iteration < 8; iteration++)
+    {
+        axis = covariance * axis;
+        float length = glm::length(axis);
+        if (length < 1e-6f)
+            return Vector(0.0f);
+        axis /= length;
+    }
+    return axis;
+}
+
+// fits two endpoints to the points with indices, given the weight of the second endpoint in each point. Returns false
+// if all the weights are the same
+template<typename Vector>
+bool fitEndpoints(const Vector *points, const float *weights, int count, Vector &endpoint0, Vector &endpoint1)
+{
+    // least squares of (1 - w) * e0 + w * e1 = p
+    float a = 0.0f, b = 0.0f, c = 0.0f;
+    Vector x(0.0f), y(0.0f);
+    for (int i = 0; i < count; i++)
+    {
+        float w = weights[i];
+        a += (1.0f - w) * (1.0f - w);
+        b += (1.0f - w) * w;
+        c += w * w;
+        x += points[i] * (1.0f - w);
+        y += points[i] * w;
+    }
+    float determinant = a * c - b * b;
+    if (std::fabs(determinant) < 1e-6f)
+        return false;
+    endpoint0 = glm::clamp((x * c - y * b) / determinant, Vector(0.0f), Vector(255.0f));
+    endpoint1 = glm::clamp((y * a - x * b) / determinant, Vector(0.0f), Vector(255.0f));
+    return true;
+}
+
+// BC1 color block, always with 4 colors (BC3 can't use the 3 color mode). Returns the squared error
+inline float encodeColorBlock(const uint8_t pixels[16][4], uint8_t *out)
+{
+    glm::vec3 points[16], mean(0.0f);
+    for (int i = 0; i < 16; i++)
+    {
+        points[i] = glm::vec3(pixels[i][0], pixels[i][1], pixels[i][2]);
+        mean += points[i] / 16.0f;
+    }
+    glm::vec3 axis = principalAxis<glm::vec3, glm::mat3>(points, 16, mean);
+    float minT = 0.0f, maxT = 0.0f;
+    for (int i = 0; i < 16; i++)
+    {
+        float t = glm::dot(points[i] - mean, axis);
+        minT = std::min(minT, t);
+        maxT = std::max(maxT, t);
+    }
+    glm::vec3 endpoint0 = glm::clamp(mean + axis * maxT, glm::vec3(0.0f), glm::vec3(255.0f));
+    glm::vec3 endpoint1 = glm::clamp(mean + axis * minT, glm::vec3(0.0f), glm::vec3(255.0f));
+
+    static const float weights[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+    float bestError = -1.0f;
+    for (int iteration = 0; iteration < 3; iteration++)
+    {
+        uint16_t color0 = packRgb565(endpoint0), color1 = packRgb565(endpoint1);
+        if (color0 < color1)
+            std::swap(color0, color1);
+        glm::vec3 palette[4];
+        palette[0] = unpackRgb565(color0);
+        palette[1] = unpackRgb565(color1);
+        palette[2] = (palette[0] * 2.0f + palette[1]) / 3.0f;
+        palette[3] = (palette[0] + palette[1] * 2.0f) / 3.0f;
+
+        uint32_t indices = 0;
+        float error = 0.0f, pointWeights[16];
+        for (int i = 0; i < 16; i++)
+        {
+            int best = 0;
+            float bestDistance = glm::dot(points[i] - palette[0], points[i] - palette[0]);
+            for (int j = 1; j < (color0 == color1 ? 1 : 4); j++)
+            {
+                float distance = glm::dot(points[i] - palette[j], points[i] - palette[j]);
+                if (distance < bestDistance)
+                {
+                    bestDistance = distance;
+                    best = j;
+                }
+            }
+            indices |= (uint32_t)best << (i * 2);
+            error += bestDistance;
+            pointWeights[i] = weights[best];
+        }
+        if (bestError < 0.0f || error < bestError)
+        {
+            bestError = error;
+            std::memcpy(out, &color0, 2);
+            std::memcpy(out + 2, &color1, 2);
+            std::memcpy(out + 4, &indices, 4);
+        }
+        if (!fitEndpoints(points, pointWeights, 16, endpoint0, endpoint1))
+            break;
+    }
+    return bestError;
+}
+
+// BC4 block, one channel with 8 interpolated values. Used for the alpha of BC3, and for each channel of BC5
+inline void encodeChannelBlock(const uint8_t values[16], uint8_t *out)
+{
+    uint8_t minValue = 255, maxValue = 0;
+    for (int i = 0; i < 16; i++)
+    {
+        minValue = std::min(minValue, values[i]);
+        maxValue = std::max(maxValue, values[i]);
+    }
+    out[0] = maxValue;
+    out[1] = minValue;
+    uint64_t indices = 0;
+    if (maxValue != minValue)
+    {
+        int palette[8] = { maxValue, minValue };
+        for (int j = 2; j < 8; j++)
+            palette[j] = ((8 - j) * maxValue + (j - 1) * minValue) / 7;
+        for (int i = 0; i < 16; i++)
+        {
+            int best = 0;
+            for (int j = 1; j < 8; j++)
+            {
+                if (std::abs(palette[j] - values[i]) < std::abs(palette[best] - values[i]))
+                    best = j;
+            }
+            indices |= (uint64_t)best << (i * 3);
+        }
+    }
+    for (int i = 0; i < 6; i++)
+        out[2 + i] = (uint8_t)(indices >> (i * 8));
+}
+
+// writes the fields of a BC7 block, from the lowest bit
+struct BlockBitWriter
+{
+    uint8_t *out;
+    int position = 0;
+
+    explicit BlockBitWriter(uint8_t *out) : out(out)
+    {
+        std::memset(out, 0, 16);
+    }
+
+    void Write(uint32_t value, int bits)
+    {
+        for (int i = 0; i < bits; i++, position++)
+            out[position / 8] |= (uint8_t)(((value >> i) & 1) << (position % 8));
+    }
+};
+
+// BC7 block in mode 6: one subset, RGBA endpoints of 7 bits plus a shared lowest bit per endpoint, and 16 weights
+inline float encodeBC7Block(const uint8_t pixels[16][4], uint8_t *out)
+{
+    static const int weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+    glm::vec4 points[16], mean(0.0f);
+    for (int i = 0; i < 16; i++)
+    {
+        points[i] = glm::vec4(pixels[i][0], pixels[i][1], pixels[i][2], pixels[i][3]);
+        mean += points[i] / 16.0f;
+    }
+    glm::vec4 axis = principalAxis<glm::vec4, glm::mat4>(points, 16, mean);
+    float minT = 0.0f, maxT = 0.0f;
+    for (int i = 0; i < 16; i++)
+    {
+        float t = glm::dot(points[i] - mean, axis);
+        minT = std::min(minT, t);
+        maxT = std::max(maxT, t);
+    }
+    glm::vec4 endpoints[2] = {
+        glm::clamp(mean + axis * minT, glm::vec4(0.0f), glm::vec4(255.0f)),
+        glm::clamp(mean + axis * maxT, glm::vec4(0.0f), glm::vec4(255.0f))
+    };
+
+    float bestError = -1.0f;
+    int bestQuantized[2][4] = {}, bestPBits[2] = {}, bestIndices[16] = {};
+    for (int iteration = 0; iteration < 3; iteration++)
+    {
+        // the 4 combinations of the lowest bits
+        float iterationBest = -1.0f;
+        int iterationIndices[16];
+        for (int pBits = 0; pBits < 4; pBits++)
+        {
+            int quantized[2][4], palette[16][4];
+            for (int e = 0; e < 2; e++)
+            {
+                int p = (pBits >> e) & 1;
+                for (int c = 0; c < 4; c++)
+                    quantized[e][c] = glm::clamp((int)std::lround((endpoints[e][c] - p) * 0.5f), 0, 127);
+            }
+            for (int j = 0; j < 16; j++)
+            {
+                for (int c = 0; c < 4; c++)
+                {
+                    int e0 = quantized[0][c] * 2 + (pBits & 1), e1 = quantized[1][c] * 2 + (pBits >> 1);
+                    palette[j][c] = ((64 - weights[j]) * e0 + weights[j] * e1 + 32) >> 6;
+                }
+            }
+            float error = 0.0f;
+            int indices[16];
+            for (int i = 0; i < 16; i++)
+            {
+                int bestDistance = -1;
+                for (int j = 0; j < 16; j++)
+                {
+                    int distance = 0;
+                    for (int c = 0; c < 4; c++)
+                    {
+                        int d = palette[j][c] - pixels[i][c];
+                        distance += d * d;
+                    }
+                    if (bestDistance < 0 || distance < bestDistance)
+                    {
+                        bestDistance = distance;
+                        indices[i] = j;
+                    }
+                }
+                error += (float)bestDistance;
+            }
+            if (iterationBest < 0.0f || error < iterationBest)
+            {
+                iterationBest = error;
+                std::memcpy(iterationIndices, indices, sizeof(indices));
+            }
+            if (bestError < 0.0f || error < bestError)
+            {
+                bestError = error;
+                std::memcpy(bestQuantized, quantized, sizeof(quantized));
+                bestPBits[0] = pBits & 1;
+                bestPBits[1] = pBits >> 1;
+                std::memcpy(bestIndices, indices, sizeof(indices));
+            }
+        }
+        float pointWeights[16];
+        for (int i = 0; i < 16; i++)
+            pointWeights[i] = weights[iterationIndices[i]] / 64.0f;
+        if (!fitEndpoints(points, pointWeights, 16, endpoints[0], endpoints[1]))
+            break;
+    }
+
+    // the highest bit of the first index is not stored, it has to be 0
+    if (bestIndices[0] >= 8)
+    {
+        std::swap(bestQuantized[0], bestQuantized[1]);
+        std::swap(bestPBits[0], bestPBits[1]);
+        for (int i = 0; i < 16; i++)
+            bestIndices[i] = 15 - bestIndices[i];
+    }
+
+    BlockBitWriter writer(out);
+    writer.Write(1 << 6, 7); // mode 6
+    for (int c = 0; c < 4; c++)
+    {
+        writer.Write(bestQuantized[0][c], 7);
+        writer.Write(bestQuantized[1][c], 7);
+    }
+    writer.Write(bestPBits[0], 1);
+    writer.Write(bestPBits[1], 1);
+    writer.Write(bestIndices[0], 3);
+    for (int i = 1; i < 16; i++)
+        writer.Write(bestIndices[i], 4);
+    return bestError;
+}
+
+inline void encodeBlock(BlockFormat format, const uint8_t pixels[16][4], uint8_t *out)
+{
+    uint8_t channel[16];
+    switch (format)
+    {
+        case BlockFormat::BC1_SRGB:
+            encodeColorBlock(pixels, out);
+            break;
+        case BlockFormat::BC3_SRGB:
+            for (int i = 0; i < 16; i++)
+                channel[i] = pixels[i][3];
+            encodeChannelBlock(channel, out);
+            encodeColorBlock(pixels, out + 8);
+            break;
+        case BlockFormat::BC5:
+            for (int c = 0; c < 2; c++)
+            {
+                for (int i = 0; i < 16; i++)
+                    channel[i] = pixels[i][c];
+                encodeChannelBlock(channel, out + c * 8);
+            }
+            break;
+        case BlockFormat::BC7:
+            encodeBC7Block(pixels, out);
+            break;
+    }
+}
+
+
+// -------------------------------------------------------------------------------------------------------------------
+// mip chain
+
+inline float srgbToLinear(float value)
+{
+    return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+}
+
+inline float linearToSrgb(float value)
+{
+    return value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+}
+
+// one level of the mip chain, in floats. Colors are linear, normals are unit vectors
+struct MipLevel
+{
+    int width, height;
+    std::vector<glm::vec4> pixels;
+};
+
+inline MipLevel imageToMipLevel(const unsigned char *data, int width, int height, int components, TextureUsage usage)
+{
+    MipLevel level = { width, height, std::vector<glm::vec4>((size_t)width * height) };
+    for (size_t i = 0; i < level.pixels.size(); i++)
+    {
+        const unsigned char *pixel = data + i * components;
+        glm::vec4 value;
+        if (components <= 2)
+            value = glm::vec4(pixel[0], pixel[0], pixel[0], components == 2 ? pixel[1] : 255);
+        else
+            value = glm::vec4(pixel[0], pixel[1], pixel[2], components == 4 ? pixel[3] : 255);
+        value /= 255.0f;
+        if (usage == TextureUsage::DIFFUSE)
+            value = glm::vec4(srgbToLinear(value.r), srgbToLinear(value.g), srgbToLinear(value.b), value.a);
+        else if (usage == TextureUsage::NORMAL)
+            value = glm::vec4(glm::normalize(glm::vec3(value) * 2.0f - 1.0f), 1.0f);
+        level.pixels[i] = value;
+    }
+    return level;
+}
+
+// the next level, each pixel is the average of 2x2 pixels. With odd sizes, the last pixel of the next level also
+// averages the last row or column
+inline MipLevel downsample(const MipLevel &level, TextureUsage usage)
+{
+    MipLevel next = { std::max(level.width / 2, 1), std::max(level.height / 2, 1), {} };
+    next.pixels.resize((size_t)next.width * next.height);
+    for (int y = 0; y < next.height; y++)
+    {
+        int y0 = y * 2, y1 = y == next.height - 1 ? level.height : std::min(y * 2 + 2, level.height);
+        for (int x = 0; x < next.width; x++)
+        {
+            int x0 = x * 2, x1 = x == next.width - 1 ? level.width : std::min(x * 2 + 2, level.width);
+            glm::vec4 sum(0.0f);
+            for (int sy = y0; sy < y1; sy++)
+            {
+                for (int sx = x0; sx < x1; sx++)
+                    sum += level.pixels[(size_t)sy * level.width + sx];
+            }
+            glm::vec4 value = sum / (float)((y1 - y0) * (x1 - x0));
+            if (usage == TextureUsage::NORMAL)
+            {
+                // averaged normals get shorter, they are normalized again
+                glm::vec3 normal = glm::vec3(sum);
+                value = glm::vec4(glm::length(normal) > 0.0f ? glm::normalize(normal) : glm::vec3(0.0f, 0.0f, 1.0f), 1.0f);
+            }
+            next.pixels[(size_t)y * next.width + x] = value;
+        }
+    }
+    return next;
+}
+
+// the 8 bit RGBA pixel the encoders get
+inline void mipLevelPixel(const MipLevel &level, int x, int y, TextureUsage usage, uint8_t *out)
+{
+    glm::vec4 value = level.pixels[(size_t)std::min(y, level.height - 1) * level.width + std::min(x, level.width - 1)];
+    if (usage == TextureUsage::DIFFUSE)
+        value = glm::vec4(linearToSrgb(value.r), linearToSrgb(value.g), linearToSrgb(value.b), value.a);
+    else if (usage == TextureUsage::NORMAL)
+        value = glm::vec4(glm::vec3(value) * 0.5f + 0.5f, 1.0f);
+    for (int c = 0; c < 4; c++)
+        out[c] = (uint8_t)std::lround(glm::clamp(value[c], 0.0f, 1.0f) * 255.0f);
+}
+
+
+// -------------------------------------------------------------------------------------------------------------------
+// container
+
+const uint32_t BAKED_TEXTURE_VERSION = 2;
+
+struct BakedHeader
+{
+    char magic[4];        // "BTEX"
+    uint32_t version;
+    uint32_t format;      // BlockFormat
+    uint32_t usage;       // TextureUsage
+    uint32_t width, height;
+    uint32_t levelCount;
+};
+
+struct BakedLevel
+{
+    uint32_t width, height;
+    uint32_t offset, size; // of the blocks, from the start of the file
+};
+
+// true if the baked file exists and is not older than the image it was baked from
+inline bool isBakedTextureCurrent(const std::string &imagePath, const std::string &bakedPath)
+{
+    struct stat image, baked;
+    if (stat(imagePath.c_str(), &image) != 0 || stat(bakedPath.c_str(), &baked) != 0)
+        return false;
+    return baked.st_mtime >= image.st_mtime;
+}
+
+// a baked texture, in memory after baking, or mapped from its file
+class BakedTexture
+{
+public:
+    BakedTexture(const BakedTexture&) = delete;
+    BakedTexture& operator=(const BakedTexture&) = delete;
+
+    ~BakedTexture()
+    {
+        unmap();
+    }
+
+    // builds the mip chain of an image and compresses it
+    static std::shared_ptr<BakedTexture> Bake(const unsigned char *data, int width, int height, int components,
+                                              TextureUsage usage, BlockFormat format)
+    {
+        std::vector<MipLevel> mips;
+        mips.push_back(imageToMipLevel(data, width, height, components, usage));
+        while (mips.back().width > 1 || mips.back().height > 1)
+            mips.push_back(downsample(mips.back(), usage));
+
+        std::shared_ptr<BakedTexture> baked(new BakedTexture());
+        uint32_t offset = alignOffset((uint32_t)(sizeof(BakedHeader) + mips.size() * sizeof(BakedLevel)));
+        std::vector<BakedLevel> levels;
+        for (const MipLevel &mip : mips)
+        {
+            BakedLevel level;
+            level.width = mip.width;
+            level.height = mip.height;
+            level.offset = offset;
+            level.size = ((mip.width + 3) / 4) * ((mip.height + 3) / 4) * blockSize(format);
+            levels.push_back(level);
+            offset = alignOffset(offset + level.size);
+        }
+
+        std::vector<unsigned char> &memory = baked->memory;
+        memory.assign(offset, 0);
+        BakedHeader header = { { 'B', 'T', 'E', 'X' }, BAKED_TEXTURE_VERSION, (uint32_t)format, (uint32_t)usage,
+                               (uint32_t)width, (uint32_t)height, (uint32_t)levels.size() };
+        std::memcpy(memory.data(), &header, sizeof(header));
+        std::memcpy(memory.data() + sizeof(header), levels.data(), levels.size() * sizeof(BakedLevel));
+
+        uint8_t pixels[16][4];
+        for (size_t l = 0; l < mips.size(); l++)
+        {
+            uint8_t *block = memory.data() + levels[l].offset;
+            for (int y = 0; y < mips[l].height; y += 4)
+            {
+                for (int x = 0; x < mips[l].width; x += 4, block += blockSize(format))
+                {
+                    // the blocks on the right and bottom edges repeat the last pixels
+                    for (int i = 0; i < 16; i++)
+                        mipLevelPixel(mips[l], x + i % 4, y + i / 4, usage, pixels[i]);
+                    encodeBlock(format, pixels, block);
+                }
+            }
+        }
+        baked->bytes = memory.data();
+        baked->size = memory.size();
+        return baked;
+    }
+
+    // maps a baked file, returns nullptr if it can't be read or it is from another version
+    static std::shared_ptr<BakedTexture> Load(const std::string &path)
+    {
+        std::shared_ptr<BakedTexture> baked(new BakedTexture());
+        if (!baked->map(path) || baked->size < sizeof(BakedHeader))
+            return nullptr;
+        const BakedHeader &header = baked->Header();
+        if (std::memcmp(header.magic, "BTEX", 4) != 0 || header.version != BAKED_TEXTURE_VERSION ||
+            header.format > (uint32_t)BlockFormat::BC7 || header.usage > (uint32_t)TextureUsage::AMBIENT ||
+            baked->size < sizeof(BakedHeader) + header.levelCount * sizeof(BakedLevel))
+            return nullptr;
+        for (uint32_t l = 0; l < header.levelCount; l++)
+        {
+            if ((size_t)baked->Level(l).offset + baked->Level(l).size > baked->size)
+                return nullptr;
+        }
+        return baked;
+    }
+
+    // writes to a temporary file and renames it, so a crash never leaves a truncated file that looks current
+    bool Save(const std::string &path) const
+    {
+        std::string tempPath = path + ".tmp";
+        FILE *file = std::fopen(tempPath.c_str(), "wb");
+        if (file == nullptr)
+            return false;
+        bool success = std::fwrite(bytes, 1, size, file) == size;
+        success = std::fclose(file) == 0 && success;
+        if (success)
+        {
+            std::remove(path.c_str()); // rename does not replace existing files on every platform
+            success = std::rename(tempPath.c_str(), path.c_str()) == 0;
+        }
+        if (!success)
+            std::remove(tempPath.c_str());
+        return success;
+    }
+
+    const BakedHeader& Header() const
+    {
+        return *(const BakedHeader*)bytes;
+    }
+
+    BlockFormat Format() const
+    {
+        return (BlockFormat)Header().format;
+    }
+
+    TextureUsage Usage() const
+    {
+        return (TextureUsage)Header().usage;
+    }
+
+    const BakedLevel& Level(uint32_t level) const
+    {
+        return ((const BakedLevel*)(bytes + sizeof(BakedHeader)))[level];
+    }
+
+    const unsigned char* LevelData(uint32_t level) const
+    {
+        return bytes + Level(level).offset;
+    }
+
+private:
+    std::vector<unsigned char> memory;
+    const unsigned char *bytes = nullptr;
+    size_t size = 0;
+#if defined(_WIN32)
+    HANDLE file = INVALID_HANDLE_VALUE, mapping = nullptr;
+#else
+    void *mapped = nullptr;
+#endif
+
+    BakedTexture() = default;
+
+    // the levels start at multiples of 16 bytes
+    static uint32_t alignOffset(uint32_t offset)
+    {
+        return (offset + 15) & ~15u;
+    }
+
+    bool map(const std::string &path)
+    {
+#if defined(_WIN32)
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        LARGE_INTEGER fileSize;
+        if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+            return false;
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping == nullptr)
+            return false;
+        bytes = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        size = bytes != nullptr ? (size_t)fileSize.QuadPart : 0;
+        return bytes != nullptr;
+#else
+        int descriptor = open(path.c_str(), O_RDONLY);
+        if (descriptor < 0)
+            return false;
+        struct stat status;
+        if (fstat(descriptor, &status) != 0 || status.st_size == 0)
+        {
+            close(descriptor);
+            return false;
+        }
+        mapped = mmap(nullptr, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+        close(descriptor); // the mapping keeps the file
+        if (mapped == MAP_FAILED)
+        {
+            mapped = nullptr;
+            return false;
+        }
+        bytes = (const unsigned char*)mapped;
+        size = (size_t)status.st_size;
+        return true;
+#endif
+    }
+
+    void unmap()
+    {
+#if defined(_WIN32)
+        if (mapping != nullptr && bytes != nullptr)
+            UnmapViewOfFile(bytes);
+        if (mapping != nullptr)
+            CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE)
+            CloseHandle(file);
+#else
+        if (mapped != nullptr)
+            munmap(mapped, size);
+#endif
+    }
+};
+
+// creates a texture with the levels of a baked texture, the format must be in supportedBlockFormats
+inline unsigned int uploadBakedTexture(const BakedTexture &baked)
+{
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    GLenum format = blockFormatGL(baked.Format());
+    uint32_t levelCount = baked.Header().levelCount;
+    for (uint32_t l = 0; l < levelCount; l++)
+    {
+        const BakedLevel &level = baked.Level(l);
+        glCompressedTexImage2D(GL_TEXTURE_2D, l, format, level.width, level.height, 0, level.size, baked.LevelData(l));
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    return textureID;
+}
+
+#endif
@@ -0,0 +1,270 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <glad/glad.h>
+
+#include "texture_baker.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <climits>
+#define TEXTURE_CACHE_HAS_REALPATH
+#endif
+
+// pixels of an image file, decoded on any thread and uploaded on the render thread
+struct ImageData
+{
+    unsigned char *data = nullptr;
+    int width = 0, height = 0, components = 0;
+};
+
+// defined in model.h, next to stb_image
+ImageData decodeImage(const std::string &filename);
+unsigned int uploadTexture(ImageData &image, bool gamma);
+void freeImage(ImageData &image);
+
+// what the pool loads for a texture: the baked texture, or the pixels if it can't be compressed
+struct TextureImage
+{
+    ImageData pixels;
+    std::shared_ptr<BakedTexture> baked;
+};
+
+// a texture shared by every model that uses the same file
+struct CachedTexture
+{
+    std::string key;                       // canonical path, and the usage
+    TextureUsage usage = TextureUsage::DIFFUSE;
+    std::shared_future<TextureImage> image; // loaded on the pool, freed when uploaded. Guarded by the cache mutex
+    unsigned int id = 0;                   // OpenGL texture, 0 until uploaded
+    int references = 0;
+};
+
+
+// Process-wide texture cache.
+// Textures are looked up by the canonical path of their file and their usage, so models that share a file share the
+// texture. The first request of a file starts loading it on a pool of threads, so the images of a model are decoded
+// in parallel while the model is processed. The textures are counted: each Acquire is paired with a Release, and the
+// texture is deleted when the last one is released.
+// When SetBakedFormats has been given the compressed formats of the context, the pool loads the baked textures
+// instead of the images, and bakes the ones that are missing or older than their image (see texture_baker.h).
+class TextureCache
+{
+public:
+    static TextureCache& Get()
+    {
+        static TextureCache cache;
+        return cache;
+    }
+
+    TextureCache(const TextureCache&) = delete;
+    TextureCache& operator=(const TextureCache&) = delete;
+
+    // finds the texture of the file or adds it, can be called from any thread
+    CachedTexture* Acquire(const std::string &path, TextureUsage usage)
+    {
+        std::string canonicalPath = canonical(path);
+        std::string key = canonicalPath + '|' + std::to_string((int)usage);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        std::unique_ptr<CachedTexture> &entry = textures[key];
+        if (!entry)
+        {
+            entry.reset(new CachedTexture());
+            entry->key = key;
+            entry->usage = usage;
+            unsigned int formats = bakedFormats.load();
+            entry->image = runLocked<TextureImage>([canonicalPath, usage, formats]()
+            {
+                return loadTextureImage(canonicalPath, usage, formats);
+            });
+        }
+        entry->references++;
+        return entry.get();
+    }
+
+    // decodes an image on the pool, without adding it to the cache
+    std::shared_future<ImageData> Decode(const std::string &path)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return runLocked<ImageData>([path]() { return decodeImage(path); });
+    }
+
+    // the compressed formats the textures can be baked to, from supportedBlockFormats. 0 keeps the images
+    void SetBakedFormats(unsigned int formats)
+    {
+        bakedFormats = formats;
+    }
+
+    // blocks until the image of the texture is decoded, can be called from any thread. The future is copied under the
+    // lock, Upload may reset it on the render thread while this waits
+    void WaitDecoded(CachedTexture *texture)
+    {
+        std::shared_future<TextureImage> image;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            image = texture->image;
+        }
+        if (image.valid())
+            image.wait();
+    }
+
+    // creates the OpenGL texture the first time, waiting for the image if it is not decoded yet. Render thread only
+    unsigned int Upload(CachedTexture *texture)
+    {
+        if (texture->id == 0)
+        {
+            std::shared_future<TextureImage> future;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                future = texture->image;
+            }
+            TextureImage image = future.get();
+            if (image.baked)
+                texture->id = uploadBakedTexture(*image.baked);
+            else
+                texture->id = uploadTexture(image.pixels, texture->usage == TextureUsage::DIFFUSE);
+            std::lock_guard<std::mutex> lock(mutex);
+            texture->image = std::shared_future<TextureImage>();
+        }
+        return texture->id;
+    }
+
+    // deletes the texture when it is not used anymore. Render thread only
+    void Release(CachedTexture *texture)
+    {
+        std::unique_ptr<CachedTexture> removed;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--texture->references > 0)
+                return;
+            auto it = textures.find(texture->key);
+            removed = std::move(it->second);
+            textures.erase(it);
+        }
+        if (removed->id != 0)
+            glDeleteTextures(1, &removed->id);
+        else if (removed->image.valid())
+        {
+            ImageData pixels = removed->image.get().pixels; // decoded, but never uploaded
+            freeImage(pixels);
+        }
+    }
+
+private:
+    std::mutex mutex;
+    std::unordered_map<std::string, std::unique_ptr<CachedTexture>> textures;
+
+    // decoding threads
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> jobs;
+    std::condition_variable jobCondition;
+    bool stopping = false;
+
+    std::atomic<unsigned int> bakedFormats{0};
+
+    TextureCache()
+    {
+        unsigned int threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+        for (unsigned int i = 0; i < threadCount; i++)
+            workers.emplace_back(&TextureCache::workerLoop, this);
+    }
+
+    ~TextureCache()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        jobCondition.notify_all();
+        for (std::thread &worker : workers)
+            worker.join();
+    }
+
+    template<typename Result>
+    std::shared_future<Result> runLocked(std::function<Result()> function)
+    {
+        std::shared_ptr<std::packaged_task<Result()>> task = std::make_shared<std::packaged_task<Result()>>(function);
+        jobs.push_back([task]() { (*task)(); });
+        jobCondition.notify_one();
+        return task->get_future().share();
+    }
+
+    // maps the baked texture if it is current, or decodes the image and bakes it
+    static TextureImage loadTextureImage(const std::string &path, TextureUsage usage, unsigned int formats)
+    {
+        TextureImage image;
+        std::string bakedPath = path + '.' + textureUsageName(usage) + ".baked";
+        if (formats != 0 && isBakedTextureCurrent(path, bakedPath))
+        {
+            // a file baked for another usage, or with a format the usage can't have, is baked again
+            image.baked = BakedTexture::Load(bakedPath);
+            if (image.baked && image.baked->Usage() == usage && isBlockFormatFor(usage, image.baked->Format()) &&
+                (formats & blockFormatBit(image.baked->Format())))
+                return image;
+            image.baked = nullptr;
+        }
+
+        image.pixels = decodeImage(path);
+        if (formats == 0 || !image.pixels.data)
+            return image;
+        ImageData &pixels = image.pixels;
+        BlockFormat format = chooseBlockFormat(usage, pixels.data, pixels.width, pixels.height, pixels.components);
+        if ((formats & blockFormatBit(format)) == 0)
+            return image; // the context can't upload it, the pixels are uploaded as they are
+
+        image.baked = BakedTexture::Bake(pixels.data, pixels.width, pixels.height, pixels.components, usage, format);
+        freeImage(pixels);
+        if (!image.baked->Save(bakedPath))
+            std::cout << "Baked texture could not be saved at path: " << bakedPath << std::endl;
+        return image;
+    }
+
+    void workerLoop()
+    {
+        while (true)
+        {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                jobCondition.wait(lock, [this]() { return stopping || !jobs.empty(); });
+                if (stopping && jobs.empty())
+                    return;
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+            job();
+        }
+    }
+
+    // the same file can be reached with different paths, like "car/../car/paint.png", the real path is used as key
+    static std::string canonical(const std::string &path)
+    {
+#ifdef TEXTURE_CACHE_HAS_REALPATH
+        char resolved[PATH_MAX];
+        if (realpath(path.c_str(), resolved) != nullptr)
+            return resolved;
+#else
+        char resolved[_MAX_PATH];
+        if (_fullpath(resolved, path.c_str(), _MAX_PATH) != nullptr)
+            return resolved;
+#endif
+        return path; // the file doesn't exist, decoding will report it
+    }
+};
+
+#endif
@@ -0,0 +1,128 @@
+#ifndef TRANSFORM_SYSTEM_H
+#define TRANSFORM_SYSTEM_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+#include "worker_pool.h"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define TRANSFORM_SYSTEM_SSE 1
+#endif
+
+// Transforms of many instances, stored as a structure of arrays: one array for each component of the position, of the
+// rotation (a unit quaternion) and of the scale. An animation only touches the arrays it changes, and the model
+// matrices are built in batches of 4 instances with SSE: each register holds the same component of 4 instances, so
+// the matrix is computed with the same instructions as for one instance, and the 4 results are transposed into 4
+// matrices at the end. Without SSE the same code runs one instance at a time.
+class TransformSystem
+{
+public:
+    std::vector<float> positionX, positionY, positionZ;
+    std::vector<float> rotationX, rotationY, rotationZ, rotationW;
+    std::vector<float> scaleX, scaleY, scaleZ;
+
+    unsigned int Add(glm::vec3 position, glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f),
+                     glm::vec3 scale = glm::vec3(1.0f))
+    {
+        positionX.push_back(position.x);
+        positionY.push_back(position.y);
+        positionZ.push_back(position.z);
+        rotationX.push_back(rotation.x);
+        rotationY.push_back(rotation.y);
+        rotationZ.push_back(rotation.z);
+        rotationW.push_back(rotation.w);
+        scaleX.push_back(scale.x);
+        scaleY.push_back(scale.y);
+        scaleZ.push_back(scale.z);
+        return Size() - 1;
+    }
+
+    unsigned int Size() const { return (unsigned int)positionX.size(); }
+
+    // fewer transforms than this in a range cost less than waking up a worker, the 2511 cars of the scene make 8 ranges
+    static const unsigned int MIN_RANGE_SIZE = 256;
+
+    // writes translate * rotate * scale of every transform. The matrix of transform i is at matrices + i * stride
+    // bytes, so the matrices can be written straight into an array of instance structs. With a pool the transforms are
+    // split in up to threadCount ranges of at least MIN_RANGE_SIZE, done by the pool and the calling thread
+    void ComposeMatrices(glm::mat4* matrices, size_t stride, WorkerPool* pool = nullptr, unsigned int threadCount = 1) const
+    {
+        unsigned int count = Size();
+        unsigned int rangeCount = pool ? std::min(std::min(threadCount, pool->ThreadCount()), count / MIN_RANGE_SIZE) : 1;
+        if (rangeCount <= 1)
+        {
+            composeRange(matrices, stride, 0, count);
+            return;
+        }
+        // the ranges are multiples of 4, so only the last one has a partial batch
+        unsigned int rangeSize = ((count + rangeCount - 1) / rangeCount + 3) & ~3u;
+        pool->Run(rangeCount, [=](unsigned int range)
+        {
+            unsigned int begin = range * rangeSize;
+            composeRange(matrices, stride, std::min(begin, count), std::min(begin + rangeSize, count));
+        });
+    }
+
+private:
+    void composeRange(glm::mat4* matrices, size_t stride, unsigned int begin, unsigned int end) const
+    {
+        char* output = (char*)matrices;
+        unsigned int i = begin;
+#ifdef TRANSFORM_SYSTEM_SSE
+        const __m128 one = _mm_set1_ps(1.0f), two = _mm_set1_ps(2.0f), zero = _mm_setzero_ps();
+        for (; i + 4 <= end; i += 4)
+        {
+            __m128 x = _mm_loadu_ps(&rotationX[i]), y = _mm_loadu_ps(&rotationY[i]);
+            __m128 z = _mm_loadu_ps(&rotationZ[i]), w = _mm_loadu_ps(&rotationW[i]);
+            __m128 x2 = _mm_mul_ps(x, two), y2 = _mm_mul_ps(y, two), z2 = _mm_mul_ps(z, two);
+            __m128 xx = _mm_mul_ps(x, x2), yy = _mm_mul_ps(y, y2), zz = _mm_mul_ps(z, z2);
+            __m128 xy = _mm_mul_ps(x, y2), xz = _mm_mul_ps(x, z2), yz = _mm_mul_ps(y, z2);
+            __m128 wx = _mm_mul_ps(w, x2), wy = _mm_mul_ps(w, y2), wz = _mm_mul_ps(w, z2);
+            __m128 sx = _mm_loadu_ps(&scaleX[i]), sy = _mm_loadu_ps(&scaleY[i]), sz = _mm_loadu_ps(&scaleZ[i]);
+
+            // element r of column c, for the 4 instances
+            __m128 columns[4][4] =
+            {
+                { _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(yy, zz)), sx), _mm_mul_ps(_mm_add_ps(xy, wz), sx),
+                  _mm_mul_ps(_mm_sub_ps(xz, wy), sx), zero },
+                { _mm_mul_ps(_mm_sub_ps(xy, wz), sy), _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, zz)), sy),
+                  _mm_mul_ps(_mm_add_ps(yz, wx), sy), zero },
+                { _mm_mul_ps(_mm_add_ps(xz, wy), sz), _mm_mul_ps(_mm_sub_ps(yz, wx), sz),
+                  _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, yy)), sz), zero },
+                { _mm_loadu_ps(&positionX[i]), _mm_loadu_ps(&positionY[i]), _mm_loadu_ps(&positionZ[i]), one }
+            };
+            for (int c = 0; c < 4; c++)
+            {
+                // after the transpose, register k holds column c of instance k
+                _MM_TRANSPOSE4_PS(columns[c][0], columns[c][1], columns[c][2], columns[c][3]);
+                for (int k = 0; k < 4; k++)
+                    _mm_storeu_ps((float*)(output + (i + k) * stride) + c * 4, columns[c][k]);
+            }
+        }
+#endif
+        for (; i < end; i++)
+        {
+            float x = rotationX[i], y = rotationY[i], z = rotationZ[i], w = rotationW[i];
+            float xx = 2.0f * x * x, yy = 2.0f * y * y, zz = 2.0f * z * z;
+            float xy = 2.0f * x * y, xz = 2.0f * x * z, yz = 2.0f * y * z;
+            float wx = 2.0f * w * x, wy = 2.0f * w * y, wz = 2.0f * w * z;
+            const float matrix[16] =
+            {
+                (1.0f - yy - zz) * scaleX[i], (xy + wz) * scaleX[i], (xz - wy) * scaleX[i], 0.0f,
+                (xy - wz) * scaleY[i], (1.0f - xx - zz) * scaleY[i], (yz + wx) * scaleY[i], 0.0f,
+                (xz + wy) * scaleZ[i], (yz - wx) * scaleZ[i], (1.0f - xx - yy) * scaleZ[i], 0.0f,
+                positionX[i], positionY[i], positionZ[i], 1.0f
+            };
+            std::memcpy(output + i * stride, matrix, sizeof(matrix));
+        }
+    }
+};
+
+#endif
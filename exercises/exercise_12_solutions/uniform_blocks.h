@@ -0,0 +1,89 @@
+#ifndef UNIFORM_BLOCKS_H
+#define UNIFORM_BLOCKS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "stream_buffer.h"
+
+// Uniform blocks shared by every shader. The data that is the same for all the draws of a frame (time, camera, lights)
+// is written once per frame in the stream buffer, and bound to fixed binding points, so the shaders that declare the
+// blocks read them without any glUniform call. Shader binds the blocks of a program to these points when it is linked
+// (see bindUniformBlocks).
+// The structs follow the std140 layout of the blocks in the shaders: vec3 are padded to vec4, and so are the arrays.
+
+enum UniformBlockBinding : GLuint
+{
+    FRAME_BLOCK_BINDING = 0,
+    VIEW_BLOCK_BINDING = 1,
+    LIGHT_BLOCK_BINDING = 2
+};
+
+const unsigned int MAX_BLOCK_LIGHTS = 16;
+
+// layout(std140) uniform FrameData
+struct FrameData
+{
+    float time;      // seconds since the start
+    float deltaTime; // seconds since the previous frame
+    float exposure;  // scale of the final color
+    float padding;
+};
+
+// layout(std140) uniform ViewData
+struct ViewData
+{
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::mat4 viewProjection;
+    glm::mat4 inverseProjection;
+    glm::vec4 cameraPosition; // w is 1
+};
+
+struct BlockLight
+{
+    glm::vec4 position; // xyz position or direction, w radius (0 for directional lights)
+    glm::vec4 color;    // rgb energy
+};
+
+// layout(std140) uniform LightData
+struct LightData
+{
+    glm::vec4 ambientLightColor; // rgb color, a amount of ambient and reflections
+    BlockLight lights[MAX_BLOCK_LIGHTS];
+    int lightCount;
+    int padding[3];
+};
+
+static_assert(sizeof(FrameData) == 16, "FrameData doesn't match the std140 layout");
+static_assert(sizeof(ViewData) == 4 * 64 + 16, "ViewData doesn't match the std140 layout");
+static_assert(sizeof(LightData) == 16 + MAX_BLOCK_LIGHTS * 32 + 16, "LightData doesn't match the std140 layout");
+
+// binds the blocks the program declares to their binding points, the ones it doesn't use are skipped
+inline void bindUniformBlocks(GLuint program)
+{
+    const struct { const char *name; GLuint binding; } blocks[] =
+    {
+        { "FrameData", FRAME_BLOCK_BINDING },
+        { "ViewData", VIEW_BLOCK_BINDING },
+        { "LightData", LIGHT_BLOCK_BINDING }
+    };
+    for (const auto &block : blocks)
+    {
+        GLuint index = glGetUniformBlockIndex(program, block.name);
+        if (index != GL_INVALID_INDEX)
+            glUniformBlockBinding(program, index, block.binding);
+    }
+}
+
+// writes the block in the stream buffer of the frame and binds it to its binding point, once per frame before the
+// draws that read it
+template<typename Block>
+void uploadUniformBlock(StreamBuffer &stream, GLuint bindingPoint, const Block &block)
+{
+    BufferRange range = stream.Write(&block, sizeof(Block));
+    if (range.buffer != 0)
+        glBindBufferRange(GL_UNIFORM_BUFFER, bindingPoint, range.buffer, range.offset, range.size);
+}
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef VERTEX_QUANTIZATION_H
+#define VERTEX_QUANTIZATION_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <cstdint>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+// Compact vertex format used on the GPU, 20 bytes instead of the 56 of Vertex:
+// - position: 16 bit signed normalized, relative to the bounding box of the mesh. The shader gets the box as
+//   positionOffset and positionScale uniforms, and computes offset + scale * position
+// - normal and tangent: octahedral encoding, 2 x 16 bit signed normalized each
+// - bitangent: only its sign, stored in the w of the position (the shaders rebuild it from the normal and tangent)
+// - texture coordinates: 2 half floats
+// The meshes keep the float vertices on the CPU, they are packed when uploaded.
+
+struct PackedVertex
+{
+    int16_t position[4];   // xyz position, w bitangent sign
+    int16_t normal[2];
+    uint16_t texCoords[2]; // half floats
+    int16_t tangent[2];
+};
+
+// the transform from the packed positions back to model space
+struct VertexQuantization
+{
+    glm::vec3 offset;
+    glm::vec3 scale;
+};
+
+inline int16_t packSnorm16(float value)
+{
+    value = glm::clamp(value, -1.0f, 1.0f);
+    return (int16_t)std::lround(value * 32767.0f);
+}
+
+// maps the unit sphere to the [-1, 1] square: the upper half is projected on the octahedron |x| + |y| + |z| = 1, and
+// the lower half is folded over the diagonals
+inline glm::vec2 encodeOctahedral(glm::vec3 n)
+{
+    float length = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+    if (length == 0.0f)
+        return glm::vec2(0.0f);
+    glm::vec2 p = glm::vec2(n.x, n.y) / length;
+    if (n.z < 0.0f)
+    {
+        p = glm::vec2((1.0f - std::fabs(p.y)) * (p.x >= 0.0f ? 1.0f : -1.0f),
+                      (1.0f - std::fabs(p.x)) * (p.y >= 0.0f ? 1.0f : -1.0f));
+    }
+    return p;
+}
+
+// same as decodeOctahedral in shaders/common_shading.vert
+inline glm::vec3 decodeOctahedral(glm::vec2 e)
+{
+    glm::vec3 n(e.x, e.y, 1.0f - std::fabs(e.x) - std::fabs(e.y));
+    float t = glm::max(-n.z, 0.0f);
+    n.x += n.x >= 0.0f ? -t : t;
+    n.y += n.y >= 0.0f ? -t : t;
+    return glm::normalize(n);
+}
+
+// the offset and scale that map [-1, 1] to the bounding box of the vertices
+template<typename Vertex>
+VertexQuantization computeVertexQuantization(const std::vector<Vertex> &vertices)
+{
+    glm::vec3 boxMin(std::numeric_limits<float>::max()), boxMax(-std::numeric_limits<float>::max());
+    for (const Vertex &vertex : vertices)
+    {
+        boxMin = glm::min(boxMin, vertex.Position);
+        boxMax = glm::max(boxMax, vertex.Position);
+    }
+    VertexQuantization quantization;
+    if (vertices.empty())
+    {
+        quantization.offset = glm::vec3(0.0f);
+        quantization.scale = glm::vec3(1.0f);
+        return quantization;
+    }
+    quantization.offset = (boxMin + boxMax) * 0.5f;
+    // a flat box still needs a scale that is not 0
+    quantization.scale = glm::max((boxMax - boxMin) * 0.5f, glm::vec3(std::numeric_limits<float>::min()));
+    return quantization;
+}
+
+template<typename Vertex>
+PackedVertex packVertex(const Vertex &vertex, const VertexQuantization &quantization)
+{
+    PackedVertex packed;
+    glm::vec3 position = (vertex.Position - quantization.offset) / quantization.scale;
+    packed.position[0] = packSnorm16(position.x);
+    packed.position[1] = packSnorm16(position.y);
+    packed.position[2] = packSnorm16(position.z);
+    // handedness of the tangent frame
+    bool mirrored = glm::dot(glm::cross(vertex.Normal, vertex.Tangent), vertex.Bitangent) < 0.0f;
+    packed.position[3] = mirrored ? -32767 : 32767;
+
+    glm::vec2 normal = encodeOctahedral(vertex.Normal);
+    packed.normal[0] = packSnorm16(normal.x);
+    packed.normal[1] = packSnorm16(normal.y);
+    glm::vec2 tangent = encodeOctahedral(vertex.Tangent);
+    packed.tangent[0] = packSnorm16(tangent.x);
+    packed.tangent[1] = packSnorm16(tangent.y);
+
+    packed.texCoords[0] = glm::packHalf1x16(vertex.TexCoords.x);
+    packed.texCoords[1] = glm::packHalf1x16(vertex.TexCoords.y);
+    return packed;
+}
+
+#endif
@@ -0,0 +1,120 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Threads for the work of a frame that can be split in ranges, like building the car matrices or culling the cars.
+// The threads are created once and sleep between the calls, so a call only wakes them up instead of creating them.
+// Run calls the function once for each range, on the workers and on the calling thread, and returns when every range
+// is done. The ranges are taken one at a time, so a worker that wakes up late takes fewer of them, or none.
+// One thread calls Run at a time, the render thread.
+class WorkerPool
+{
+public:
+    // threadCount 0 uses every core but one, the calling thread does ranges too
+    explicit WorkerPool(unsigned int threadCount = 0)
+    {
+        if (threadCount == 0)
+            threadCount = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+        for (unsigned int i = 0; i < threadCount; i++)
+            workers.emplace_back(&WorkerPool::workerLoop, this);
+    }
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    ~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        startCondition.notify_all();
+        for (std::thread &worker : workers)
+            worker.join();
+    }
+
+    // the workers and the calling thread
+    unsigned int ThreadCount() const
+    {
+        return (unsigned int)workers.size() + 1;
+    }
+
+    // calls function(range) for every range in [0, rangeCount), and waits until all are done
+    void Run(unsigned int rangeCount, const std::function<void(unsigned int)> &function)
+    {
+        if (rangeCount <= 1 || workers.empty())
+        {
+            for (unsigned int range = 0; range < rangeCount; range++)
+                function(range);
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = &function;
+            jobRanges = rangeCount;
+            nextRange = 0;
+            finishedWorkers = 0;
+            generation++;
+        }
+        startCondition.notify_all();
+
+        runRanges(function);
+
+        // every worker takes part in every call, so none of them can still be in this one when the next one starts
+        std::unique_lock<std::mutex> lock(mutex);
+        doneCondition.wait(lock, [this]() { return finishedWorkers == workers.size(); });
+        job = nullptr;
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable startCondition, doneCondition;
+    bool stopping = false;
+
+    // the current call of Run
+    const std::function<void(unsigned int)> *job = nullptr;
+    unsigned int jobRanges = 0;
+    std::atomic<unsigned int> nextRange{0};
+    unsigned int generation = 0;
+    unsigned int finishedWorkers = 0;
+
+    void runRanges(const std::function<void(unsigned int)> &function)
+    {
+        for (unsigned int range = nextRange++; range < jobRanges; range = nextRange++)
+            function(range);
+    }
+
+    void workerLoop()
+    {
+        unsigned int seenGeneration = 0;
+        while (true)
+        {
+            const std::function<void(unsigned int)> *function;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                startCondition.wait(lock, [&]() { return stopping || generation != seenGeneration; });
+                if (stopping)
+                    return;
+                seenGeneration = generation;
+                function = job;
+            }
+            runRanges(*function);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (++finishedWorkers == workers.size())
+                    doneCondition.notify_one();
+            }
+        }
+    }
+};
+
+#endif
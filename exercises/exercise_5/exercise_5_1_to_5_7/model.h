@@ -10,6 +10,7 @@
 // NEW! our models are stored in a specific 3D mesh format (i.e. no longer in a header file)
 //  objloader is used to parse those files
 #include "objloader.h"
+#include "mesh_optimizer.h"
 
 #include <string>
 #include <fstream>
@@ -17,9 +18,35 @@
 #include <iostream>
 #include <map>
 #include <vector>
+#include <unordered_map>
+#include <cstring>
+#include <cstdint>
 using namespace std;
 
 
+// hash and comparison of the bits of a vertex, so that identical vertices can be merged
+struct VertexBitsHash
+{
+    size_t operator()(const Vertex &vertex) const
+    {
+        uint32_t words[sizeof(Vertex) / 4];
+        memcpy(words, &vertex, sizeof(Vertex));
+        uint64_t hash = 14695981039346656037ull;
+        for (uint32_t word : words)
+            hash = (hash ^ word) * 1099511628211ull;
+        return (size_t)(hash ^ (hash >> 32));
+    }
+};
+
+struct VertexBitsEqual
+{
+    bool operator()(const Vertex &a, const Vertex &b) const
+    {
+        return memcmp(&a, &b, sizeof(Vertex)) == 0;
+    }
+};
+
+
 class Model
 {
 public:
@@ -57,7 +84,7 @@ private:
         std::vector<glm::vec2> uvs;
         std::vector<glm::vec3> normals;
 
-        loadOBJ(path.c_str(), vertices, uvs, normals);
+        loadOBJMapped(path.c_str(), vertices, uvs, normals, 0); // parse with all the cores
         meshes.push_back(processMesh(vertices, uvs, normals));
 
     }
@@ -71,11 +98,16 @@ private:
         std::vector<Vertex> vertices;
         std::vector<unsigned int> indices;
 
+        // the OBJ loader gives one vertex per triangle corner, corners with the same position, normal and texture
+        // coordinates are merged into a single vertex, so that the index buffer can reuse it
+        std::unordered_map<Vertex, unsigned int, VertexBitsHash, VertexBitsEqual> uniqueVertices;
+        uniqueVertices.reserve(inVertices.size());
+        indices.reserve(inVertices.size());
+
         // Walk through each of the mesh's vertices
         for(unsigned int i = 0; i < inVertices.size(); i++)
         {
             Vertex vertex;
-            glm::vec3 vector;
             // positions
             vertex.Position = inVertices[i];
             // normals
@@ -83,10 +115,20 @@ private:
             // texture coordinates
             vertex.TexCoords = i < inUvs.size() ? inUvs[i] : glm::vec2(0.0f, 0.0f);
 
-            vertices.push_back(vertex);
-            indices.push_back(i);
+            auto inserted = uniqueVertices.emplace(vertex, (unsigned int)vertices.size());
+            if (inserted.second)
+                vertices.push_back(vertex);
+            indices.push_back(inserted.first->second);
         }
 
+        size_t weldedBytes = vertices.size() * sizeof(Vertex) + indices.size() * sizeof(unsigned int);
+        size_t unweldedBytes = inVertices.size() * sizeof(Vertex) + indices.size() * sizeof(unsigned int);
+        printf("Welded %zu corners into %zu vertices, %.1f KB of GPU memory instead of %.1f KB\n",
+               inVertices.size(), vertices.size(), weldedBytes / 1024.0, unweldedBytes / 1024.0);
+
+        // reorder triangles and vertices for the vertex cache and overdraw
+        optimizeMesh(vertices, indices);
+
         // return a mesh object created from the extracted mesh data
         return Mesh(vertices, indices);//, textures);
     }
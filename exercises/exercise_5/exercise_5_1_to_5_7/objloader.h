@@ -8,6 +8,18 @@
 #include <stdio.h>
 #include <string>
 #include <cstring>
+#include <cstdlib>
+#include <cstdint>
+#include <algorithm>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define OBJLOADER_HAS_MMAP
+#endif
 
 #include <glm/glm.hpp>
 
@@ -257,4 +269,434 @@ bool loadOBJ(
 }
 
 
+// Faster loader that produces the same output as loadOBJ.
+// The file is memory mapped (or read in a single call on platforms without mmap) and parsed in place, numbers are
+// converted by hand instead of through fscanf, which spends most of its time in locale handling and format parsing.
+
+// read-only view of a whole file
+class OBJFileView
+{
+public:
+    const char * data = nullptr;
+    size_t size = 0;
+
+    bool open(const char * path){
+#ifdef OBJLOADER_HAS_MMAP
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat info;
+        if (fstat(fd, &info) != 0){
+            ::close(fd);
+            return false;
+        }
+        size = (size_t)info.st_size;
+        if (size > 0){
+            void * mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped == MAP_FAILED){
+                ::close(fd);
+                return false;
+            }
+            madvise(mapped, size, MADV_SEQUENTIAL);
+            data = (const char *) mapped;
+        }
+        ::close(fd); // the mapping stays valid after closing the file
+        return true;
+#else
+        FILE * file = fopen(path, "rb");
+        if (file == NULL)
+            return false;
+        fseek(file, 0, SEEK_END);
+        buffer.resize((size_t)ftell(file));
+        fseek(file, 0, SEEK_SET);
+        size = fread(buffer.data(), 1, buffer.size(), file);
+        fclose(file);
+        data = buffer.data();
+        return true;
+#endif
+    }
+
+    ~OBJFileView(){
+#ifdef OBJLOADER_HAS_MMAP
+        if (data != nullptr)
+            munmap((void *) data, size);
+#endif
+    }
+
+private:
+#ifndef OBJLOADER_HAS_MMAP
+    std::vector<char> buffer;
+#endif
+};
+
+
+inline bool isOBJSpace(char c){
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+inline void skipOBJSpaces(const char *& p, const char * end){
+    while (p < end && isOBJSpace(*p))
+        p++;
+}
+
+inline void skipOBJLine(const char *& p, const char * end){
+    const char * newline = (const char *) memchr(p, '\n', (size_t)(end - p));
+    p = newline != nullptr ? newline + 1 : end;
+}
+
+// parses a float at p, advancing p. Returns false if there is no number.
+// Decimal numbers with up to 19 significant digits and a small exponent take a fast path, that is exact: the digits
+// fit in a 64 bit integer, and both the integer and the power of ten are exact doubles, so the division/multiplication
+// gives the correctly rounded double. Converting that double to float only differs from rounding the decimal number
+// directly to float when the double lands exactly halfway between two floats, those rare cases (as well as long
+// mantissas, big exponents, denormals, inf and nan) go through strtof, so the result always matches fscanf("%f").
+inline bool parseOBJFloat(const char *& p, const char * end, float & out){
+    static const double powersOf10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    skipOBJSpaces(p, end);
+    const char * start = p;
+
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')){
+        negative = *p == '-';
+        p++;
+    }
+
+    uint64_t mantissa = 0;
+    int digits = 0, exponent = 0;
+    bool anyDigit = false;
+    while (p < end && (unsigned)(*p - '0') < 10u){
+        // leading zeros are not significant
+        if (digits > 0 || *p != '0'){
+            if (digits < 19) mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+            else exponent++;
+            digits++;
+        }
+        anyDigit = true;
+        p++;
+    }
+    if (p < end && *p == '.'){
+        p++;
+        while (p < end && (unsigned)(*p - '0') < 10u){
+            if (digits > 0 || *p != '0'){
+                if (digits < 19){
+                    mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+                    exponent--;
+                }
+                digits++;
+            }
+            else
+                exponent--;
+            anyDigit = true;
+            p++;
+        }
+    }
+    if (anyDigit && p < end && (*p == 'e' || *p == 'E')){
+        const char * exponentStart = p++;
+        bool negativeExponent = false;
+        if (p < end && (*p == '-' || *p == '+')){
+            negativeExponent = *p == '-';
+            p++;
+        }
+        if (p < end && (unsigned)(*p - '0') < 10u){
+            int value = 0;
+            while (p < end && (unsigned)(*p - '0') < 10u){
+                if (value < 100000) value = value * 10 + (*p - '0');
+                p++;
+            }
+            exponent += negativeExponent ? -value : value;
+        }
+        else
+            p = exponentStart; // not an exponent, like strtof, stop before the 'e'
+    }
+
+    if (anyDigit && digits <= 19 && mantissa < (1ull << 53) && exponent >= -22 && exponent <= 22){
+        double value = (double) mantissa;
+        value = exponent < 0 ? value / powersOf10[-exponent] : value * powersOf10[exponent];
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        // halfway between two floats: the 29 mantissa bits that a float drops are exactly 1000...0
+        bool halfway = (bits & 0x1FFFFFFFull) == 0x10000000ull;
+        if (mantissa == 0 || (!halfway && value >= 1.17549435e-38 && value <= 3.40282347e+38)){
+            out = (float)(negative ? -value : value);
+            return true;
+        }
+    }
+
+    // slow path, the mapped file is not null terminated so the token is copied first
+    char token[128];
+    p = start;
+    size_t length = 0;
+    while (p < end && length < sizeof(token) - 1 && !isOBJSpace(*p) && *p != '\n')
+        token[length++] = *p++;
+    token[length] = '\0';
+    char * tokenEnd;
+    out = strtof(token, &tokenEnd);
+    p = start + (tokenEnd - token);
+    return tokenEnd != token;
+}
+
+// parses an integer at p, advancing p. Returns false if there is no number
+inline bool parseOBJInt(const char *& p, const char * end, unsigned int & out){
+    skipOBJSpaces(p, end);
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')){
+        negative = *p == '-';
+        p++;
+    }
+    if (p == end || (unsigned)(*p - '0') >= 10u)
+        return false;
+    unsigned int value = 0;
+    while (p < end && (unsigned)(*p - '0') < 10u)
+        value = value * 10 + (unsigned int)(*p++ - '0');
+    out = negative ? 0u - value : value;
+    return true;
+}
+
+// parses the "v/vt/vn" triplets of a face line, returns how many numbers were read, like the fscanf in loadOBJ
+inline int parseOBJFace(const char *& p, const char * end,
+                        unsigned int vertexIndex[4], unsigned int uvIndex[4], unsigned int normalIndex[4]){
+    int matches = 0;
+    for (int i = 0; i < 4; i++){
+        if (!parseOBJInt(p, end, vertexIndex[i])) break;
+        matches++;
+        if (p == end || *p++ != '/' || !parseOBJInt(p, end, uvIndex[i])) break;
+        matches++;
+        if (p == end || *p++ != '/' || !parseOBJInt(p, end, normalIndex[i])) break;
+        matches++;
+    }
+    return matches;
+}
+
+// positions, uvs and normals of an OBJ file (or of a part of it), and the attribute indices of each triangle corner
+struct OBJData
+{
+    std::vector<float> vertices, uvs, normals;
+    std::vector<unsigned int> vertexIndices, uvIndices, normalIndices;
+};
+
+// runs function(i) for i in [0, count), each call in its own thread
+template<typename Function>
+void runOBJThreads(unsigned int count, Function function){
+    std::vector<std::thread> threads;
+    for (unsigned int i = 1; i < count; i++)
+        threads.emplace_back(function, i);
+    function(0);
+    for (std::thread & thread : threads)
+        thread.join();
+}
+
+// parses the lines in [p, end) and appends them to data, returns false if a face can't be read
+inline bool parseOBJRange(const char * p, const char * end, OBJData & data){
+    // rough guess of the final sizes from the size of the text, to avoid most reallocations
+    size_t bytes = (size_t)(end - p);
+    data.vertices.reserve(bytes / 32);
+    data.normals.reserve(bytes / 32);
+    data.uvs.reserve(bytes / 48);
+    data.vertexIndices.reserve(bytes / 24);
+    data.uvIndices.reserve(bytes / 24);
+    data.normalIndices.reserve(bytes / 24);
+
+    while (p < end){
+        // skip blank lines, fscanf("%s") skips them too
+        while (p < end && (isOBJSpace(*p) || *p == '\n'))
+            p++;
+        if (p == end)
+            break;
+
+        // read the first word of the line
+        const char * header = p;
+        while (p < end && !isOBJSpace(*p) && *p != '\n')
+            p++;
+        size_t headerLength = (size_t)(p - header);
+
+        if (headerLength == 1 && header[0] == 'v'){
+            float x = 0, y = 0, z = 0;
+            parseOBJFloat(p, end, x) && parseOBJFloat(p, end, y) && parseOBJFloat(p, end, z);
+            data.vertices.push_back(x);
+            data.vertices.push_back(y);
+            data.vertices.push_back(z);
+        }else if (headerLength == 2 && header[0] == 'v' && header[1] == 't'){
+            float u = 0, v = 0;
+            parseOBJFloat(p, end, u) && parseOBJFloat(p, end, v);
+            v = -v; // Invert V coordinate, same as loadOBJ
+            data.uvs.push_back(u);
+            data.uvs.push_back(v);
+        }else if (headerLength == 2 && header[0] == 'v' && header[1] == 'n'){
+            float nx = 0, ny = 0, nz = 0;
+            parseOBJFloat(p, end, nx) && parseOBJFloat(p, end, ny) && parseOBJFloat(p, end, nz);
+            data.normals.push_back(nx);
+            data.normals.push_back(ny);
+            data.normals.push_back(nz);
+        }else if (headerLength == 1 && header[0] == 'f'){
+            unsigned int vertexIndex[4], uvIndex[4], normalIndex[4];
+            int matches = parseOBJFace(p, end, vertexIndex, uvIndex, normalIndex);
+            if (matches != 9 && matches != 12)
+                return false;
+            data.vertexIndices.push_back(vertexIndex[0]);
+            data.vertexIndices.push_back(vertexIndex[1]);
+            data.vertexIndices.push_back(vertexIndex[2]);
+            data.uvIndices    .push_back(uvIndex[0]);
+            data.uvIndices    .push_back(uvIndex[1]);
+            data.uvIndices    .push_back(uvIndex[2]);
+            data.normalIndices.push_back(normalIndex[0]);
+            data.normalIndices.push_back(normalIndex[1]);
+            data.normalIndices.push_back(normalIndex[2]);
+            if (matches == 12){
+                // if a quad is defined, load as a second triangle
+                data.vertexIndices.push_back(vertexIndex[0]);
+                data.vertexIndices.push_back(vertexIndex[2]);
+                data.vertexIndices.push_back(vertexIndex[3]);
+                data.uvIndices    .push_back(uvIndex[0]);
+                data.uvIndices    .push_back(uvIndex[2]);
+                data.uvIndices    .push_back(uvIndex[3]);
+                data.normalIndices.push_back(normalIndex[0]);
+                data.normalIndices.push_back(normalIndex[2]);
+                data.normalIndices.push_back(normalIndex[3]);
+            }
+        }
+        // anything left on the line (comments, unsupported statements, extra values) is ignored
+        skipOBJLine(p, end);
+    }
+    return true;
+}
+
+// appends the arrays of every chunk, in order, to the arrays of data. offsets[i] is where chunk i starts in the result,
+// the prefix sum of the sizes of the chunks before it
+template<typename T>
+void mergeOBJArrays(std::vector<OBJData> & chunks, std::vector<T> OBJData::* array, OBJData & data){
+    std::vector<size_t> offsets(chunks.size() + 1, 0);
+    for (size_t i = 0; i < chunks.size(); i++)
+        offsets[i + 1] = offsets[i] + (chunks[i].*array).size();
+    (data.*array).resize(offsets.back());
+    runOBJThreads((unsigned int) chunks.size(), [&](unsigned int i){
+        std::vector<T> & chunk = chunks[i].*array;
+        if (!chunk.empty())
+            memcpy(&(data.*array)[offsets[i]], chunk.data(), chunk.size() * sizeof(T));
+        std::vector<T>().swap(chunk); // free it as soon as it is copied
+    });
+}
+
+// parses a whole file, with threadCount threads (0 uses all the cores)
+// In parallel mode the file is split in chunks that end at line boundaries, each thread parses one chunk into its own
+// arrays and then the arrays are concatenated in file order. OBJ indices are absolute (1-based in the whole file), so
+// they don't need to be changed, and the result is the same as parsing the file with a single thread.
+inline bool parseOBJMapped(const char * path, OBJData & data, unsigned int threadCount = 1){
+    OBJFileView file;
+    if( !file.open(path) ){
+        printf("Impossible to open the file ! Are you in the right path ? See Tutorial 1 for details\n");
+        getchar();
+        return false;
+    }
+
+    if (threadCount == 0)
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    // chunks smaller than 1MB are not worth a thread
+    threadCount = std::max(1u, std::min(threadCount, (unsigned int)(file.size >> 20)));
+
+    bool success;
+    if (threadCount == 1){
+        success = parseOBJRange(file.data, file.data + file.size, data);
+    }
+    else{
+        const char * end = file.data + file.size;
+        std::vector<const char *> splits(threadCount + 1, end);
+        splits[0] = file.data;
+        for (unsigned int i = 1; i < threadCount; i++){
+            // move each split point to the start of the next line
+            const char * split = std::max(splits[i - 1], file.data + file.size / threadCount * i);
+            if (split > file.data && split < end && split[-1] != '\n')
+                skipOBJLine(split, end);
+            splits[i] = split;
+        }
+
+        std::vector<OBJData> chunks(threadCount);
+        std::vector<char> chunkSuccess(threadCount);
+        runOBJThreads(threadCount, [&](unsigned int i){
+            chunkSuccess[i] = parseOBJRange(splits[i], splits[i + 1], chunks[i]);
+        });
+        success = std::find(chunkSuccess.begin(), chunkSuccess.end(), 0) == chunkSuccess.end();
+        if (success){
+            mergeOBJArrays(chunks, &OBJData::vertices, data);
+            mergeOBJArrays(chunks, &OBJData::uvs, data);
+            mergeOBJArrays(chunks, &OBJData::normals, data);
+            mergeOBJArrays(chunks, &OBJData::vertexIndices, data);
+            mergeOBJArrays(chunks, &OBJData::uvIndices, data);
+            mergeOBJArrays(chunks, &OBJData::normalIndices, data);
+        }
+    }
+
+    if (!success)
+        printf("File can't be read by our simple parser :-( Try exporting with other options\n");
+    return success;
+}
+
+// de-indexes the parsed data into one position/uv/normal per triangle corner, appended to the output arrays.
+// Vec3 and Vec2 are either float or glm vectors, both are written as plain floats. Split in threadCount ranges of corners
+template<typename Vec3, typename Vec2>
+void expandOBJData(const OBJData & data, std::vector<Vec3> & out_vertices, std::vector<Vec2> & out_uvs,
+                   std::vector<Vec3> & out_normals, unsigned int threadCount){
+    static_assert(sizeof(glm::vec3) == 3 * sizeof(float) && sizeof(glm::vec2) == 2 * sizeof(float), "glm vectors must be packed");
+    const size_t corners = data.vertexIndices.size();
+    const size_t floats3 = 3 * sizeof(float) / sizeof(Vec3), floats2 = 2 * sizeof(float) / sizeof(Vec2);
+    size_t firstVertex = out_vertices.size(), firstUv = out_uvs.size(), firstNormal = out_normals.size();
+    out_vertices.resize(firstVertex + corners * floats3);
+    out_uvs.resize(firstUv + corners * floats2);
+    out_normals.resize(firstNormal + corners * floats3);
+    float * vertices = (float *) (out_vertices.data() + firstVertex);
+    float * uvs = (float *) (out_uvs.data() + firstUv);
+    float * normals = (float *) (out_normals.data() + firstNormal);
+
+    if (threadCount == 0)
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    threadCount = std::max(1u, std::min(threadCount, (unsigned int)(corners >> 16)));
+    runOBJThreads(threadCount, [&](unsigned int t){
+        size_t begin = corners * t / threadCount, end = corners * (t + 1) / threadCount;
+        for (size_t i = begin; i < end; i++){
+            memcpy(&vertices[i * 3], &data.vertices[ (data.vertexIndices[i]-1) * 3 ], 3 * sizeof(float));
+            memcpy(&uvs[i * 2], &data.uvs[ (data.uvIndices[i]-1) * 2 ], 2 * sizeof(float));
+            memcpy(&normals[i * 3], &data.normals[ (data.normalIndices[i]-1) * 3 ], 3 * sizeof(float));
+        }
+    });
+}
+
+
+// threadCount 1 parses the file in the calling thread, 0 uses all the cores
+bool loadOBJMapped(
+        const char * path,
+        std::vector<float> & out_vertices,
+        std::vector<float> & out_uvs,
+        std::vector<float> & out_normals,
+        unsigned int threadCount = 1
+){
+    printf("Loading OBJ file %s...\n", path);
+
+    OBJData data;
+    if (!parseOBJMapped(path, data, threadCount))
+        return false;
+
+    expandOBJData(data, out_vertices, out_uvs, out_normals, threadCount);
+    return true;
+}
+
+
+// threadCount 1 parses the file in the calling thread, 0 uses all the cores
+bool loadOBJMapped(
+        const char * path,
+        std::vector<glm::vec3> & out_vertices,
+        std::vector<glm::vec2> & out_uvs,
+        std::vector<glm::vec3> & out_normals,
+        unsigned int threadCount = 1
+){
+    printf("Loading OBJ file %s...\n", path);
+
+    OBJData data;
+    if (!parseOBJMapped(path, data, threadCount))
+        return false;
+
+    expandOBJData(data, out_vertices, out_uvs, out_normals, threadCount);
+    return true;
+}
+
+
 #endif //GRAPHICSPROGRAMMINGEXERCISES_OBJLOADER_H
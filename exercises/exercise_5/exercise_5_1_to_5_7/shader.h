@@ -9,6 +9,61 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <memory>
+#include <unordered_map>
+
+// uniform setters by location, for each type of uniform
+inline void setUniform(GLint location, bool value) { glUniform1i(location, (int)value); }
+inline void setUniform(GLint location, int value) { glUniform1i(location, value); }
+inline void setUniform(GLint location, float value) { glUniform1f(location, value); }
+inline void setUniform(GLint location, const glm::vec2 &value) { glUniform2fv(location, 1, &value[0]); }
+inline void setUniform(GLint location, const glm::vec3 &value) { glUniform3fv(location, 1, &value[0]); }
+inline void setUniform(GLint location, const glm::vec4 &value) { glUniform4fv(location, 1, &value[0]); }
+inline void setUniform(GLint location, const glm::mat2 &mat) { glUniformMatrix2fv(location, 1, GL_FALSE, &mat[0][0]); }
+inline void setUniform(GLint location, const glm::mat3 &mat) { glUniformMatrix3fv(location, 1, GL_FALSE, &mat[0][0]); }
+inline void setUniform(GLint location, const glm::mat4 &mat) { glUniformMatrix4fv(location, 1, GL_FALSE, &mat[0][0]); }
+
+// the GLSL types that can be set with a C++ type. int also sets samplers
+template<typename T> struct UniformType;
+template<> struct UniformType<bool> { static bool matches(GLenum type) { return type == GL_BOOL || type == GL_INT; } };
+template<> struct UniformType<int>
+{
+    // ints, bools, and the samplers, that are all the types that are not numbers
+    static bool matches(GLenum type)
+    {
+        switch (type)
+        {
+            case GL_FLOAT: case GL_FLOAT_VEC2: case GL_FLOAT_VEC3: case GL_FLOAT_VEC4:
+            case GL_FLOAT_MAT2: case GL_FLOAT_MAT3: case GL_FLOAT_MAT4:
+            case GL_INT_VEC2: case GL_INT_VEC3: case GL_INT_VEC4:
+            case GL_BOOL_VEC2: case GL_BOOL_VEC3: case GL_BOOL_VEC4:
+            case GL_UNSIGNED_INT: case GL_DOUBLE:
+                return false;
+            default:
+                return true;
+        }
+    }
+};
+template<> struct UniformType<float> { static bool matches(GLenum type) { return type == GL_FLOAT; } };
+template<> struct UniformType<glm::vec2> { static bool matches(GLenum type) { return type == GL_FLOAT_VEC2; } };
+template<> struct UniformType<glm::vec3> { static bool matches(GLenum type) { return type == GL_FLOAT_VEC3; } };
+template<> struct UniformType<glm::vec4> { static bool matches(GLenum type) { return type == GL_FLOAT_VEC4; } };
+template<> struct UniformType<glm::mat2> { static bool matches(GLenum type) { return type == GL_FLOAT_MAT2; } };
+template<> struct UniformType<glm::mat3> { static bool matches(GLenum type) { return type == GL_FLOAT_MAT3; } };
+template<> struct UniformType<glm::mat4> { static bool matches(GLenum type) { return type == GL_FLOAT_MAT4; } };
+
+// a uniform resolved once with Shader::getUniform, setting it is a single glUniform call with no name lookup.
+// Like the setters of Shader, it sets the uniform in the program in use
+template<typename T>
+struct Uniform
+{
+    GLint location = -1;
+
+    void set(const T &value) const
+    {
+        setUniform(location, value);
+    }
+};
 
 class Shader
 {
@@ -96,6 +151,7 @@ public:
         if (geometryPath != nullptr)
             glDeleteShader(geometry);
 
+        cacheUniforms();
     }
     // activate the shader
     // ------------------------------------------------------------------------
@@ -103,66 +159,132 @@ public:
     {
         glUseProgram(ID);
     }
+    // location of a uniform, -1 if the program doesn't use it. It is looked up in the table built when the program
+    // was linked, not in the driver
+    // ------------------------------------------------------------------------
+    GLint getUniformLocation(const std::string &name) const
+    {
+        auto it = uniforms->find(name);
+        return it != uniforms->end() ? it->second.location : -1;
+    }
+    // handle to a uniform, for the uniforms set often. Reports a type that doesn't match the one in the shader
+    // ------------------------------------------------------------------------
+    template<typename T>
+    Uniform<T> getUniform(const std::string &name) const
+    {
+        Uniform<T> uniform;
+        auto it = uniforms->find(name);
+        if (it != uniforms->end())
+        {
+            if (!UniformType<T>::matches(it->second.type))
+                std::cout << "ERROR::SHADER::UNIFORM_TYPE_MISMATCH of uniform: " << name << std::endl;
+            uniform.location = it->second.location;
+        }
+        return uniform;
+    }
     // utility uniform functions
     // ------------------------------------------------------------------------
     void setBool(const std::string &name, bool value) const
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+        glUniform1i(getUniformLocation(name), (int)value);
     }
     // ------------------------------------------------------------------------
     void setInt(const std::string &name, int value) const
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+        glUniform1i(getUniformLocation(name), value);
     }
     // ------------------------------------------------------------------------
     void setFloat(const std::string &name, float value) const
     {
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+        glUniform1f(getUniformLocation(name), value);
     }
     // ------------------------------------------------------------------------
     void setVec2(const std::string &name, const glm::vec2 &value) const
     {
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform2fv(getUniformLocation(name), 1, &value[0]);
     }
     void setVec2(const std::string &name, float x, float y) const
     {
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+        glUniform2f(getUniformLocation(name), x, y);
     }
     // ------------------------------------------------------------------------
     void setVec3(const std::string &name, const glm::vec3 &value) const
     {
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform3fv(getUniformLocation(name), 1, &value[0]);
     }
     void setVec3(const std::string &name, float x, float y, float z) const
     {
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+        glUniform3f(getUniformLocation(name), x, y, z);
     }
     // ------------------------------------------------------------------------
     void setVec4(const std::string &name, const glm::vec4 &value) const
     {
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform4fv(getUniformLocation(name), 1, &value[0]);
     }
     void setVec4(const std::string &name, float x, float y, float z, float w)
     {
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+        glUniform4f(getUniformLocation(name), x, y, z, w);
     }
     // ------------------------------------------------------------------------
     void setMat2(const std::string &name, const glm::mat2 &mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix2fv(getUniformLocation(name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
     void setMat3(const std::string &name, const glm::mat3 &mat) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix3fv(getUniformLocation(name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
     void setMat4(const std::string &name, const glm::mat4 &mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix4fv(getUniformLocation(name), 1, GL_FALSE, &mat[0][0]);
     }
 
 private:
+    struct UniformInfo
+    {
+        GLint location;
+        GLenum type;
+    };
+    // shared, so copies of the shader don't copy the table
+    std::shared_ptr<std::unordered_map<std::string, UniformInfo>> uniforms;
+
+    // finds the location of every active uniform after linking. The elements of arrays are added as "name[i]", and
+    // the first one also as "name"
+    // ------------------------------------------------------------------------
+    void cacheUniforms()
+    {
+        uniforms = std::make_shared<std::unordered_map<std::string, UniformInfo>>();
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::string name(maxLength > 0 ? maxLength : 1, '\0');
+        for (GLint i = 0; i < count; i++)
+        {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(ID, (GLuint)i, maxLength, &length, &size, &type, &name[0]);
+            std::string uniformName = name.substr(0, length);
+            GLint location = glGetUniformLocation(ID, uniformName.c_str());
+            if (location < 0)
+                continue; // in a uniform block
+            (*uniforms)[uniformName] = UniformInfo{ location, type };
+            // arrays of basic types are listed once, as "name[0]"
+            if (uniformName.size() > 3 && uniformName.compare(uniformName.size() - 3, 3, "[0]") == 0)
+            {
+                std::string arrayName = uniformName.substr(0, uniformName.size() - 3);
+                (*uniforms)[arrayName] = UniformInfo{ location, type };
+                for (GLint element = 0; element < size; element++)
+                {
+                    std::string elementName = arrayName + "[" + std::to_string(element) + "]";
+                    (*uniforms)[elementName] = UniformInfo{ glGetUniformLocation(ID, elementName.c_str()), type };
+                }
+            }
+        }
+    }
+
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(GLuint shader, std::string type)
@@ -0,0 +1,323 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+// Mesh optimization pass, run when a model is imported.
+// 1. optimizeVertexCache: reorders the triangles so that the vertices they use are still in the post-transform
+//    vertex cache (Tom Forsyth, "Linear-Speed Vertex Cache Optimisation").
+// 2. optimizeOverdraw: splits that order into clusters that can be moved without hurting the cache much, and sorts the
+//    clusters so that the ones on the outside, facing away from the center, are drawn first (Sander et al., "Fast
+//    Triangle Reordering for Vertex Locality and Reduced Overdraw").
+// 3. optimizeVertexFetch: renumbers the vertices in the order they are first used, so the vertex fetches are sequential.
+// All of them work on triangle lists, an index buffer whose size is not a multiple of 3 is left unchanged.
+
+// cache statistics of an index buffer, simulated with a FIFO cache like the ones found in GPUs
+struct VertexCacheStats
+{
+    float acmr; // average cache miss ratio, vertex shader runs per triangle (0.5 is ideal for a big regular grid)
+    float atvr; // average transformed vertex ratio, vertex shader runs per vertex (1 is ideal)
+};
+
+inline VertexCacheStats analyzeVertexCache(const std::vector<unsigned int> &indices, size_t vertexCount,
+                                           unsigned int cacheSize = 16)
+{
+    std::vector<size_t> timestamps(vertexCount, 0);
+    size_t time = cacheSize + 1, misses = 0;
+    for (unsigned int index : indices)
+    {
+        // a vertex is in a FIFO cache if less than cacheSize misses happened since it was added
+        if (time - timestamps[index] > cacheSize)
+        {
+            timestamps[index] = time++;
+            misses++;
+        }
+    }
+    VertexCacheStats stats;
+    stats.acmr = indices.empty() ? 0.0f : (float)misses / (float)(indices.size() / 3);
+    stats.atvr = vertexCount == 0 ? 0.0f : (float)misses / (float)vertexCount;
+    return stats;
+}
+
+
+inline void optimizeVertexCache(std::vector<unsigned int> &indices, size_t vertexCount)
+{
+    const unsigned int cacheSize = 32;
+    const size_t triangleCount = indices.size() / 3;
+    // only triangle lists, meshes with leftover point or line indices are left as they are
+    if (triangleCount == 0 || indices.size() % 3 != 0)
+        return;
+
+    // score of a vertex from its position in the simulated LRU cache and the number of triangles that still use it
+    auto vertexScore = [cacheSize](int cachePosition, unsigned int remaining)
+    {
+        if (remaining == 0)
+            return -1.0f; // no triangle left, it doesn't matter anymore
+        float score = 0.0f;
+        if (cachePosition >= 0)
+        {
+            // the last triangle used the first 3 positions, they get a fixed score so that strips are not favored
+            score = cachePosition < 3 ? 0.75f
+                                      : std::pow(1.0f - (float)(cachePosition - 3) / (float)(cacheSize - 3), 1.5f);
+        }
+        // boost vertices with few triangles left, so they are finished and lone triangles are not left behind
+        return score + 2.0f / std::sqrt((float)remaining);
+    };
+
+    // triangles that use each vertex, the first "remaining[v]" entries of each range are not emitted yet
+    std::vector<unsigned int> remaining(vertexCount, 0), offsets(vertexCount + 1, 0);
+    for (unsigned int index : indices)
+        remaining[index]++;
+    for (size_t v = 0; v < vertexCount; v++)
+        offsets[v + 1] = offsets[v] + remaining[v];
+    std::vector<unsigned int> adjacency(indices.size()), filled(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); i++)
+        adjacency[filled[indices[i]]++] = (unsigned int)(i / 3);
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> score(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++)
+        score[v] = vertexScore(-1, remaining[v]);
+    std::vector<char> emitted(triangleCount, 0);
+    std::vector<unsigned int> result;
+    result.reserve(indices.size());
+    std::vector<unsigned int> cache, newCache;
+    cache.reserve(cacheSize + 3);
+    newCache.reserve(cacheSize + 3);
+
+    size_t nextInput = 0; // used to restart when no triangle in the cache is left
+    long long best = -1;
+    while (result.size() < triangleCount * 3)
+    {
+        if (best < 0)
+        {
+            while (nextInput < triangleCount && emitted[nextInput])
+                nextInput++;
+            if (nextInput == triangleCount)
+                break;
+            best = (long long)nextInput;
+        }
+        unsigned int triangle = (unsigned int)best;
+        const unsigned int* corners = &indices[triangle * 3];
+        emitted[triangle] = 1;
+        result.insert(result.end(), corners, corners + 3);
+
+        // remove the triangle from the lists of its vertices
+        for (int c = 0; c < 3; c++)
+        {
+            unsigned int v = corners[c];
+            unsigned int* list = &adjacency[offsets[v]];
+            for (unsigned int i = 0; i < remaining[v]; i++)
+            {
+                if (list[i] == triangle)
+                {
+                    std::swap(list[i], list[remaining[v] - 1]);
+                    break;
+                }
+            }
+            remaining[v]--;
+        }
+
+        // the vertices of the triangle go to the front of the cache
+        newCache.assign(corners, corners + 3);
+        for (unsigned int v : cache)
+        {
+            if (v != corners[0] && v != corners[1] && v != corners[2])
+                newCache.push_back(v);
+        }
+        // vertices pushed out of the cache lose their position score
+        for (size_t i = cacheSize; i < newCache.size(); i++)
+        {
+            cachePosition[newCache[i]] = -1;
+            score[newCache[i]] = vertexScore(-1, remaining[newCache[i]]);
+        }
+        if (newCache.size() > cacheSize)
+            newCache.resize(cacheSize);
+        std::swap(cache, newCache);
+
+        // update the scores of the cached vertices, and of the triangles that use them, and pick the best of those
+        for (unsigned int i = 0; i < cache.size(); i++)
+        {
+            cachePosition[cache[i]] = (int)i;
+            score[cache[i]] = vertexScore((int)i, remaining[cache[i]]);
+        }
+        best = -1;
+        float bestScore = -1.0f;
+        for (unsigned int v : cache)
+        {
+            for (unsigned int i = 0; i < remaining[v]; i++)
+            {
+                unsigned int t = adjacency[offsets[v] + i];
+                float s = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+                if (s > bestScore)
+                {
+                    bestScore = s;
+                    best = t;
+                }
+            }
+        }
+    }
+    indices.swap(result);
+}
+
+
+// needs the triangles in vertex cache order. threshold is how much worse (1.05 = 5%) the cache miss ratio of a cluster
+// can get to allow splitting it into smaller clusters, which can be sorted with more freedom
+template<typename Vertex>
+void optimizeOverdraw(std::vector<unsigned int> &indices, const std::vector<Vertex> &vertices, float threshold = 1.05f)
+{
+    const unsigned int cacheSize = 16;
+    const size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0 || indices.size() % 3 != 0)
+        return;
+
+    // cache misses of each triangle
+    std::vector<unsigned int> misses(triangleCount);
+    {
+        std::vector<size_t> timestamps(vertices.size(), 0);
+        size_t time = cacheSize + 1;
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            misses[t] = 0;
+            for (int c = 0; c < 3; c++)
+            {
+                unsigned int v = indices[t * 3 + c];
+                if (time - timestamps[v] > cacheSize)
+                {
+                    timestamps[v] = time++;
+                    misses[t]++;
+                }
+            }
+        }
+    }
+
+    // hard boundaries: triangles that miss all their vertices, where the cache starts over anyway
+    std::vector<size_t> clusters;
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        if (t == 0 || misses[t] == 3)
+            clusters.push_back(t);
+    }
+    clusters.push_back(triangleCount);
+
+    // soft boundaries: split a cluster where the triangles since the last split, drawn starting with an empty cache,
+    // already have a miss ratio close to the one of the whole cluster. Then the pieces can be drawn in any order
+    std::vector<size_t> softClusters;
+    std::vector<size_t> timestamps(vertices.size(), 0);
+    size_t time = cacheSize + 1;
+    for (size_t c = 0; c + 1 < clusters.size(); c++)
+    {
+        size_t begin = clusters[c], end = clusters[c + 1];
+        unsigned int clusterMisses = 0;
+        for (size_t t = begin; t < end; t++)
+            clusterMisses += misses[t];
+        float clusterAcmr = (float)clusterMisses / (float)(end - begin);
+
+        softClusters.push_back(begin);
+        unsigned int runningMisses = 0;
+        size_t start = begin;
+        time += cacheSize + 1; // empty the cache
+        for (size_t t = begin; t < end; t++)
+        {
+            for (int corner = 0; corner < 3; corner++)
+            {
+                unsigned int v = indices[t * 3 + corner];
+                if (time - timestamps[v] > cacheSize)
+                {
+                    timestamps[v] = time++;
+                    runningMisses++;
+                }
+            }
+            size_t count = t - start + 1;
+            if (t + 1 < end && (float)runningMisses / (float)count <= clusterAcmr * threshold)
+            {
+                softClusters.push_back(t + 1);
+                start = t + 1;
+                runningMisses = 0;
+                time += cacheSize + 1;
+            }
+        }
+    }
+    softClusters.push_back(triangleCount);
+
+    // sort key of each cluster: how much it faces away from the center of the mesh
+    glm::vec3 meshCenter(0.0f);
+    for (const Vertex &vertex : vertices)
+        meshCenter += vertex.Position;
+    meshCenter /= (float)std::max<size_t>(vertices.size(), 1);
+
+    size_t clusterCount = softClusters.size() - 1;
+    std::vector<float> sortKey(clusterCount);
+    for (size_t c = 0; c < clusterCount; c++)
+    {
+        glm::vec3 centroid(0.0f), normal(0.0f);
+        float area = 0.0f;
+        for (size_t t = softClusters[c]; t < softClusters[c + 1]; t++)
+        {
+            const glm::vec3 &p0 = vertices[indices[t * 3]].Position;
+            const glm::vec3 &p1 = vertices[indices[t * 3 + 1]].Position;
+            const glm::vec3 &p2 = vertices[indices[t * 3 + 2]].Position;
+            glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+            float triangleArea = glm::length(n);
+            centroid += (p0 + p1 + p2) * (triangleArea / 3.0f);
+            normal += n;
+            area += triangleArea;
+        }
+        centroid = area > 0.0f ? centroid / area : vertices[indices[softClusters[c] * 3]].Position;
+        float normalLength = glm::length(normal);
+        sortKey[c] = normalLength > 0.0f ? glm::dot(centroid - meshCenter, normal / normalLength) : 0.0f;
+    }
+
+    std::vector<size_t> order(clusterCount);
+    for (size_t c = 0; c < clusterCount; c++)
+        order[c] = c;
+    std::stable_sort(order.begin(), order.end(), [&sortKey](size_t a, size_t b) { return sortKey[a] > sortKey[b]; });
+
+    std::vector<unsigned int> result;
+    result.reserve(indices.size());
+    for (size_t c : order)
+        result.insert(result.end(), indices.begin() + softClusters[c] * 3, indices.begin() + softClusters[c + 1] * 3);
+    indices.swap(result);
+}
+
+
+// vertices are renumbered in the order the index buffer uses them first, unused vertices are removed
+template<typename Vertex>
+void optimizeVertexFetch(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices)
+{
+    const unsigned int unused = ~0u;
+    std::vector<unsigned int> remap(vertices.size(), unused);
+    std::vector<Vertex> result;
+    result.reserve(vertices.size());
+    for (unsigned int &index : indices)
+    {
+        if (remap[index] == unused)
+        {
+            remap[index] = (unsigned int)result.size();
+            result.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+    vertices.swap(result);
+}
+
+
+// runs the three passes and prints the cache statistics before and after
+template<typename Vertex>
+void optimizeMesh(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices)
+{
+    VertexCacheStats before = analyzeVertexCache(indices, vertices.size());
+    optimizeVertexCache(indices, vertices.size());
+    optimizeOverdraw(indices, vertices);
+    optimizeVertexFetch(vertices, indices);
+    VertexCacheStats after = analyzeVertexCache(indices, vertices.size());
+    printf("Optimized mesh (%zu triangles): ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n",
+           indices.size() / 3, before.acmr, after.acmr, before.atvr, after.atvr);
+}
+
+#endif
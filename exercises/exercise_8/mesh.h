@@ -8,6 +8,7 @@
 
 #include <shader.h>
 
+#include <algorithm>
 #include <string>
 #include <fstream>
 #include <sstream>
@@ -55,33 +56,9 @@ public:
     }
 
     // render the mesh
-    void Draw(Shader shader)
+    void Draw(const Shader &shader)
     {
-        // bind appropriate textures
-        unsigned int diffuseNr  = 1;
-        unsigned int specularNr = 1;
-        unsigned int normalNr   = 1;
-        unsigned int ambientNr   = 1;
-        for(unsigned int i = 0; i < textures.size(); i++)
-        {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
-            // retrieve texture number (the N in diffuse_textureN)
-            string number;
-            string name = textures[i].type;
-            if(name == "texture_diffuse")
-                number = std::to_string(diffuseNr++);
-            else if(name == "texture_specular")
-                number = std::to_string(specularNr++); // transfer unsigned int to stream
-            else if(name == "texture_normal")
-                number = std::to_string(normalNr++); // transfer unsigned int to stream
-            else if(name == "texture_ambient")
-                number = std::to_string(ambientNr++); // transfer unsigned int to stream
-
-            // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
-        }
+        bindTextures(shader);
 
         // draw mesh
         glBindVertexArray(VAO);
@@ -93,6 +70,55 @@ public:
     }
 
 private:
+    // texture unit of each texture. Every mesh uses the same units: the first texture of each type uses units 0 to 3
+    // (texture_diffuse1, texture_specular1, texture_normal1, texture_ambient1), the next ones units 8 and up, clear
+    // of the units the exercises use for their other textures
+    vector<unsigned int> textureUnits;
+    // the shaders whose samplers have been set to those units
+    vector<unsigned int> samplerShaders;
+
+    // binds the textures to their units. The samplers of a shader are set the first time the mesh is drawn with it,
+    // and they keep their value because all the meshes use the same units
+    void bindTextures(const Shader &shader)
+    {
+        if (std::find(samplerShaders.begin(), samplerShaders.end(), shader.ID) == samplerShaders.end())
+        {
+            setSamplers(shader);
+            samplerShaders.push_back(shader.ID);
+        }
+        for(unsigned int i = 0; i < textures.size(); i++)
+        {
+            glActiveTexture(GL_TEXTURE0 + textureUnits[i]); // active proper texture unit before binding
+            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+        }
+    }
+
+    // finds the unit and the sampler of each texture, and sets the samplers of the shader in use to the units
+    void setSamplers(const Shader &shader)
+    {
+        static const char* types[4] = { "texture_diffuse", "texture_specular", "texture_normal", "texture_ambient" };
+        unsigned int typeCount[4] = { 0, 0, 0, 0 };
+        textureUnits.resize(textures.size());
+        for(unsigned int i = 0; i < textures.size(); i++)
+        {
+            // retrieve texture number (the N in diffuse_textureN)
+            string name = textures[i].type;
+            unsigned int type = 0;
+            while (type < 4 && name != types[type])
+                type++;
+            if (type < 4)
+            {
+                unsigned int number = ++typeCount[type];
+                name += std::to_string(number);
+                textureUnits[i] = number == 1 ? type : 8 + (number - 2) * 4 + type;
+            }
+            else
+                textureUnits[i] = 4; // not a sampler of the exercise shaders
+            // now set the sampler to the texture unit
+            glUniform1i(shader.getUniformLocation(name), textureUnits[i]);
+        }
+    }
+
     /*  Render data  */
     unsigned int VBO, EBO;
 
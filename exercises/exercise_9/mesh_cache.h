@@ -0,0 +1,338 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define MESH_CACHE_HAS_MMAP
+#else
+#include <sys/stat.h>
+#endif
+
+// Binary mesh cache.
+// After a model is imported, its meshes are written to a single file that can be memory mapped on the next runs, so
+// the vertex and index data can be given to the GPU straight from the mapping, without parsing or copying it.
+//
+// File layout, every section starts at a multiple of 16 bytes:
+//   MeshCacheHeader
+//   MeshCacheAttribute[attributeCount]   vertex layout the file was written with
+//   MeshCacheMesh[meshCount]
+//   MeshCacheTexture[textureCount]       textures of all meshes, each mesh references a range
+//   vertex and index data of every mesh
+// The file is only used if its version, source hash and vertex layout match the current ones, otherwise it is rebuilt.
+
+const uint32_t MESH_CACHE_MAGIC = 0x4843534D; // "MSCH"
+const uint32_t MESH_CACHE_VERSION = 3; // 2: meshes are stored after optimizeMesh, 3: the source hash covers the content
+
+struct MeshCacheHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t sourceHash;
+    uint32_t vertexStride;
+    uint32_t attributeCount;
+    uint32_t meshCount;
+    uint32_t textureCount;
+};
+
+// one vertex attribute, as it is passed to glVertexAttribPointer (all attributes are floats)
+struct MeshCacheAttribute
+{
+    uint32_t location;
+    uint32_t components;
+    uint32_t offset;
+    uint32_t padding;
+};
+
+struct MeshCacheMesh
+{
+    uint64_t vertexOffset; // in bytes from the start of the file
+    uint64_t indexOffset;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t firstTexture;
+    uint32_t textureCount;
+    float boundsMin[3];
+    float boundsMax[3];
+};
+
+struct MeshCacheTexture
+{
+    char type[32];  // sampler name prefix, like texture_diffuse
+    char path[224]; // relative to the model directory
+};
+
+// what the writer needs to know about each mesh
+struct MeshCacheSource
+{
+    const void* vertices;
+    uint32_t vertexCount;
+    const unsigned int* indices;
+    uint32_t indexCount;
+    float boundsMin[3];
+    float boundsMax[3];
+    std::vector<MeshCacheTexture> textures;
+};
+
+
+// 64-bit seek and tell, fseek and ftell take a long, which is 32 bits on Windows
+inline int seekMeshCacheFile(FILE* file, uint64_t offset, int origin)
+{
+#ifdef _WIN32
+    return _fseeki64(file, (__int64)offset, origin);
+#else
+    return fseeko(file, (off_t)offset, origin);
+#endif
+}
+
+inline uint64_t tellMeshCacheFile(FILE* file)
+{
+#ifdef _WIN32
+    return (uint64_t)_ftelli64(file);
+#else
+    return (uint64_t)ftello(file);
+#endif
+}
+
+// identifies the version of the source file that a cache was built from, by hashing its content. The size and the
+// modification time are not enough: copying or checking out a file can keep both while the content changes. Reading
+// the file is still much cheaper than importing it. FNV-1a over 8-byte words, the shift carries the high bits of each
+// step down, the multiply alone only moves bits up
+inline uint64_t meshCacheSourceHash(const std::string &path)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == NULL)
+        return 0;
+    uint64_t hash = 14695981039346656037ull;
+    uint64_t size = 0;
+    std::vector<unsigned char> chunk(1 << 20);
+    size_t count;
+    while ((count = fread(chunk.data(), 1, chunk.size(), file)) > 0)
+    {
+        // the last word of the file is padded with zeros, the size below tells it apart from real zeros
+        size_t padded = (count + 7) & ~(size_t)7;
+        memset(chunk.data() + count, 0, padded - count);
+        for (size_t i = 0; i < padded; i += 8)
+        {
+            uint64_t word;
+            memcpy(&word, chunk.data() + i, sizeof(word));
+            hash = (hash ^ word) * 1099511628211ull;
+            hash ^= hash >> 32;
+        }
+        size += count;
+    }
+    bool failed = ferror(file) != 0;
+    fclose(file);
+    if (failed)
+        return 0;
+    hash = (hash ^ size) * 1099511628211ull;
+    hash = (hash ^ MESH_CACHE_VERSION) * 1099511628211ull;
+    return hash != 0 ? hash : 1; // 0 means no hash
+}
+
+inline uint64_t alignMeshCacheOffset(uint64_t offset)
+{
+    return (offset + 15) & ~(uint64_t)15;
+}
+
+
+// read-only mapping of a cache file
+class MeshCache
+{
+public:
+    MeshCache() = default;
+    MeshCache(const MeshCache&) = delete;
+    MeshCache& operator=(const MeshCache&) = delete;
+
+    ~MeshCache()
+    {
+        close();
+    }
+
+    // maps the file and checks that it was built from the given source with the given vertex layout
+    bool open(const std::string &cachePath, uint64_t sourceHash, uint32_t vertexStride,
+              const std::vector<MeshCacheAttribute> &attributes)
+    {
+        close();
+        if (!map(cachePath))
+            return false;
+
+        const MeshCacheHeader* h = header();
+        bool valid = size >= sizeof(MeshCacheHeader) && h->magic == MESH_CACHE_MAGIC &&
+                     h->version == MESH_CACHE_VERSION && h->sourceHash == sourceHash &&
+                     h->vertexStride == vertexStride && h->attributeCount == attributes.size() &&
+                     dataOffset() <= size;
+        if (valid)
+            valid = memcmp(data + attributesOffset(), attributes.data(), attributes.size() * sizeof(MeshCacheAttribute)) == 0;
+        for (uint32_t i = 0; valid && i < h->meshCount; i++)
+        {
+            const MeshCacheMesh &m = mesh(i);
+            valid = m.vertexOffset + (uint64_t)m.vertexCount * vertexStride <= size &&
+                    m.indexOffset + (uint64_t)m.indexCount * sizeof(unsigned int) <= size &&
+                    m.firstTexture + m.textureCount <= h->textureCount;
+        }
+        if (!valid)
+            close();
+        return valid;
+    }
+
+    uint32_t meshCount() const { return header()->meshCount; }
+    const MeshCacheMesh& mesh(uint32_t i) const
+    {
+        return ((const MeshCacheMesh*)(data + meshesOffset()))[i];
+    }
+    const MeshCacheTexture& texture(uint32_t i) const
+    {
+        return ((const MeshCacheTexture*)(data + texturesOffset()))[i];
+    }
+    const void* vertices(const MeshCacheMesh &m) const { return data + m.vertexOffset; }
+    const unsigned int* indices(const MeshCacheMesh &m) const { return (const unsigned int*)(data + m.indexOffset); }
+
+    // writes a new cache file, returns false if it could not be written
+    static bool write(const std::string &cachePath, uint64_t sourceHash, uint32_t vertexStride,
+                      const std::vector<MeshCacheAttribute> &attributes, const std::vector<MeshCacheSource> &meshes)
+    {
+        MeshCacheHeader h = {};
+        h.magic = MESH_CACHE_MAGIC;
+        h.version = MESH_CACHE_VERSION;
+        h.sourceHash = sourceHash;
+        h.vertexStride = vertexStride;
+        h.attributeCount = (uint32_t)attributes.size();
+        h.meshCount = (uint32_t)meshes.size();
+
+        std::vector<MeshCacheMesh> records(meshes.size());
+        std::vector<MeshCacheTexture> textures;
+        for (const MeshCacheSource &source : meshes)
+            h.textureCount += (uint32_t)source.textures.size();
+
+        // place the data of each mesh after the tables
+        uint64_t offset = layoutEnd(h);
+        for (size_t i = 0; i < meshes.size(); i++)
+        {
+            MeshCacheMesh &m = records[i];
+            m.vertexCount = meshes[i].vertexCount;
+            m.indexCount = meshes[i].indexCount;
+            m.vertexOffset = offset;
+            offset = alignMeshCacheOffset(offset + (uint64_t)m.vertexCount * vertexStride);
+            m.indexOffset = offset;
+            offset = alignMeshCacheOffset(offset + (uint64_t)m.indexCount * sizeof(unsigned int));
+            m.firstTexture = (uint32_t)textures.size();
+            m.textureCount = (uint32_t)meshes[i].textures.size();
+            memcpy(m.boundsMin, meshes[i].boundsMin, sizeof(m.boundsMin));
+            memcpy(m.boundsMax, meshes[i].boundsMax, sizeof(m.boundsMax));
+            textures.insert(textures.end(), meshes[i].textures.begin(), meshes[i].textures.end());
+        }
+
+        // write to a temporary file and rename it, so that a crash never leaves a broken cache behind
+        std::string tempPath = cachePath + ".tmp";
+        FILE* file = fopen(tempPath.c_str(), "wb");
+        if (file == NULL)
+            return false;
+        bool success = writeAt(file, 0, &h, sizeof(h)) &&
+                       writeAt(file, attributesOffset(), attributes.data(), attributes.size() * sizeof(MeshCacheAttribute)) &&
+                       writeAt(file, meshesOffset(h), records.data(), records.size() * sizeof(MeshCacheMesh)) &&
+                       writeAt(file, texturesOffset(h), textures.data(), textures.size() * sizeof(MeshCacheTexture));
+        for (size_t i = 0; success && i < meshes.size(); i++)
+        {
+            success = writeAt(file, records[i].vertexOffset, meshes[i].vertices, (size_t)records[i].vertexCount * vertexStride) &&
+                      writeAt(file, records[i].indexOffset, meshes[i].indices, records[i].indexCount * sizeof(unsigned int));
+        }
+        success = fclose(file) == 0 && success;
+        if (success)
+        {
+            remove(cachePath.c_str()); // rename does not replace existing files on every platform
+            success = rename(tempPath.c_str(), cachePath.c_str()) == 0;
+        }
+        if (!success)
+            remove(tempPath.c_str());
+        return success;
+    }
+
+private:
+    const char* data = nullptr;
+    size_t size = 0;
+#ifndef MESH_CACHE_HAS_MMAP
+    std::vector<char> buffer;
+#endif
+
+    const MeshCacheHeader* header() const { return (const MeshCacheHeader*)data; }
+
+    static uint64_t attributesOffset() { return alignMeshCacheOffset(sizeof(MeshCacheHeader)); }
+    static uint64_t meshesOffset(const MeshCacheHeader &h)
+    {
+        return alignMeshCacheOffset(attributesOffset() + h.attributeCount * sizeof(MeshCacheAttribute));
+    }
+    static uint64_t texturesOffset(const MeshCacheHeader &h)
+    {
+        return alignMeshCacheOffset(meshesOffset(h) + h.meshCount * sizeof(MeshCacheMesh));
+    }
+    static uint64_t layoutEnd(const MeshCacheHeader &h)
+    {
+        return alignMeshCacheOffset(texturesOffset(h) + h.textureCount * sizeof(MeshCacheTexture));
+    }
+    uint64_t meshesOffset() const { return meshesOffset(*header()); }
+    uint64_t texturesOffset() const { return texturesOffset(*header()); }
+    uint64_t dataOffset() const { return layoutEnd(*header()); }
+
+    static bool writeAt(FILE* file, uint64_t offset, const void* bytes, size_t count)
+    {
+        if (count == 0)
+            return true;
+        return seekMeshCacheFile(file, offset, SEEK_SET) == 0 && fwrite(bytes, 1, count, file) == count;
+    }
+
+    bool map(const std::string &path)
+    {
+#ifdef MESH_CACHE_HAS_MMAP
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(MeshCacheHeader))
+        {
+            ::close(fd);
+            return false;
+        }
+        void* mapped = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd); // the mapping stays valid after closing the file
+        if (mapped == MAP_FAILED)
+            return false;
+        data = (const char*)mapped;
+        size = (size_t)info.st_size;
+        return true;
+#else
+        FILE* file = fopen(path.c_str(), "rb");
+        if (file == NULL)
+            return false;
+        seekMeshCacheFile(file, 0, SEEK_END);
+        buffer.resize((size_t)tellMeshCacheFile(file));
+        seekMeshCacheFile(file, 0, SEEK_SET);
+        size = fread(buffer.data(), 1, buffer.size(), file);
+        fclose(file);
+        data = buffer.data();
+        return size >= sizeof(MeshCacheHeader);
+#endif
+    }
+
+    void close()
+    {
+#ifdef MESH_CACHE_HAS_MMAP
+        if (data != nullptr)
+            munmap((void*)data, size);
+#else
+        buffer.clear();
+#endif
+        data = nullptr;
+        size = 0;
+    }
+};
+
+#endif
@@ -0,0 +1,193 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <glad/glad.h>
+
+#include <unordered_map>
+
+// Shadow copy of the OpenGL state that the passes change.
+// The functions have the same parameters as the GL calls they replace, and only make the call when the value is
+// different from the one that was set last, so a pass can set all the state it needs without checking what the
+// previous pass left. Everything that changes this state has to go through GLState: a direct GL call makes the copy
+// wrong, and then Invalidate has to be called. The state starts unknown, so the first call of each one is made.
+class GLState
+{
+public:
+    // calls made and calls skipped, for the frame in progress and for the last one
+    struct Stats
+    {
+        unsigned int calls = 0;
+        unsigned int elided = 0;
+    };
+    Stats frame, lastFrame;
+
+    static GLState& Get()
+    {
+        static GLState state;
+        return state;
+    }
+
+    GLState(const GLState&) = delete;
+    GLState& operator=(const GLState&) = delete;
+
+    // forgets the state, after GL calls made outside of GLState
+    void Invalidate()
+    {
+        capabilities.clear();
+        blendSource = blendDestination = depthFunction = cullFaceMode = -1;
+        depthMask = -1;
+        program = vertexArray = drawFramebuffer = readFramebuffer = -1;
+        activeTexture = -1;
+        for (unsigned int unit = 0; unit < MAX_TEXTURE_UNITS; unit++)
+            textures2D[unit] = texturesCube[unit] = -1;
+    }
+
+    // once per frame, keeps the counters of the frame in lastFrame
+    void EndFrame()
+    {
+        lastFrame = frame;
+        frame = Stats();
+    }
+
+    void Enable(GLenum capability)
+    {
+        if (change(capabilityState(capability), 1))
+            glEnable(capability);
+    }
+
+    void Disable(GLenum capability)
+    {
+        if (change(capabilityState(capability), 0))
+            glDisable(capability);
+    }
+
+    void BlendFunc(GLenum source, GLenum destination)
+    {
+        if (blendSource == (GLint)source && blendDestination == (GLint)destination)
+        {
+            frame.elided++;
+            return;
+        }
+        blendSource = (GLint)source;
+        blendDestination = (GLint)destination;
+        frame.calls++;
+        glBlendFunc(source, destination);
+    }
+
+    void DepthFunc(GLenum function)
+    {
+        if (change(depthFunction, (GLint)function))
+            glDepthFunc(function);
+    }
+
+    void DepthMask(bool write)
+    {
+        if (change(depthMask, write ? 1 : 0))
+            glDepthMask(write);
+    }
+
+    void CullFace(GLenum mode)
+    {
+        if (change(cullFaceMode, (GLint)mode))
+            glCullFace(mode);
+    }
+
+    void UseProgram(GLuint id)
+    {
+        if (change(program, (GLint)id))
+            glUseProgram(id);
+    }
+
+    void BindVertexArray(GLuint id)
+    {
+        if (change(vertexArray, (GLint)id))
+            glBindVertexArray(id);
+    }
+
+    // GL_FRAMEBUFFER binds both the draw and the read framebuffer
+    void BindFramebuffer(GLenum target, GLuint id)
+    {
+        bool draw = target == GL_FRAMEBUFFER || target == GL_DRAW_FRAMEBUFFER;
+        bool read = target == GL_FRAMEBUFFER || target == GL_READ_FRAMEBUFFER;
+        if ((!draw || drawFramebuffer == (GLint)id) && (!read || readFramebuffer == (GLint)id))
+        {
+            frame.elided++;
+            return;
+        }
+        if (draw)
+            drawFramebuffer = (GLint)id;
+        if (read)
+            readFramebuffer = (GLint)id;
+        frame.calls++;
+        glBindFramebuffer(target, id);
+    }
+
+    void ActiveTexture(GLenum unit)
+    {
+        if (change(activeTexture, (GLint)(unit - GL_TEXTURE0)))
+            glActiveTexture(unit);
+    }
+
+    // binds the texture to the active unit. Only 2D and cube map textures are tracked, other targets are always bound
+    void BindTexture(GLenum target, GLuint id)
+    {
+        GLint *binding = textureBinding(target);
+        if (binding == nullptr)
+        {
+            frame.calls++;
+            glBindTexture(target, id);
+            return;
+        }
+        if (change(*binding, (GLint)id))
+            glBindTexture(target, id);
+    }
+
+private:
+    static const unsigned int MAX_TEXTURE_UNITS = 32;
+
+    // -1 is unknown
+    std::unordered_map<GLenum, GLint> capabilities;
+    GLint blendSource, blendDestination, depthFunction, cullFaceMode, depthMask;
+    GLint program, vertexArray, drawFramebuffer, readFramebuffer;
+    GLint activeTexture;
+    GLint textures2D[MAX_TEXTURE_UNITS], texturesCube[MAX_TEXTURE_UNITS];
+
+    GLState()
+    {
+        Invalidate();
+    }
+
+    // sets the copy of a value, returns false and counts the call as elided when it is already set
+    bool change(GLint &current, GLint value)
+    {
+        if (current == value)
+        {
+            frame.elided++;
+            return false;
+        }
+        current = value;
+        frame.calls++;
+        return true;
+    }
+
+    GLint& capabilityState(GLenum capability)
+    {
+        auto it = capabilities.find(capability);
+        if (it == capabilities.end())
+            it = capabilities.emplace(capability, -1).first;
+        return it->second;
+    }
+
+    GLint* textureBinding(GLenum target)
+    {
+        if (activeTexture < 0 || activeTexture >= (GLint)MAX_TEXTURE_UNITS)
+            return nullptr;
+        if (target == GL_TEXTURE_2D)
+            return &textures2D[activeTexture];
+        if (target == GL_TEXTURE_CUBE_MAP)
+            return &texturesCube[activeTexture];
+        return nullptr;
+    }
+};
+
+#endif
@@ -7,6 +7,8 @@
 #include "shader.h"
 #include "camera.h"
 #include "model.h"
+#include "render_queue.h"
+#include "scene_graph.h"
 
 #include "imgui.h"
 #include "imgui_impl_glfw.h"
@@ -43,6 +45,23 @@ Shader* bloom_shader;
 Shader* celshading_shader;
 Shader* outline_shader;
 
+// uniforms set for every light, resolved once when the shaders are loaded
+struct LightUniforms
+{
+    Uniform<glm::mat4> model;
+    Uniform<glm::mat4> viewProjection;
+    Uniform<glm::vec3> lightPosition;
+    Uniform<glm::vec3> lightColor;
+    Uniform<float> lightRadius;
+    Uniform<glm::mat4> lightSpaceMatrix;
+    Uniform<int> shadowMap;
+};
+LightUniforms lightUniforms; // lighting_shader
+
+// the objects of the shadow map and geometry passes, built once per frame
+RenderQueue renderQueue;
+unsigned int deferredQueueShader, shadowMapQueueShader;
+
 // models
 Model* carBodyModel;
 Model* carPaintModel;
@@ -58,6 +77,11 @@ GLuint carWindowsTexture;
 GLuint carWheelTexture;
 GLuint floorTexture;
 
+// placement of the models. The car parts are children of the car node, so moving the car moves all of them
+SceneGraph sceneGraph;
+SceneGraph::NodeId carNode, carPaintNode, carBodyNode, carLightNode, carInteriorNode, floorNode;
+SceneGraph::NodeId carWheelNodes[4];
+
 Camera camera(glm::vec3(0.0f, 1.6f, 5.0f));
 glm::mat4 view;
 glm::mat4 projection;
@@ -125,6 +149,9 @@ struct Config
     float roughness = 0.25f;
     float metalness = 0.0f;
 
+    // rotation of the car around the vertical axis, in degrees
+    float carRotation = 0.0f;
+
 
     //TODO 9.1 9.2 9.4 9.5 and 9.6 : Add configuration values
     // hdr
@@ -167,7 +194,9 @@ void drawCube();
 void drawQuad();
 void drawSkybox();
 void drawShadowMap();
-void drawObjects();
+void buildRenderQueue();
+bool isBoxVisible(const glm::mat4 &viewProjection, glm::vec3 boundsMin, glm::vec3 boundsMax);
+void drawObjects(RenderPass pass);
 void drawGui();
 void drawDeferredLight(Light& light);
 void drawFullscreenPass(const char* sourceTextureName, GLuint sourceTexture);
@@ -175,6 +204,7 @@ void drawFullscreenPass(const char* sourceTextureName, GLuint sourceTexture);
 unsigned int initSkyboxBuffers();
 unsigned int loadCubemap(vector<std::string> faces);
 void createShadowMap();
+void buildSceneGraph();
 
 void prepareGeometryPass();
 void restoreGeometryPass();
@@ -238,6 +268,16 @@ int main()
     celshading_shader = new Shader("shaders/fullscreen.vert", "shaders/celshading.frag");
     outline_shader = new Shader("shaders/fullscreen.vert", "shaders/outline.frag");
 
+    deferredQueueShader = renderQueue.AddShader(deferred_shader);
+    shadowMapQueueShader = renderQueue.AddShader(shadowMap_shader);
+    lightUniforms.model = lighting_shader->getUniform<glm::mat4>("model");
+    lightUniforms.viewProjection = lighting_shader->getUniform<glm::mat4>("viewProjection");
+    lightUniforms.lightPosition = lighting_shader->getUniform<glm::vec3>("lightPosition");
+    lightUniforms.lightColor = lighting_shader->getUniform<glm::vec3>("lightColor");
+    lightUniforms.lightRadius = lighting_shader->getUniform<float>("lightRadius");
+    lightUniforms.lightSpaceMatrix = lighting_shader->getUniform<glm::mat4>("lightSpaceMatrix");
+    lightUniforms.shadowMap = lighting_shader->getUniform<int>("ShadowMap");
+
 
     // load the 3D models
     // ----------------------------------
@@ -248,6 +288,7 @@ int main()
     carWindowsModel = new Model("car/Windows_LOD0.obj");
     carWheelModel = new Model("car/Wheel_LOD0.obj");
     floorModel = new Model("floor/floor.obj");
+    buildSceneGraph();
 
     // init skybox
     vector<std::string> faces
@@ -267,8 +308,8 @@ int main()
     // set up the z-buffer
     // -------------------
     glDepthRange(-1,1); // make the NDC a right handed coordinate system, with the camera pointing towards -z
-    glEnable(GL_DEPTH_TEST); // turn on z-buffer depth test
-    glDepthFunc(GL_LESS); // draws fragments that are closer to the screen in NDC
+    GLState::Get().Enable(GL_DEPTH_TEST); // turn on z-buffer depth test
+    GLState::Get().DepthFunc(GL_LESS); // draws fragments that are closer to the screen in NDC
 
     //set up gbuffers
     initFrameBuffers(window);
@@ -303,12 +344,14 @@ int main()
 
         updateCameraMatrices();
 
+        buildRenderQueue();
+
         drawShadowMap();
 
         // Enable SRGB framebuffer
-        glEnable(GL_FRAMEBUFFER_SRGB);
+        GLState::Get().Enable(GL_FRAMEBUFFER_SRGB);
 
-        glBindFramebuffer(GL_FRAMEBUFFER, accumBuffer);
+        GLState::Get().BindFramebuffer(GL_FRAMEBUFFER, accumBuffer);
         glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT);
 
@@ -317,15 +360,15 @@ int main()
             shader = deferred_shader;
             shader->use();
 
-            glBindFramebuffer(GL_FRAMEBUFFER, gBuffer);
+            GLState::Get().BindFramebuffer(GL_FRAMEBUFFER, gBuffer);
 
             prepareGeometryPass();
 
-            drawObjects();
+            drawObjects(RenderPass::GEOMETRY);
 
             restoreGeometryPass();
 
-            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            GLState::Get().BindFramebuffer(GL_FRAMEBUFFER, 0);
         }
 
         // 2. lighting pass: calculate lighting using the gbuffer's content
@@ -333,7 +376,7 @@ int main()
             shader = lighting_shader;
             shader->use();
 
-            glBindFramebuffer(GL_FRAMEBUFFER, accumBuffer);
+            GLState::Get().BindFramebuffer(GL_FRAMEBUFFER, accumBuffer);
 
             prepareDeferredPass();
 
@@ -350,7 +393,7 @@ int main()
             // NEW! Draw skybox at the end, so we only process those fragments that are in the background
             drawSkybox();
 
-            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            GLState::Get().BindFramebuffer(GL_FRAMEBUFFER, 0);
         }
 
         // Final pass, render accumulation buffer
@@ -362,14 +405,14 @@ int main()
                 shader = bloom_shader;
                 shader->use();
 
-                glBindFramebuffer(GL_FRAMEBUFFER, tempBuffers[0]);
+                GLState::Get().BindFramebuffer(GL_FRAMEBUFFER, tempBuffers[0]);
 
                 shader->setFloat("threshold", config.bloomThreshold);
                 shader->setFloat("scale", config.bloomScale);
                 shader->setFloat("maxIntensity", config.bloomMax);
                 drawFullscreenPass("SourceTexture", gAccum);
 
-                glBindFramebuffer(GL_FRAMEBUFFER, 0);
+                GLState::Get().BindFramebuffer(GL_FRAMEBUFFER, 0);
             }
 
             //TODO 9.3 : Blur passes
@@ -382,16 +425,16 @@ int main()
                 glfwGetFramebufferSize(window, &width, &height);
 
                 // Horizontal blur pass
-                glBindFramebuffer(GL_FRAMEBUFFER, tempBuffers[1]);
+                GLState::Get().BindFramebuffer(GL_FRAMEBUFFER, tempBuffers[1]);
                 shader->setVec2("blurScale", glm::vec2(1.0f / width, 0.0f));
                 drawFullscreenPass("SourceTexture", tempTextures[0]);
 
                 // Vertical blur pass
-                glBindFramebuffer(GL_FRAMEBUFFER, tempBuffers[0]);
+                GLState::Get().BindFramebuffer(GL_FRAMEBUFFER, tempBuffers[0]);
                 shader->setVec2("blurScale", glm::vec2(0, 1.0f / height));
                 drawFullscreenPass("SourceTexture", tempTextures[1]);
 
-                glBindFramebuffer(GL_FRAMEBUFFER, 0);
+                GLState::Get().BindFramebuffer(GL_FRAMEBUFFER, 0);
             }
 
             //TODO 9.1 : Composition pass
@@ -401,8 +444,8 @@ int main()
                 shader->use();
 
                 //TODO 9.4 : Add tempTextures[0] as GL_TEXTURE1 and pass it as "BloomTexture"
-                glActiveTexture(GL_TEXTURE1);
-                glBindTexture(GL_TEXTURE_2D, tempTextures[0]);
+                GLState::Get().ActiveTexture(GL_TEXTURE1);
+                GLState::Get().BindTexture(GL_TEXTURE_2D, tempTextures[0]);
                 shader->setInt("BloomTexture", 1);
 
                 //TODO 9.1 : Add the exposure uniform
@@ -441,10 +484,10 @@ int main()
                 shader->setVec3("outlineColor", config.outlineColor);
                 shader->setFloat("distance", config.outlineDistance);
 
-                glEnable(GL_BLEND);
-                glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+                GLState::Get().Enable(GL_BLEND);
+                GLState::Get().BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
                 drawFullscreenPass("SourceTexture", gDepth);
-                glDisable(GL_BLEND);
+                GLState::Get().Disable(GL_BLEND);
             }
         }
         else
@@ -456,7 +499,7 @@ int main()
         }
 
         // Disable SRGB framebuffer
-        glDisable(GL_FRAMEBUFFER_SRGB);
+        GLState::Get().Disable(GL_FRAMEBUFFER_SRGB);
 
         if (isPaused) {
             drawGui();
@@ -464,6 +507,9 @@ int main()
 
         glfwSwapBuffers(window);
         glfwPollEvents();
+
+        // counters of the state calls made and elided in this frame, shown in the GUI
+        GLState::Get().EndFrame();
     }
 
     // Cleanup
@@ -527,6 +573,7 @@ void drawGui(){
         ImGui::ColorEdit3("color", (float*)&config.reflectionColor);
         ImGui::SliderFloat("roughness", &config.roughness, 0.01f, 1.0f);
         ImGui::SliderFloat("metalness", &config.metalness, 0.0f, 1.0f);
+        ImGui::SliderFloat("car rotation", &config.carRotation, -180.0f, 180.0f);
         ImGui::Separator();
 
         ImGui::Text("Post-processing: ");
@@ -554,6 +601,11 @@ void drawGui(){
             if (ImGui::RadioButton("No PostFX", postFXMode == PostFXMode::None)) { postFXMode = PostFXMode::None; }
         }
 
+        ImGui::Text("Draw calls: %u (%u in submission order)", renderQueue.executed.drawCalls, renderQueue.submitted.drawCalls);
+        ImGui::Text("State changes: %u (%u in submission order)", renderQueue.executed.stateChanges(), renderQueue.submitted.stateChanges());
+        ImGui::Text("World transforms updated: %u of %u", sceneGraph.stats.updated, sceneGraph.stats.nodes);
+        ImGui::Text("GL state calls: %u made, %u elided", GLState::Get().lastFrame.calls, GLState::Get().lastFrame.elided);
+
         ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
         ImGui::End();
     }
@@ -569,8 +621,8 @@ void prepareGeometryPass()
 
     // set up skybox texture
     shader->setInt("skybox", 5);
-    glActiveTexture(GL_TEXTURE5);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
+    GLState::Get().ActiveTexture(GL_TEXTURE5);
+    GLState::Get().BindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
 
     shader->setMat4("view", view);
     shader->setMat4("viewProjection", viewProjection);
@@ -579,23 +631,23 @@ void prepareGeometryPass()
 
 void restoreGeometryPass()
 {
-    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    GLState::Get().BindTexture(GL_TEXTURE_CUBE_MAP, 0);
 }
 
 void prepareDeferredPass()
 {
     // Bind g-buffers as textures
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, gAlbedo);
+    GLState::Get().ActiveTexture(GL_TEXTURE0);
+    GLState::Get().BindTexture(GL_TEXTURE_2D, gAlbedo);
     shader->setInt("AlbedoGBuffer", 0);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, gNormal);
+    GLState::Get().ActiveTexture(GL_TEXTURE1);
+    GLState::Get().BindTexture(GL_TEXTURE_2D, gNormal);
     shader->setInt("NormalGBuffer", 1);
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, gOthers);
+    GLState::Get().ActiveTexture(GL_TEXTURE2);
+    GLState::Get().BindTexture(GL_TEXTURE_2D, gOthers);
     shader->setInt("OthersGBuffer", 2);
-    glActiveTexture(GL_TEXTURE3);
-    glBindTexture(GL_TEXTURE_2D, gDepth);
+    GLState::Get().ActiveTexture(GL_TEXTURE3);
+    GLState::Get().BindTexture(GL_TEXTURE_2D, gDepth);
     shader->setInt("DepthBuffer", 3);
 
     // Set view projection for all lights
@@ -604,33 +656,33 @@ void prepareDeferredPass()
     shader->setMat4("invProjection", glm::inverse(projection));
 
     // Render additional lights in additive
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_ONE, GL_ONE);
+    GLState::Get().Enable(GL_BLEND);
+    GLState::Get().BlendFunc(GL_ONE, GL_ONE);
 
     // Depth clamp ignores clipping with near and far planes
-    glEnable(GL_DEPTH_CLAMP);
+    GLState::Get().Enable(GL_DEPTH_CLAMP);
 
     // Render only the back faces of the box
-    glEnable(GL_CULL_FACE);
-    glCullFace(GL_FRONT);
+    GLState::Get().Enable(GL_CULL_FACE);
+    GLState::Get().CullFace(GL_FRONT);
 
     // Disable depth write
-    glDepthMask(false);
+    GLState::Get().DepthMask(false);
 
     // Disable depth test
-    glDisable(GL_DEPTH_TEST);
+    GLState::Get().Disable(GL_DEPTH_TEST);
 }
 
 void restoreDeferredPass()
 {
     // Restore values
-    glDisable(GL_BLEND);
-    glBlendFunc(GL_ONE, GL_ZERO);
-    glDisable(GL_DEPTH_CLAMP);
-    glCullFace(GL_BACK);
-    glDisable(GL_CULL_FACE);
-    glDepthMask(true);
-    glEnable(GL_DEPTH_TEST);
+    GLState::Get().Disable(GL_BLEND);
+    GLState::Get().BlendFunc(GL_ONE, GL_ZERO);
+    GLState::Get().Disable(GL_DEPTH_CLAMP);
+    GLState::Get().CullFace(GL_BACK);
+    GLState::Get().Disable(GL_CULL_FACE);
+    GLState::Get().DepthMask(true);
+    GLState::Get().Enable(GL_DEPTH_TEST);
 }
 
 void drawDeferredLight(Light& light)
@@ -641,8 +693,8 @@ void drawDeferredLight(Light& light)
     {
         // The quad is already in clip space
         glm::mat4 identity(1.0f);
-        shader->setMat4("model", identity);
-        shader->setMat4("viewProjection", identity);
+        lightUniforms.model.set(identity);
+        lightUniforms.viewProjection.set(identity);
 
         // Directional lights render a quad
         drawQuad();
@@ -651,8 +703,8 @@ void drawDeferredLight(Light& light)
     {
         // The model is positioned at the center of the light, with a size equal to the radius
         glm::mat4 model = glm::translate(glm::mat4(1.0f), light.position) * glm::scale(glm::mat4(1.0f), glm::vec3(light.radius));
-        shader->setMat4("model", model);
-        shader->setMat4("viewProjection", viewProjection);
+        lightUniforms.model.set(model);
+        lightUniforms.viewProjection.set(viewProjection);
 
         // Positional lights render a cube
         drawCube();
@@ -661,15 +713,15 @@ void drawDeferredLight(Light& light)
 
 void drawFullscreenPass(const char* sourceTextureName, GLuint sourceTexture)
 {
-    glDisable(GL_DEPTH_TEST);
+    GLState::Get().Disable(GL_DEPTH_TEST);
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, sourceTexture);
+    GLState::Get().ActiveTexture(GL_TEXTURE0);
+    GLState::Get().BindTexture(GL_TEXTURE_2D, sourceTexture);
     shader->setInt(sourceTextureName, 0);
 
     drawQuad();
 
-    glEnable(GL_DEPTH_TEST);
+    GLState::Get().Enable(GL_DEPTH_TEST);
 }
 
 void initFrameBuffers(GLFWwindow* window)
@@ -677,28 +729,28 @@ void initFrameBuffers(GLFWwindow* window)
     // configure g-buffer framebuffer
     // ------------------------------
     glGenFramebuffers(1, &gBuffer);
-    glBindFramebuffer(GL_FRAMEBUFFER, gBuffer);
+    GLState::Get().BindFramebuffer(GL_FRAMEBUFFER, gBuffer);
 
     int width, height;
     glfwGetFramebufferSize(window, &width, &height);
 
     // albedo color buffer
     glGenTextures(1, &gAlbedo);
-    glBindTexture(GL_TEXTURE_2D, gAlbedo);
+    GLState::Get().BindTexture(GL_TEXTURE_2D, gAlbedo);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 
     // normal color buffer
     glGenTextures(1, &gNormal);
-    glBindTexture(GL_TEXTURE_2D, gNormal);
+    GLState::Get().BindTexture(GL_TEXTURE_2D, gNormal);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, width, height, 0, GL_RG, GL_FLOAT, NULL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 
     // others color buffer
     glGenTextures(1, &gOthers);
-    glBindTexture(GL_TEXTURE_2D, gOthers);
+    GLState::Get().BindTexture(GL_TEXTURE_2D, gOthers);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB8_ALPHA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
@@ -706,14 +758,14 @@ void initFrameBuffers(GLFWwindow* window)
     // accumulation buffer
     // TODO 9.1 : Change the format of the accumulation buffer to 16bit floating point (4 components)
     glGenTextures(1, &gAccum);
-    glBindTexture(GL_TEXTURE_2D, gAccum);
+    GLState::Get().BindTexture(GL_TEXTURE_2D, gAccum);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
     // depth texture buffer
     glGenTextures(1, &gDepth);
-    glBindTexture(GL_TEXTURE_2D, gDepth);
+    GLState::Get().BindTexture(GL_TEXTURE_2D, gDepth);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -737,12 +789,12 @@ void initFrameBuffers(GLFWwindow* window)
     // configure accumulation buffer framebuffer
     // ------------------------------
     glGenFramebuffers(1, &accumBuffer);
-    glBindFramebuffer(GL_FRAMEBUFFER, accumBuffer);
+    GLState::Get().BindFramebuffer(GL_FRAMEBUFFER, accumBuffer);
 
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, gAccum, 0);
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, gDepth, 0);
 
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    GLState::Get().BindFramebuffer(GL_FRAMEBUFFER, 0);
 
 
     // TODO 9.3 : Generate 2 frame buffers (variable tempBuffers) and 2 textures (variable tempTextures)
@@ -752,17 +804,17 @@ void initFrameBuffers(GLFWwindow* window)
     for (int i = 0; i < 2; ++i)
     {
         // TODO 9.3 : Bind and configure temp textures with the same format as the accumulation buffer
-        glBindTexture(GL_TEXTURE_2D, tempTextures[i]);
+        GLState::Get().BindTexture(GL_TEXTURE_2D, tempTextures[i]);
         glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
         // TODO 9.3 : Bind temp framebuffers and attach the corresponding temp texture as color attachment 0
-        glBindFramebuffer(GL_FRAMEBUFFER, tempBuffers[i]);
+        GLState::Get().BindFramebuffer(GL_FRAMEBUFFER, tempBuffers[i]);
         glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tempTextures[i], 0);
     }
 
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    GLState::Get().BindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
 void setLightUniforms(Light& light, Camera* viewSpace)
@@ -783,17 +835,17 @@ void setLightUniforms(Light& light, Camera* viewSpace)
     }
 
     // light uniforms
-    shader->setVec3("lightPosition", position);
-    shader->setVec3("lightColor", light.color * light.intensity * glm::pi<float>());
-    shader->setFloat("lightRadius", light.radius);
+    lightUniforms.lightPosition.set(position);
+    lightUniforms.lightColor.set(light.color * light.intensity * glm::pi<float>());
+    lightUniforms.lightRadius.set(light.radius);
 
     // shadow uniforms
     if (light.shadow)
     {
-        shader->setMat4("lightSpaceMatrix", shadowMatrix);
-        shader->setInt("ShadowMap", 5);
-        glActiveTexture(GL_TEXTURE5);
-        glBindTexture(GL_TEXTURE_2D, shadowMap);
+        lightUniforms.lightSpaceMatrix.set(shadowMatrix);
+        lightUniforms.shadowMap.set(5);
+        GLState::Get().ActiveTexture(GL_TEXTURE5);
+        GLState::Get().BindTexture(GL_TEXTURE_2D, shadowMap);
         //shader->setFloat("shadowBias", config.shadowBias * 0.01f);
     }
 }
@@ -862,7 +914,7 @@ unsigned int initSkyboxBuffers() {
     glGenVertexArrays(1, &skyboxVAO);
     glGenBuffers(1, &skyboxVBO);
 
-    glBindVertexArray(skyboxVAO);
+    GLState::Get().BindVertexArray(skyboxVAO);
     glBindBuffer(GL_ARRAY_BUFFER, skyboxVBO);
 
     glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), &skyboxVertices, GL_STATIC_DRAW);
@@ -885,7 +937,7 @@ unsigned int loadCubemap(vector<std::string> faces)
 {
     unsigned int textureID;
     glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+    GLState::Get().BindTexture(GL_TEXTURE_CUBE_MAP, textureID);
 
     int width, height, nrComponents;
     for (unsigned int i = 0; i < faces.size(); i++)
@@ -910,7 +962,7 @@ unsigned int loadCubemap(vector<std::string> faces)
 
     glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
 
-    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    GLState::Get().BindTexture(GL_TEXTURE_CUBE_MAP, 0);
 
     return textureID;
 }
@@ -933,7 +985,7 @@ void drawQuad()
         // setup plane VAO
         glGenVertexArrays(1, &quadVAO);
         glGenBuffers(1, &quadVBO);
-        glBindVertexArray(quadVAO);
+        GLState::Get().BindVertexArray(quadVAO);
         glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
         glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
         glEnableVertexAttribArray(0);
@@ -941,9 +993,9 @@ void drawQuad()
         glEnableVertexAttribArray(1);
         glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
     }
-    glBindVertexArray(quadVAO);
+    GLState::Get().BindVertexArray(quadVAO);
     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-    glBindVertexArray(0);
+    GLState::Get().BindVertexArray(0);
 }
 
 // drawCube() renders a 3D cube.
@@ -1004,7 +1056,7 @@ void drawCube()
         glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
         glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
         // link vertex attributes
-        glBindVertexArray(cubeVAO);
+        GLState::Get().BindVertexArray(cubeVAO);
         glEnableVertexAttribArray(0);
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
         glEnableVertexAttribArray(1);
@@ -1012,19 +1064,19 @@ void drawCube()
         glEnableVertexAttribArray(2);
         glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
         glBindBuffer(GL_ARRAY_BUFFER, 0);
-        glBindVertexArray(0);
+        GLState::Get().BindVertexArray(0);
     }
     // render Cube
-    glBindVertexArray(cubeVAO);
+    GLState::Get().BindVertexArray(cubeVAO);
     glDrawArrays(GL_TRIANGLES, 0, 36);
-    glBindVertexArray(0);
+    GLState::Get().BindVertexArray(0);
 }
 
 
 void drawSkybox()
 {
     // render skybox
-    glDepthFunc(GL_LEQUAL);  // change depth function so depth test passes when values are equal to depth buffer's content
+    GLState::Get().DepthFunc(GL_LEQUAL);  // change depth function so depth test passes when values are equal to depth buffer's content
     skybox_shader->use();
     glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
     glm::mat4 view = camera.GetViewMatrix();
@@ -1033,12 +1085,12 @@ void drawSkybox()
     skybox_shader->setInt("skybox", 0);
 
     // skybox cube
-    glBindVertexArray(skyboxVAO);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
+    GLState::Get().BindVertexArray(skyboxVAO);
+    GLState::Get().ActiveTexture(GL_TEXTURE0);
+    GLState::Get().BindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
     glDrawArrays(GL_TRIANGLES, 0, 36);
-    glBindVertexArray(0);
-    glDepthFunc(GL_LESS); // set depth function back to default
+    GLState::Get().BindVertexArray(0);
+    GLState::Get().DepthFunc(GL_LESS); // set depth function back to default
 }
 
 
@@ -1046,7 +1098,7 @@ void createShadowMap()
 {
     // create depth texture
     glGenTextures(1, &shadowMap);
-    glBindTexture(GL_TEXTURE_2D, shadowMap);
+    GLState::Get().BindTexture(GL_TEXTURE_2D, shadowMap);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR); // if you replace GL_LINEAR with GL_NEAREST you will see pixelation in the borders of the shadow
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR); // if you replace GL_LINEAR with GL_NEAREST you will see pixelation in the borders of the shadow
@@ -1057,11 +1109,11 @@ void createShadowMap()
 
     // attach depth texture as FBO's depth buffer
     glGenFramebuffers(1, &shadowMapFBO);
-    glBindFramebuffer(GL_FRAMEBUFFER, shadowMapFBO);
+    GLState::Get().BindFramebuffer(GL_FRAMEBUFFER, shadowMapFBO);
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, shadowMap, 0);
     glDrawBuffer(GL_NONE);
     glReadBuffer(GL_NONE);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    GLState::Get().BindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
 
@@ -1093,83 +1145,117 @@ void drawShadowMap()
     glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
 
     // bind our depth texture to the frame buffer
-    glBindFramebuffer(GL_FRAMEBUFFER, shadowMapFBO);
+    GLState::Get().BindFramebuffer(GL_FRAMEBUFFER, shadowMapFBO);
 
     // clear the depth texture/depth buffer
     glClear(GL_DEPTH_BUFFER_BIT);
 
     // draw scene from the light's perspective into the depth texture
-    drawObjects();
+    drawObjects(RenderPass::SHADOW);
 
     // unbind the depth texture from the frame buffer, now we can render to the screen (frame buffer) again
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    GLState::Get().BindFramebuffer(GL_FRAMEBUFFER, 0);
 
     glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
 
     shader = currShader;
 }
 
-void drawObjects()
+// adds the car parts and the floor to the scene graph, once the models are loaded
+void buildSceneGraph()
+{
+    carNode = sceneGraph.AddNode(SceneGraph::ROOT);
+    carPaintNode = sceneGraph.AddNode(carNode, glm::mat4(1.0f), carPaintModel);
+    carBodyNode = sceneGraph.AddNode(carNode, glm::mat4(1.0f), carBodyModel);
+    carLightNode = sceneGraph.AddNode(carNode, glm::mat4(1.0f), carLightModel);
+    carInteriorNode = sceneGraph.AddNode(carNode, glm::mat4(1.0f), carInteriorModel);
+
+    // wheels
+    glm::mat4 wheels[4];
+    wheels[0] = glm::translate(glm::mat4(1.0f), glm::vec3(-.7432f, .328f, 1.39f));
+    wheels[1] = glm::translate(glm::mat4(1.0f), glm::vec3(-.7432f, .328f, -1.28f));
+    wheels[2] = glm::rotate(glm::mat4(1.0f), glm::pi<float>(), glm::vec3(0.0, 1.0, 0.0));
+    wheels[2] = glm::translate(wheels[2], glm::vec3(-.7432f, .328f, 1.28f));
+    wheels[3] = glm::rotate(glm::mat4(1.0f), glm::pi<float>(), glm::vec3(0.0, 1.0, 0.0));
+    wheels[3] = glm::translate(wheels[3], glm::vec3(-.7432f, .328f, -1.39f));
+    for (unsigned int i = 0; i < 4; i++)
+        carWheelNodes[i] = sceneGraph.AddNode(carNode, wheels[i], carWheelModel);
+
+    floorNode = sceneGraph.AddNode(SceneGraph::ROOT, glm::scale(glm::mat4(1.0), glm::vec3(5.f, 5.f, 5.f)), floorModel);
+}
+
+// submits the objects to the render queue, for the shadow map and the geometry pass
+void buildRenderQueue()
 {
-    // the typical transformation uniforms are already set for you, these are:
-    // model (for each model part we draw)
+    renderQueue.Clear();
 
     // material uniforms for car paint
-    shader->setVec3("reflectionColor", config.reflectionColor);
-    shader->setFloat("roughness", config.roughness);
-    shader->setFloat("metalness", config.metalness);
-    shader->setVec4("texCoordTransform", glm::vec4(1,1,0,0));    
+    unsigned int carPaint = renderQueue.AddMaterial({ config.reflectionColor, config.roughness, config.metalness, glm::vec4(1, 1, 0, 0) });
+    // material uniforms for other car parts (hardcoded)
+    unsigned int carParts = renderQueue.AddMaterial({ glm::vec3(1.0f, 1.0f, 1.0f), 0.35f, 0.0f, glm::vec4(1, 1, 0, 0) });
+    unsigned int floor = renderQueue.AddMaterial({ glm::vec3(1.0f, 1.0f, 1.0f), 0.9f, 0.0f, glm::vec4(4.0f, 4.0f, 0, 0) });
 
-    glm::mat4 model = glm::mat4(1.0f);
-    shader->setMat4("model", model);
-    carPaintModel->Draw(*shader);
+    // only the nodes under the car are updated when it turns, and nothing when it doesn't
+    static float carRotation = 0.0f;
+    if (config.carRotation != carRotation)
+    {
+        carRotation = config.carRotation;
+        sceneGraph.SetLocal(carNode, glm::rotate(glm::mat4(1.0f), glm::radians(carRotation), glm::vec3(0.0f, 1.0f, 0.0f)));
+    }
+    sceneGraph.Update();
 
-    // material uniforms for other car parts (hardcoded)
-    shader->setVec3("reflectionColor", 1.0f, 1.0f, 1.0f);
-    shader->setFloat("roughness", 0.35f);
-    shader->setFloat("metalness", 0.0f);
-
-    carBodyModel->Draw(*shader);
-
-    // draw car
-    shader->setMat4("model", model);
-    carLightModel->Draw(*shader);
-    carInteriorModel->Draw(*shader);
-
-    // draw wheel
-    model = glm::translate(glm::mat4(1.0f), glm::vec3(-.7432f, .328f, 1.39f));
-    shader->setMat4("model", model);
-    carWheelModel->Draw(*shader);
-
-    // draw wheel
-    model = glm::translate(glm::mat4(1.0f), glm::vec3(-.7432f, .328f, -1.28f));
-    shader->setMat4("model", model);
-    carWheelModel->Draw(*shader);
-
-    // draw wheel
-    model = glm::rotate(glm::mat4(1.0f), glm::pi<float>(), glm::vec3(0.0, 1.0, 0.0));
-    model = glm::translate(model, glm::vec3(-.7432f, .328f, 1.28f));
-    shader->setMat4("model", model);
-    carWheelModel->Draw(*shader);
-
-    // draw wheel
-    model = glm::rotate(glm::mat4(1.0f), glm::pi<float>(), glm::vec3(0.0, 1.0, 0.0));
-    model = glm::translate(model, glm::vec3(-.7432f, .328f, -1.39f));
-    shader->setMat4("model", model);
-    carWheelModel->Draw(*shader);
-
-    // draw floor
-    model = glm::scale(glm::mat4(1.0), glm::vec3(5.f, 5.f, 5.f));
-    shader->setMat4("model", model);
-    shader->setFloat("roughness", 0.9f);
-    shader->setVec4("texCoordTransform", glm::vec4(4.0f, 4.0f, 0, 0));
-    floorModel->Draw(*shader);
-    shader->setVec4("texCoordTransform", glm::vec4(1, 1, 0, 0));
-
-    shader->setFloat("roughness", 0.05f);
-    model = glm::mat4(1.0f);
-    shader->setMat4("model", model);
-    //carWindowsModel->Draw(*shader);
+    // the same objects in both passes, the shadow map doesn't use the materials
+    const RenderPass passes[2] = { RenderPass::SHADOW, RenderPass::GEOMETRY };
+    for (RenderPass pass : passes)
+    {
+        unsigned int queueShader = pass == RenderPass::SHADOW ? shadowMapQueueShader : deferredQueueShader;
+        // the bounds of the car node hold all its parts, a car out of the view skips them all in the geometry pass
+        if (pass == RenderPass::SHADOW ||
+            isBoxVisible(viewProjection, sceneGraph.SubtreeBoundsMin(carNode), sceneGraph.SubtreeBoundsMax(carNode)))
+        {
+            renderQueue.Submit(pass, queueShader, carPaint, *carPaintModel, sceneGraph.World(carPaintNode), camera.Position);
+            renderQueue.Submit(pass, queueShader, carParts, *carBodyModel, sceneGraph.World(carBodyNode), camera.Position);
+            renderQueue.Submit(pass, queueShader, carParts, *carLightModel, sceneGraph.World(carLightNode), camera.Position);
+            renderQueue.Submit(pass, queueShader, carParts, *carInteriorModel, sceneGraph.World(carInteriorNode), camera.Position);
+            for (SceneGraph::NodeId wheel : carWheelNodes)
+                renderQueue.Submit(pass, queueShader, carParts, *carWheelModel, sceneGraph.World(wheel), camera.Position);
+        }
+        renderQueue.Submit(pass, queueShader, floor, *floorModel, sceneGraph.World(floorNode), camera.Position);
+    }
+
+    renderQueue.Sort();
+}
+
+// false when the 8 corners of the box are all outside the same plane of the view volume
+bool isBoxVisible(const glm::mat4 &viewProjection, glm::vec3 boundsMin, glm::vec3 boundsMax)
+{
+    if (boundsMin.x > boundsMax.x)
+        return false; // empty bounds
+    glm::vec4 corners[8];
+    for (int i = 0; i < 8; i++)
+    {
+        glm::vec3 corner((i & 1) ? boundsMax.x : boundsMin.x, (i & 2) ? boundsMax.y : boundsMin.y, (i & 4) ? boundsMax.z : boundsMin.z);
+        corners[i] = viewProjection * glm::vec4(corner, 1.0f);
+    }
+    // -w <= x, y, z <= w inside the view volume
+    for (int axis = 0; axis < 3; axis++)
+    {
+        bool allBelow = true, allAbove = true;
+        for (const glm::vec4 &corner : corners)
+        {
+            allBelow = allBelow && corner[axis] < -corner.w;
+            allAbove = allAbove && corner[axis] > corner.w;
+        }
+        if (allBelow || allAbove)
+            return false;
+    }
+    return true;
+}
+
+// draws the objects of the pass, with the shader the pass was submitted with
+void drawObjects(RenderPass pass)
+{
+    renderQueue.Execute(pass);
 }
 
 
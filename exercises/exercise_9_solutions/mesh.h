@@ -8,11 +8,13 @@
 
 #include <shader.h>
 
+#include <algorithm>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <vector>
+#include <limits>
 using namespace std;
 
 struct Vertex {
@@ -41,6 +43,9 @@ public:
     vector<unsigned int> indices;
     vector<Texture> textures;
     unsigned int VAO;
+    unsigned int indexCount;
+    // axis aligned bounding box of the vertex positions
+    glm::vec3 boundsMin, boundsMax;
 
     /*  Functions  */
     // constructor
@@ -50,71 +55,131 @@ public:
         this->indices = indices;
         this->textures = textures;
 
+        boundsMin = glm::vec3(std::numeric_limits<float>::max());
+        boundsMax = glm::vec3(-std::numeric_limits<float>::max());
+        for (const Vertex &vertex : this->vertices)
+        {
+            boundsMin = glm::min(boundsMin, vertex.Position);
+            boundsMax = glm::max(boundsMax, vertex.Position);
+        }
+
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
-        setupMesh();
+        setupMesh(this->vertices.data(), this->vertices.size(), this->indices.data(), this->indices.size());
+    }
+
+    // constructor for data that is already in memory, like a mapped mesh cache. The data is uploaded from the given
+    // arrays and no copy is kept on the CPU, so the vertices and indices vectors stay empty
+    Mesh(const Vertex* vertexData, size_t vertexCount, const unsigned int* indexData, size_t indexCount,
+         vector<Texture> textures, glm::vec3 boundsMin, glm::vec3 boundsMax)
+    {
+        this->textures = textures;
+        this->boundsMin = boundsMin;
+        this->boundsMax = boundsMax;
+        setupMesh(vertexData, vertexCount, indexData, indexCount);
     }
 
     // render the mesh
-    void Draw(Shader shader)
+    void Draw(const Shader &shader)
     {
-        // bind appropriate textures
-        unsigned int diffuseNr  = 1;
-        unsigned int specularNr = 1;
-        unsigned int normalNr   = 1;
-        unsigned int ambientNr   = 1;
-        for(unsigned int i = 0; i < textures.size(); i++)
-        {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
-            // retrieve texture number (the N in diffuse_textureN)
-            string number;
-            string name = textures[i].type;
-            if(name == "texture_diffuse")
-                number = std::to_string(diffuseNr++);
-            else if(name == "texture_specular")
-                number = std::to_string(specularNr++); // transfer unsigned int to stream
-            else if(name == "texture_normal")
-                number = std::to_string(normalNr++); // transfer unsigned int to stream
-            else if(name == "texture_ambient")
-                number = std::to_string(ambientNr++); // transfer unsigned int to stream
-
-            // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
-        }
+        bindTextures(shader);
 
         // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, (int)indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
+        GLState::Get().BindVertexArray(VAO);
+        glDrawElements(GL_TRIANGLES, (int)indexCount, GL_UNSIGNED_INT, 0);
+        GLState::Get().BindVertexArray(0);
 
         // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
+        GLState::Get().ActiveTexture(GL_TEXTURE0);
+    }
+
+    // binds the textures and the vertex array, so the mesh can be drawn several times with DrawInstances. Used by the
+    // render queue, that skips it when the previous draw used the same mesh
+    void Bind(const Shader &shader)
+    {
+        bindTextures(shader);
+        GLState::Get().BindVertexArray(VAO);
+    }
+
+    // draws the mesh bound with Bind, instanceCount times
+    void DrawInstances(int instanceCount) const
+    {
+        glDrawElementsInstanced(GL_TRIANGLES, (int)indexCount, GL_UNSIGNED_INT, 0, instanceCount);
     }
 
 private:
+    // texture unit of each texture. Every mesh uses the same units: the first texture of each type uses units 0 to 3
+    // (texture_diffuse1, texture_specular1, texture_normal1, texture_ambient1), the next ones units 8 and up, clear
+    // of the units the exercises use for their other textures
+    vector<unsigned int> textureUnits;
+    // the shaders whose samplers have been set to those units
+    vector<unsigned int> samplerShaders;
+
+    // binds the textures to their units. The samplers of a shader are set the first time the mesh is drawn with it,
+    // and they keep their value because all the meshes use the same units
+    void bindTextures(const Shader &shader)
+    {
+        if (std::find(samplerShaders.begin(), samplerShaders.end(), shader.ID) == samplerShaders.end())
+        {
+            setSamplers(shader);
+            samplerShaders.push_back(shader.ID);
+        }
+        for(unsigned int i = 0; i < textures.size(); i++)
+        {
+            GLState::Get().ActiveTexture(GL_TEXTURE0 + textureUnits[i]); // active proper texture unit before binding
+            GLState::Get().BindTexture(GL_TEXTURE_2D, textures[i].id);
+        }
+    }
+
+    // finds the unit and the sampler of each texture, and sets the samplers of the shader in use to the units
+    void setSamplers(const Shader &shader)
+    {
+        static const char* types[4] = { "texture_diffuse", "texture_specular", "texture_normal", "texture_ambient" };
+        unsigned int typeCount[4] = { 0, 0, 0, 0 };
+        textureUnits.resize(textures.size());
+        for(unsigned int i = 0; i < textures.size(); i++)
+        {
+            // retrieve texture number (the N in diffuse_textureN)
+            string name = textures[i].type;
+            unsigned int type = 0;
+            while (type < 4 && name != types[type])
+                type++;
+            if (type < 4)
+            {
+                unsigned int number = ++typeCount[type];
+                name += std::to_string(number);
+                textureUnits[i] = number == 1 ? type : 8 + (number - 2) * 4 + type;
+            }
+            else
+                textureUnits[i] = 4; // not a sampler of the exercise shaders
+            // now set the sampler to the texture unit
+            glUniform1i(shader.getUniformLocation(name), textureUnits[i]);
+        }
+    }
+
     /*  Render data  */
     unsigned int VBO, EBO;
 
     /*  Functions    */
     // initializes all the buffer objects/arrays
-    void setupMesh()
+    void setupMesh(const Vertex* vertexData, size_t vertexCount, const unsigned int* indexData, size_t indexCount)
     {
+        this->indexCount = (unsigned int)indexCount;
+
         // create buffers/arrays
         glGenVertexArrays(1, &VAO);
         glGenBuffers(1, &VBO);
         glGenBuffers(1, &EBO);
 
-        glBindVertexArray(VAO);
+        GLState::Get().BindVertexArray(VAO);
         // load data into vertex buffers
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
         // A great thing about structs is that their memory layout is sequential for all its items.
         // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
         // again translates to 3/2 floats which translates to a byte array.
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+        glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(Vertex), vertexData, GL_STATIC_DRAW);
 
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(unsigned int), indexData, GL_STATIC_DRAW);
 
         // set the vertex attribute pointers
         // vertex Positions
@@ -133,7 +198,7 @@ private:
         glEnableVertexAttribArray(4);
         glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
 
-        glBindVertexArray(0);
+        GLState::Get().BindVertexArray(0);
     }
 };
 #endif
\ No newline at end of file
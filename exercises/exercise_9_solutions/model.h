@@ -13,6 +13,8 @@
 
 #include <mesh.h>
 #include <shader.h>
+#include "mesh_cache.h"
+#include "mesh_optimizer.h"
 
 #include <string>
 #include <fstream>
@@ -41,7 +43,7 @@ public:
     }
 
     // draws the model, and thus all its meshes
-    void Draw(Shader shader)
+    void Draw(const Shader &shader)
     {
         for(unsigned int i = 0; i < meshes.size(); i++)
             meshes[i].Draw(shader);
@@ -50,8 +52,18 @@ public:
 private:
     /*  Functions   */
     // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
+    // The meshes are also written to a binary cache next to the model file (path + ".meshcache"), that is used instead
+    // of ASSIMP on the next runs, as long as the model file does not change.
     void loadModel(string const &path)
     {
+        // retrieve the directory path of the filepath
+        directory = path.substr(0, path.find_last_of('/'));
+
+        string cachePath = path + ".meshcache";
+        uint64_t sourceHash = meshCacheSourceHash(path);
+        if (sourceHash != 0 && loadFromCache(cachePath, sourceHash))
+            return;
+
         // read file via ASSIMP
         Assimp::Importer importer;
         const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
@@ -61,11 +73,74 @@ private:
             cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
             return;
         }
-        // retrieve the directory path of the filepath
-        directory = path.substr(0, path.find_last_of('/'));
 
         // process ASSIMP's root node recursively
         processNode(scene->mRootNode, scene);
+
+        if (sourceHash != 0 && !writeCache(cachePath, sourceHash))
+            cout << "WARNING::MESH_CACHE:: could not write " << cachePath << endl;
+    }
+
+    // layout of Vertex, as set in Mesh::setupMesh, stored in the cache to detect files written with another layout
+    static vector<MeshCacheAttribute> vertexLayout()
+    {
+        return {
+            {0, 3, (uint32_t)offsetof(Vertex, Position), 0},
+            {1, 3, (uint32_t)offsetof(Vertex, Normal), 0},
+            {2, 2, (uint32_t)offsetof(Vertex, TexCoords), 0},
+            {3, 3, (uint32_t)offsetof(Vertex, Tangent), 0},
+            {4, 3, (uint32_t)offsetof(Vertex, Bitangent), 0}
+        };
+    }
+
+    // creates the meshes from a mapped cache file, the vertex data goes to the GPU without being copied or parsed
+    bool loadFromCache(string const &cachePath, uint64_t sourceHash)
+    {
+        MeshCache cache;
+        if (!cache.open(cachePath, sourceHash, sizeof(Vertex), vertexLayout()))
+            return false;
+
+        for (uint32_t i = 0; i < cache.meshCount(); i++)
+        {
+            const MeshCacheMesh &m = cache.mesh(i);
+            vector<Texture> textures;
+            for (uint32_t t = m.firstTexture; t < m.firstTexture + m.textureCount; t++)
+            {
+                const MeshCacheTexture &texture = cache.texture(t);
+                string typeName = texture.type;
+                textures.push_back(loadTexture(texture.path, typeName, typeName == "texture_diffuse"));
+            }
+            meshes.push_back(Mesh((const Vertex*)cache.vertices(m), m.vertexCount, cache.indices(m), m.indexCount, textures,
+                                  glm::vec3(m.boundsMin[0], m.boundsMin[1], m.boundsMin[2]),
+                                  glm::vec3(m.boundsMax[0], m.boundsMax[1], m.boundsMax[2])));
+        }
+        return true;
+    }
+
+    bool writeCache(string const &cachePath, uint64_t sourceHash)
+    {
+        vector<MeshCacheSource> sources(meshes.size());
+        for (unsigned int i = 0; i < meshes.size(); i++)
+        {
+            const Mesh &mesh = meshes[i];
+            MeshCacheSource &source = sources[i];
+            source.vertices = mesh.vertices.data();
+            source.vertexCount = (uint32_t)mesh.vertices.size();
+            source.indices = mesh.indices.data();
+            source.indexCount = (uint32_t)mesh.indices.size();
+            memcpy(source.boundsMin, &mesh.boundsMin, sizeof(source.boundsMin));
+            memcpy(source.boundsMax, &mesh.boundsMax, sizeof(source.boundsMax));
+            for (const Texture &texture : mesh.textures)
+            {
+                MeshCacheTexture entry = {};
+                if (texture.type.size() >= sizeof(entry.type) || texture.path.size() >= sizeof(entry.path))
+                    return false; // does not fit, keep loading this model with ASSIMP
+                strcpy(entry.type, texture.type.c_str());
+                strcpy(entry.path, texture.path.c_str());
+                source.textures.push_back(entry);
+            }
+        }
+        return MeshCache::write(cachePath, sourceHash, sizeof(Vertex), vertexLayout(), sources);
     }
 
     // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
@@ -163,6 +238,9 @@ private:
         std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_ambient");
         textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
 
+        // reorder triangles and vertices for the vertex cache and overdraw, the cache stores the optimized order
+        optimizeMesh(vertices, indices);
+
         // return a mesh object created from the extracted mesh data
         return Mesh(vertices, indices, textures);
     }
@@ -176,29 +254,28 @@ private:
         {
             aiString str;
             mat->GetTexture(type, i, &str);
-            // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            bool skip = false;
-            for(unsigned int j = 0; j < textures_loaded.size(); j++)
-            {
-                if(std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-                {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                    break;
-                }
-            }
-            if(!skip)
-            {   // if texture hasn't been loaded already, load it
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory, type == aiTextureType_DIFFUSE);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
-            }
+            textures.push_back(loadTexture(str.C_Str(), typeName, type == aiTextureType_DIFFUSE));
         }
         return textures;
     }
+
+    // loads a texture of the model, unless it was loaded before
+    Texture loadTexture(const char *path, string const &typeName, bool gamma)
+    {
+        // check if texture was loaded before and if so, return it: skip loading a new texture
+        for(unsigned int j = 0; j < textures_loaded.size(); j++)
+        {
+            if(std::strcmp(textures_loaded[j].path.data(), path) == 0)
+                return textures_loaded[j]; // a texture with the same filepath has already been loaded (optimization)
+        }
+        // if texture hasn't been loaded already, load it
+        Texture texture;
+        texture.id = TextureFromFile(path, this->directory, gamma);
+        texture.type = typeName;
+        texture.path = path;
+        textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
+        return texture;
+    }
 };
 
 
@@ -228,7 +305,7 @@ unsigned int TextureFromFile(const char *path, const string &directory, bool gam
             internalFormat = gamma ? GL_SRGB_ALPHA : format;
         }
 
-        glBindTexture(GL_TEXTURE_2D, textureID);
+        GLState::Get().BindTexture(GL_TEXTURE_2D, textureID);
         glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, GL_UNSIGNED_BYTE, data);
         glGenerateMipmap(GL_TEXTURE_2D);
 
@@ -0,0 +1,281 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "mesh.h"
+#include "model.h"
+#include "shader.h"
+
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+// Render queue.
+// The objects are not drawn in the order they are submitted: each mesh to draw is an item with a 64 bit key, and the
+// items are sorted by key before they are drawn. From the most significant bits to the least:
+//   pass (4 bits) | shader (8 bits) | material (12 bits) | mesh (16 bits) | depth (24 bits)
+// so the items of a pass are drawn together, grouped by shader, then by material, then by mesh, and front to back
+// inside each group. Drawing them in that order, the program, the material uniforms and the mesh are only changed
+// when they differ from the previous item, and consecutive items with the same mesh and material become a single
+// instanced draw, with the model matrices of the instances in the models[] array of the shader.
+
+// size of the models[] array of the shaders, the instances of a batch are split in draws of this many
+const unsigned int MAX_DRAW_INSTANCES = 32;
+
+enum class RenderPass : unsigned int
+{
+    SHADOW = 0,
+    GEOMETRY = 1
+};
+
+// the uniforms of an object that are not its transform
+struct Material
+{
+    glm::vec3 reflectionColor;
+    float roughness;
+    float metalness;
+    glm::vec4 texCoordTransform;
+};
+
+class RenderQueue
+{
+public:
+    // draw calls and state changes of a frame. The submitted counts are the ones of drawing each item in the order it
+    // was submitted, setting the material when it changes, like the objects were drawn before the queue
+    struct Stats
+    {
+        unsigned int drawCalls = 0;
+        unsigned int shaderChanges = 0;
+        unsigned int materialChanges = 0;
+        unsigned int meshBinds = 0;
+
+        unsigned int stateChanges() const { return shaderChanges + materialChanges + meshBinds; }
+    };
+    Stats submitted, executed;
+
+    // registers a shader that draws objects, it must have the models[] array and the material uniforms
+    unsigned int AddShader(Shader *shader)
+    {
+        ShaderEntry entry;
+        entry.shader = shader;
+        entry.models = shader->getUniformLocation("models");
+        entry.reflectionColor = shader->getUniform<glm::vec3>("reflectionColor");
+        entry.roughness = shader->getUniform<float>("roughness");
+        entry.metalness = shader->getUniform<float>("metalness");
+        entry.texCoordTransform = shader->getUniform<glm::vec4>("texCoordTransform");
+        shaders.push_back(entry);
+        return (unsigned int)shaders.size() - 1;
+    }
+
+    // removes the items and the materials of the previous frame
+    void Clear()
+    {
+        items.clear();
+        materials.clear();
+        submitted = executed = Stats();
+    }
+
+    unsigned int AddMaterial(const Material &material)
+    {
+        materials.push_back(material);
+        return (unsigned int)materials.size() - 1;
+    }
+
+    // adds a draw of the mesh. depth is the distance to the viewer, the closest meshes are drawn first
+    void Submit(RenderPass pass, unsigned int shader, unsigned int material, Mesh &mesh, const glm::mat4 &model,
+                float depth)
+    {
+        Item item;
+        item.key = (uint64_t)pass << 60 | (uint64_t)(shader & 0xFF) << 52 | (uint64_t)(material & 0xFFF) << 40 |
+                   (uint64_t)meshId(mesh) << 24 | depthBits(depth);
+        item.mesh = &mesh;
+        item.material = material;
+        item.model = model;
+        items.push_back(item);
+    }
+
+    // adds a draw of each mesh of the model, their depth is the distance of the center of their bounds to viewPosition
+    void Submit(RenderPass pass, unsigned int shader, unsigned int material, Model &model,
+                const glm::mat4 &modelMatrix, glm::vec3 viewPosition)
+    {
+        for (Mesh &mesh : model.meshes)
+        {
+            glm::vec3 center = glm::vec3(modelMatrix * glm::vec4((mesh.boundsMin + mesh.boundsMax) * 0.5f, 1.0f));
+            Submit(pass, shader, material, mesh, modelMatrix, glm::length(center - viewPosition));
+        }
+    }
+
+    // sorts the items by key, after all of them are submitted
+    void Sort()
+    {
+        sorted.resize(items.size());
+        for (unsigned int i = 0; i < items.size(); i++)
+            sorted[i] = SortEntry{ items[i].key, i };
+        radixSort(sorted, sortBuffer);
+    }
+
+    // draws the items of the pass, in key order
+    void Execute(RenderPass pass)
+    {
+        countSubmitted(pass);
+
+        // the items of the pass are consecutive, after the ones of the previous passes
+        size_t begin = 0;
+        while (begin < sorted.size() && passOf(sorted[begin].key) < pass)
+            begin++;
+        size_t end = begin;
+        while (end < sorted.size() && passOf(sorted[end].key) == pass)
+            end++;
+
+        unsigned int currentShader = ~0u, currentMaterial = ~0u;
+        Mesh *currentMesh = nullptr;
+        glm::mat4 instanceModels[MAX_DRAW_INSTANCES];
+        for (size_t i = begin; i < end;)
+        {
+            const Item &first = items[sorted[i].index];
+            unsigned int shaderIndex = (unsigned int)(sorted[i].key >> 52) & 0xFF;
+            ShaderEntry &entry = shaders[shaderIndex];
+            if (shaderIndex != currentShader)
+            {
+                entry.shader->use();
+                currentShader = shaderIndex;
+                currentMaterial = ~0u;
+                currentMesh = nullptr; // the samplers of the new shader may not be set yet
+                executed.shaderChanges++;
+            }
+            if (first.material != currentMaterial)
+            {
+                const Material &material = materials[first.material];
+                entry.reflectionColor.set(material.reflectionColor);
+                entry.roughness.set(material.roughness);
+                entry.metalness.set(material.metalness);
+                entry.texCoordTransform.set(material.texCoordTransform);
+                currentMaterial = first.material;
+                executed.materialChanges++;
+            }
+            if (first.mesh != currentMesh)
+            {
+                first.mesh->Bind(*entry.shader);
+                currentMesh = first.mesh;
+                executed.meshBinds++;
+            }
+
+            // the following items with the same pass, shader, material and mesh are instances of this one
+            unsigned int instanceCount = 0;
+            uint64_t batch = sorted[i].key >> 24;
+            while (i < end && (sorted[i].key >> 24) == batch && instanceCount < MAX_DRAW_INSTANCES)
+                instanceModels[instanceCount++] = items[sorted[i++].index].model;
+            glUniformMatrix4fv(entry.models, (GLsizei)instanceCount, GL_FALSE, &instanceModels[0][0][0]);
+            currentMesh->DrawInstances((int)instanceCount);
+            executed.drawCalls++;
+        }
+
+        // always good practice to set everything back to defaults once configured.
+        GLState::Get().BindVertexArray(0);
+        GLState::Get().ActiveTexture(GL_TEXTURE0);
+    }
+
+private:
+    struct Item
+    {
+        uint64_t key;
+        Mesh *mesh;
+        unsigned int material;
+        glm::mat4 model;
+    };
+    struct SortEntry
+    {
+        uint64_t key;
+        unsigned int index;
+    };
+    struct ShaderEntry
+    {
+        Shader *shader;
+        GLint models;
+        Uniform<glm::vec3> reflectionColor;
+        Uniform<float> roughness;
+        Uniform<float> metalness;
+        Uniform<glm::vec4> texCoordTransform;
+    };
+
+    std::vector<Item> items;
+    std::vector<SortEntry> sorted, sortBuffer;
+    std::vector<Material> materials;
+    std::vector<ShaderEntry> shaders;
+    std::unordered_map<const Mesh*, unsigned int> meshIds;
+
+    static RenderPass passOf(uint64_t key)
+    {
+        return (RenderPass)(key >> 60);
+    }
+
+    // meshes are numbered in the order they are first submitted
+    unsigned int meshId(const Mesh &mesh)
+    {
+        auto it = meshIds.find(&mesh);
+        if (it == meshIds.end())
+            it = meshIds.emplace(&mesh, (unsigned int)meshIds.size() & 0xFFFF).first;
+        return it->second;
+    }
+
+    // positive floats sort like their bits, the 24 most significant ones are kept
+    static uint64_t depthBits(float depth)
+    {
+        if (!(depth > 0.0f))
+            return 0;
+        uint32_t bits;
+        std::memcpy(&bits, &depth, sizeof(bits));
+        return bits >> 8;
+    }
+
+    // least significant digit first radix sort, one byte per pass. The passes where every key has the same byte are
+    // skipped, most of the key is the same for all the items of a frame
+    static void radixSort(std::vector<SortEntry> &entries, std::vector<SortEntry> &buffer)
+    {
+        buffer.resize(entries.size());
+        for (unsigned int shift = 0; shift < 64; shift += 8)
+        {
+            size_t counts[256] = {};
+            for (const SortEntry &entry : entries)
+                counts[(entry.key >> shift) & 0xFF]++;
+            if (!entries.empty() && counts[(entries[0].key >> shift) & 0xFF] == entries.size())
+                continue;
+
+            size_t offset = 0;
+            for (size_t &count : counts)
+            {
+                size_t start = offset;
+                offset += count;
+                count = start;
+            }
+            for (const SortEntry &entry : entries)
+                buffer[counts[(entry.key >> shift) & 0xFF]++] = entry;
+            entries.swap(buffer);
+        }
+    }
+
+    // draws and state changes of drawing the items of the pass as they were submitted
+    void countSubmitted(RenderPass pass)
+    {
+        unsigned int material = ~0u;
+        bool first = true;
+        for (const Item &item : items)
+        {
+            if (passOf(item.key) != pass)
+                continue;
+            if (first)
+                submitted.shaderChanges++;
+            first = false;
+            if (item.material != material)
+                submitted.materialChanges++;
+            material = item.material;
+            submitted.meshBinds++;
+            submitted.drawCalls++;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,156 @@
+#ifndef SCENE_GRAPH_H
+#define SCENE_GRAPH_H
+
+#include <glm/glm.hpp>
+
+#include "model.h"
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+// Scene graph.
+// Each node has a local transform, relative to its parent, and a world transform, the parent world transform times
+// the local one. Setting a local transform only marks the node as dirty: Update recomputes the world transforms of
+// the dirty nodes and of their descendants, and leaves the rest of the graph as it was. A node that holds a model also
+// has world space bounds, an axis aligned box around the model, and every node has the bounds of its whole subtree, so
+// a group can be culled with a single test.
+// The nodes are stored in arrays, in the order they are added. A node is always added after its parent, so a parent
+// comes before its children, and both updates are a single pass over the arrays.
+class SceneGraph
+{
+public:
+    typedef unsigned int NodeId;
+    static const NodeId ROOT = 0;
+
+    // nodes whose world transform was recomputed by the last Update, of the total
+    struct Stats
+    {
+        unsigned int updated = 0;
+        unsigned int nodes = 0;
+    };
+    Stats stats;
+
+    SceneGraph()
+    {
+        addNode(ROOT, glm::mat4(1.0f), nullptr);
+        parents[ROOT] = ROOT;
+    }
+
+    // adds a node under parent. The bounds of the node are the ones of the meshes of the model, if there is one
+    NodeId AddNode(NodeId parent, const glm::mat4 &local = glm::mat4(1.0f), const Model *model = nullptr)
+    {
+        return addNode(parent, local, model);
+    }
+
+    void SetLocal(NodeId node, const glm::mat4 &local)
+    {
+        locals[node] = local;
+        dirty[node] = true;
+    }
+
+    const glm::mat4& Local(NodeId node) const { return locals[node]; }
+    // valid after Update
+    const glm::mat4& World(NodeId node) const { return worlds[node]; }
+    // world space bounds of the model of the node, empty (min > max) if it has no model. Valid after Update
+    const glm::vec3& BoundsMin(NodeId node) const { return boundsMin[node]; }
+    const glm::vec3& BoundsMax(NodeId node) const { return boundsMax[node]; }
+    // world space bounds of the node and all its descendants. Valid after Update
+    const glm::vec3& SubtreeBoundsMin(NodeId node) const { return subtreeMin[node]; }
+    const glm::vec3& SubtreeBoundsMax(NodeId node) const { return subtreeMax[node]; }
+
+    // recomputes the world transforms and the bounds of the dirty nodes and their descendants, once per frame after
+    // the local transforms are set
+    void Update()
+    {
+        stats.updated = 0;
+        stats.nodes = (unsigned int)parents.size();
+
+        // parents first: a node is recomputed when it or its parent changed
+        std::vector<bool> changed(parents.size(), false);
+        for (NodeId node = 0; node < parents.size(); node++)
+        {
+            NodeId parent = parents[node];
+            if (!dirty[node] && !(node != ROOT && changed[parent]))
+                continue;
+            worlds[node] = node == ROOT ? locals[node] : worlds[parent] * locals[node];
+            transformBounds(node);
+            dirty[node] = false;
+            changed[node] = true;
+            stats.updated++;
+        }
+
+        // children first: the subtree bounds of a node change when its bounds or the ones of a child change
+        std::vector<bool> subtreeChanged(changed);
+        for (NodeId node = (NodeId)parents.size() - 1; node != ROOT; node--)
+            if (subtreeChanged[node])
+                subtreeChanged[parents[node]] = true;
+        for (NodeId node = 0; node < parents.size(); node++)
+            if (subtreeChanged[node])
+            {
+                subtreeMin[node] = boundsMin[node];
+                subtreeMax[node] = boundsMax[node];
+            }
+        for (NodeId node = (NodeId)parents.size() - 1; node != ROOT; node--)
+        {
+            NodeId parent = parents[node];
+            if (!subtreeChanged[parent])
+                continue;
+            subtreeMin[parent] = glm::min(subtreeMin[parent], subtreeMin[node]);
+            subtreeMax[parent] = glm::max(subtreeMax[parent], subtreeMax[node]);
+        }
+    }
+
+private:
+    std::vector<NodeId> parents;
+    std::vector<glm::mat4> locals, worlds;
+    std::vector<bool> dirty;
+    // bounds of the model, in the space of the node
+    std::vector<glm::vec3> localMin, localMax;
+    std::vector<glm::vec3> boundsMin, boundsMax, subtreeMin, subtreeMax;
+
+    NodeId addNode(NodeId parent, const glm::mat4 &local, const Model *model)
+    {
+        glm::vec3 emptyMin(std::numeric_limits<float>::max()), emptyMax(-std::numeric_limits<float>::max());
+        glm::vec3 modelMin = emptyMin, modelMax = emptyMax;
+        if (model)
+            for (const Mesh &mesh : model->meshes)
+            {
+                modelMin = glm::min(modelMin, mesh.boundsMin);
+                modelMax = glm::max(modelMax, mesh.boundsMax);
+            }
+
+        parents.push_back(parent);
+        locals.push_back(local);
+        worlds.push_back(local);
+        dirty.push_back(true);
+        localMin.push_back(modelMin);
+        localMax.push_back(modelMax);
+        boundsMin.push_back(emptyMin);
+        boundsMax.push_back(emptyMax);
+        subtreeMin.push_back(emptyMin);
+        subtreeMax.push_back(emptyMax);
+        return (NodeId)parents.size() - 1;
+    }
+
+    // box around the local bounds in world space: each column of the matrix adds its smallest and largest
+    // contribution, which gives the same box as transforming the 8 corners
+    void transformBounds(NodeId node)
+    {
+        if (localMin[node].x > localMax[node].x)
+            return; // no model, the bounds stay empty
+        const glm::mat4 &world = worlds[node];
+        glm::vec3 newMin = glm::vec3(world[3]), newMax = glm::vec3(world[3]);
+        for (int column = 0; column < 3; column++)
+        {
+            glm::vec3 a = glm::vec3(world[column]) * localMin[node][column];
+            glm::vec3 b = glm::vec3(world[column]) * localMax[node][column];
+            newMin += glm::min(a, b);
+            newMax += glm::max(a, b);
+        }
+        boundsMin[node] = newMin;
+        boundsMax[node] = newMax;
+    }
+};
+
+#endif
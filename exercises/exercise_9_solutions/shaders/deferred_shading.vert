@@ -4,7 +4,8 @@ layout (location = 1) in vec3 normal;
 layout (location = 2) in vec2 textCoord;
 layout (location = 3) in vec3 tangent;
 
-uniform mat4 model; // represents model coordinates in the world coord space
+#define MAX_DRAW_INSTANCES 32 // same as in render_queue.h
+uniform mat4 models[MAX_DRAW_INSTANCES]; // model coordinates in the world coord space, of each instance of the draw
 uniform mat4 viewProjection;  // represents the view and projection matrices combined
 uniform vec4 texCoordTransform; // scale and offset for texture coordinates
 
@@ -15,6 +16,7 @@ out vec3 worldNormal;
 out vec3 worldTangent;
 
 void main() {
+   mat4 model = models[gl_InstanceID];
 
    // Read the texture coordinates from the attribute and pass it to the fragment shader
    textureCoordinates = textCoord * texCoordTransform.xy + texCoordTransform.zw;
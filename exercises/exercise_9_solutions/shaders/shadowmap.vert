@@ -2,9 +2,10 @@
 layout (location = 0) in vec3 vertex;
 
 uniform mat4 lightSpaceMatrix;
-uniform mat4 model;
+#define MAX_DRAW_INSTANCES 32 // same as in render_queue.h
+uniform mat4 models[MAX_DRAW_INSTANCES];
 
 void main()
 {
-   gl_Position = lightSpaceMatrix * model * vec4(vertex, 1.0);
+   gl_Position = lightSpaceMatrix * models[gl_InstanceID] * vec4(vertex, 1.0);
 }
\ No newline at end of file